@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "autospeed.h"
+#include "cache.h"
+
+#define AUTO_SPEED_MAGIC   0x50493843u // "C8IP"
+#define AUTO_SPEED_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ipf;
+    uint32_t pace;
+    uint32_t reserved;
+    uint64_t core; // chip8CoreId: the speed depends on how the core runs the ROM.
+} AutoSpeedFile;
+
+static int clampIpf(int ipf) {
+    if (ipf < AUTO_SPEED_MIN_IPF)
+        return AUTO_SPEED_MIN_IPF;
+    return ipf > AUTO_SPEED_MAX_IPF ? AUTO_SPEED_MAX_IPF : ipf;
+}
+
+int loadAutoSpeed(uint64_t program_hash) {
+    char path[4096];
+    AutoSpeedFile f;
+    if (!cachePath("ipf", program_hash, ".ipf", path, sizeof(path)) ||
+        readCacheFile(path, &f, sizeof(f)) != (long)sizeof(f) ||
+        f.magic != AUTO_SPEED_MAGIC || f.version != AUTO_SPEED_VERSION ||
+        f.core != chip8CoreId())
+        return 0;
+    return clampIpf((int)f.ipf);
+}
+
+void saveAutoSpeed(AutoSpeed *as) {
+    char path[4096];
+    AutoSpeedFile f = { AUTO_SPEED_MAGIC, AUTO_SPEED_VERSION, as->ipf, as->pace, 0, chip8CoreId() };
+    if (!as->converged || as->ipf == as->saved_ipf ||
+        !cachePath("ipf", as->program_hash, ".ipf", path, sizeof(path)))
+        return;
+    if (writeCacheFile(path, &f, sizeof(f)))
+        as->saved_ipf = as->ipf;
+}
+
+void initAutoSpeed(AutoSpeed *as, uint64_t program_hash, int start_ipf) {
+    memset(as, 0, sizeof(*as));
+    as->program_hash = program_hash;
+    as->saved_ipf = loadAutoSpeed(program_hash);
+    as->ipf = as->saved_ipf ? as->saved_ipf : clampIpf(start_ipf);
+    as->poll_pc = 0xFFFF;
+}
+
+const char *guestPaceName(GuestPace pace) {
+    switch (pace) {
+        case PACE_TIMER: return "timer";
+        case PACE_DRAW:  return "draw";
+        default:         return "unknown";
+    }
+}
+
+static int compareInts(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+static void endWindow(AutoSpeed *as) {
+    int before = as->ipf;
+    if (as->pace == PACE_TIMER && as->starved == 0 && as->busy_max > 0) {
+        // Headroom for heavier scenes, but never back down to a value that
+        // starved recently.
+        int target = as->busy_max * 6 / 5 + 2;
+        if (target <= as->starved_ipf)
+            target = as->starved_ipf + 1;
+        as->ipf = clampIpf(target);
+    } else if (as->pace != PACE_TIMER && as->draw_count >= AUTO_SPEED_DRAWS / 4) {
+        int n = as->draw_count < AUTO_SPEED_DRAWS ? as->draw_count : AUTO_SPEED_DRAWS;
+        int gaps[AUTO_SPEED_DRAWS];
+        memcpy(gaps, as->draw_gaps, n * sizeof(int));
+        qsort(gaps, n, sizeof(int), compareInts);
+        as->pace = PACE_DRAW;
+        as->ipf = clampIpf(gaps[n / 2]);
+    }
+    as->starved_ipf = as->starved_ipf * 7 / 8;
+
+    int diff = as->ipf > before ? as->ipf - before : before - as->ipf;
+    if (as->pace != PACE_UNKNOWN && as->starved == 0 && diff * 10 <= before) {
+        if (++as->stable >= AUTO_SPEED_STABLE && !as->converged) {
+            as->converged = 1;
+            saveAutoSpeed(as);
+        }
+    } else {
+        as->stable = 0;
+        as->converged = 0;
+    }
+    as->frames = 0;
+    as->busy_max = 0;
+    as->starved = 0;
+}
+
+void runAutoFrame(AutoSpeed *as, Chip8 *chip8) {
+    int executed = 0, idle = 0;
+    // A loop left some other way (a key check, say) ends with the timer.
+    if (chip8->delay_timer == 0) {
+        as->polling = 0;
+        as->poll_pc = 0xFFFF;
+    }
+    for (; executed < as->ipf && !chip8->halted; executed++) {
+        uint16_t pc = chip8->pc & ADDRESS_MASK;
+        uint16_t opcode = fetchOpcode(chip8);
+        uint8_t timer = chip8->delay_timer;
+        emulateCycle(chip8);
+        as->instructions++;
+
+        if ((opcode & 0xF0FF) == 0xF007) {
+            if (timer == 0) {
+                // The wait is over; the next read starts a new one.
+                as->polling = 0;
+                as->poll_pc = 0xFFFF;
+            } else if (pc != as->poll_pc) {
+                as->poll_pc = pc;
+                as->poll_start = as->instructions - 1;
+                as->polling = 0;
+            } else if (!as->polling) {
+                // Back at the same read with the timer still running: the
+                // loop since the first read was waiting too.
+                uint64_t waited = as->instructions - as->poll_start;
+                as->polling = 1;
+                idle += waited < (uint64_t)executed + 1 ? (int)waited : executed + 1;
+            } else {
+                idle++;
+            }
+        } else if (as->polling) {
+            idle++;
+        } else if ((opcode & 0xF0FF) == 0xF00A && (chip8->pc & ADDRESS_MASK) == pc) {
+            idle++;
+        } else if (opcode == (0x1000 | pc)) {
+            idle++;
+        } else if ((opcode & 0xF000) == 0xD000) {
+            uint64_t gap = as->instructions - as->last_draw;
+            if (as->last_draw && gap <= AUTO_SPEED_MAX_IPF)
+                as->draw_gaps[as->draw_count++ % AUTO_SPEED_DRAWS] = (int)gap;
+            as->last_draw = as->instructions;
+        }
+    }
+    // Reaching a timer read with time left counts as waiting even if the
+    // frame ended before the loop came round again.
+    if (as->poll_pc != 0xFFFF && !as->polling && chip8->delay_timer > 0) {
+        uint64_t waited = as->instructions - as->poll_start;
+        idle += waited < (uint64_t)executed - idle ? (int)waited : executed - idle;
+    }
+    tickTimers(chip8);
+
+    as->busy_total += executed - idle;
+    as->idle_total += idle;
+    if (idle > 0 && as->pace != PACE_TIMER) {
+        as->pace = PACE_TIMER;
+        as->stable = 0;
+    }
+    if (as->pace == PACE_TIMER && idle == 0 && executed == as->ipf && as->ipf < AUTO_SPEED_MAX_IPF) {
+        // Never got to wait: the game is behind. At the cap there is
+        // nothing more to give, so it settles there.
+        as->starved++;
+        as->starved_total++;
+        if (as->ipf > as->starved_ipf)
+            as->starved_ipf = as->ipf;
+        as->ipf = clampIpf(as->ipf * 3 / 2 + 1);
+    } else if (executed - idle > as->busy_max) {
+        as->busy_max = executed - idle;
+    }
+    if (++as->frames == AUTO_SPEED_WINDOW)
+        endWindow(as);
+}
+
+int runAutoSpeedReport(const char *rom_path, int frames) {
+    Chip8 *chip8 = allocChip8(sizeof(Chip8));
+    AutoSpeed as;
+    if (!chip8)
+        return 1;
+    initializeChip8(chip8);
+    seedChip8(chip8, 0x2545F491);
+    if (!loadROM(chip8, rom_path)) {
+        free(chip8);
+        return 1;
+    }
+    initAutoSpeed(&as, hashProgram(chip8), DEFAULT_CYCLES_PER_FRAME);
+    if (as.saved_ipf)
+        printf("cached:   %d IPF\n", as.saved_ipf);
+    printf("%6s %6s %-8s %8s %8s %9s\n", "second", "ipf", "pace", "busy%", "starved", "converged");
+
+    // Tap a key now and then so title screens that wait for one move on.
+    uint32_t rng = 0x9E3779B9;
+    uint64_t last_busy = 0, last_idle = 0, last_starved = 0;
+    for (int frame = 1; frame <= frames && !chip8->halted; frame++) {
+        if (frame % 90 == 0) {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            setKeyMask(chip8, 1u << (rng & 15));
+        } else if (frame % 90 == 4) {
+            setKeyMask(chip8, 0);
+        }
+        runAutoFrame(&as, chip8);
+        if (frame % 60 == 0) {
+            uint64_t busy = as.busy_total - last_busy, idle = as.idle_total - last_idle;
+            printf("%6d %6d %-8s %7.1f%% %8llu %9s\n", frame / 60, as.ipf, guestPaceName(as.pace),
+                   busy + idle ? 100.0 * busy / (busy + idle) : 0.0,
+                   (unsigned long long)(as.starved_total - last_starved), as.converged ? "yes" : "no");
+            last_busy = as.busy_total;
+            last_idle = as.idle_total;
+            last_starved = as.starved_total;
+        }
+    }
+    printf("chosen:   %d IPF (%s-paced%s), %llu instructions, %.1f%% busy\n", as.ipf,
+           guestPaceName(as.pace), as.converged ? "" : ", not converged",
+           (unsigned long long)as.instructions,
+           as.instructions ? 100.0 * as.busy_total / as.instructions : 0.0);
+    free(chip8);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#ifndef AUTOSPEED_H
+#define AUTOSPEED_H
+
+#include <stdint.h>
+#include "chip8.h"
+
+// Automatic instructions-per-frame calibration. Frames run one instruction
+// at a time while the guest's pacing is watched:
+//
+// - Timer-paced games finish a frame's work and then wait: they poll the
+//   delay timer (FX07 at the same address until it reads 0), wait for a
+//   key (FX0A), or jump to themselves. Everything else is busy work. A
+//   frame with no waiting means the game is behind, so IPF grows. Once
+//   every frame has slack, IPF drops to the largest busy count seen plus
+//   headroom.
+// - Games that never wait are paced by the CPU. The VIP held each sprite
+//   draw until vertical blank, so such games get one DXYN per frame: IPF
+//   becomes the median number of instructions between draws.
+//
+// When the value has held for a few seconds it is saved in the cache
+// (cache.h) under the ROM's program hash, and later runs start from it.
+
+#define AUTO_SPEED_MIN_IPF  7
+#define AUTO_SPEED_MAX_IPF  3000
+#define AUTO_SPEED_WINDOW   30 // Frames per adjustment.
+#define AUTO_SPEED_STABLE   4  // Windows within 10% before saving.
+#define AUTO_SPEED_DRAWS    32 // Draw intervals kept for the median.
+
+typedef enum { PACE_UNKNOWN, PACE_TIMER, PACE_DRAW } GuestPace;
+
+typedef struct {
+    uint64_t program_hash;
+    int ipf;
+    int saved_ipf;    // Value in the cache, or 0.
+    int converged;    // Held for AUTO_SPEED_STABLE windows.
+    GuestPace pace;
+
+    // Wait tracking.
+    uint16_t poll_pc;     // FX07 last seen reading a running timer.
+    uint64_t poll_start;  // Instruction count at that read.
+    int polling;          // In a confirmed delay-timer loop.
+    uint64_t instructions;
+
+    // Current window.
+    int frames;
+    int busy_max;
+    int starved;          // Timer-paced frames without any waiting.
+    int starved_ipf;      // Highest IPF that starved recently.
+    int stable;
+
+    // Draw-paced estimate.
+    uint64_t last_draw;
+    int draw_gaps[AUTO_SPEED_DRAWS];
+    int draw_count;
+
+    // Totals for reports.
+    uint64_t busy_total;
+    uint64_t idle_total;
+    uint64_t starved_total;
+} AutoSpeed;
+
+// Start from the cached value for this ROM, else `start_ipf`.
+void initAutoSpeed(AutoSpeed *as, uint64_t program_hash, int start_ipf);
+// Run one 60 Hz frame (including the timer tick) and adjust.
+void runAutoFrame(AutoSpeed *as, Chip8 *chip8);
+// The cached IPF for a ROM, or 0.
+int loadAutoSpeed(uint64_t program_hash);
+// Once converged, write the value to the cache if it differs from the
+// saved one.
+void saveAutoSpeed(AutoSpeed *as);
+const char *guestPaceName(GuestPace pace);
+
+// Headless calibration run with a report every second.
+int runAutoSpeedReport(const char *rom_path, int frames);
+
+#endif
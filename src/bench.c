@@ -0,0 +1,156 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "chip8.h"
+#include "bench.h"
+#include "kernels.h"
+#include "memo.h"
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int runInstanceBench(const char *rom_path, int instances, int frames, int cycles_per_frame) {
+    if (instances <= 0)
+        instances = 1;
+    if (cycles_per_frame <= 0)
+        cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+    Chip8 *machines = allocChip8(instances * sizeof(Chip8));
+    if (!machines) {
+        fprintf(stderr, "Out of memory for %d instances\n", instances);
+        return 1;
+    }
+    initializeChip8(&machines[0]);
+    if (!loadROM(&machines[0], rom_path)) {
+        free(machines);
+        return 1;
+    }
+    for (int i = 0; i < instances; i++) {
+        if (i > 0)
+            machines[i] = machines[0];
+        seedChip8(&machines[i], i + 1);
+    }
+
+    double start = nowSeconds();
+    for (int f = 0; f < frames; f++)
+        for (int i = 0; i < instances; i++)
+            runFrame(&machines[i], cycles_per_frame);
+    double elapsed = nowSeconds() - start;
+
+    double instructions = (double)instances * frames * cycles_per_frame;
+    printf("instances:    %d (%zu bytes each, %.1f MB total)\n", instances, sizeof(Chip8),
+           (double)instances * sizeof(Chip8) / (1 << 20));
+    printf("frames:       %d at %d cycles/frame\n", frames, cycles_per_frame);
+    printf("elapsed:      %.3f s\n", elapsed);
+    printf("throughput:   %.1f M instructions/s, %.0f frames/s\n",
+           elapsed > 0 ? instructions / elapsed / 1e6 : 0.0,
+           elapsed > 0 ? (double)instances * frames / elapsed : 0.0);
+    free(machines);
+    return 0;
+}
+
+// Execute one opcode `iterations` times on a busy display.
+static double timeOpcode(Chip8 *chip8, uint16_t opcode, int iterations) {
+    chip8->memory[START_ADDRESS] = opcode >> 8;
+    chip8->memory[START_ADDRESS + 1] = opcode & 0xFF;
+    for (int i = 0; i < MAX_WIDTH * MAX_HEIGHT; i++)
+        chip8->display[i] = (i * 7 >> 3) & 1;
+    double start = nowSeconds();
+    for (int i = 0; i < iterations; i++) {
+        chip8->pc = START_ADDRESS;
+        emulateCycle(chip8);
+    }
+    return (nowSeconds() - start) * 1e9 / iterations;
+}
+
+int runScrollBench(int iterations) {
+    static const struct { uint16_t opcode; const char *name; } ops[] = {
+        { 0x00C4, "00C4 scroll down 4" },
+        { 0x00FB, "00FB scroll right" },
+        { 0x00FC, "00FC scroll left" },
+    };
+    static Chip8 chip8;
+    if (iterations <= 0)
+        iterations = 1000000;
+    printf("%-20s %12s %12s\n", "opcode", "lores ns", "hires ns");
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        initializeChip8(&chip8);
+        double lores = timeOpcode(&chip8, ops[i].opcode, iterations);
+        chip8.memory[START_ADDRESS] = 0x00;
+        chip8.memory[START_ADDRESS + 1] = 0xFF;
+        chip8.pc = START_ADDRESS;
+        emulateCycle(&chip8);
+        double hires = timeOpcode(&chip8, ops[i].opcode, iterations);
+        printf("%-20s %12.1f %12.1f\n", ops[i].name, lores, hires);
+    }
+    return 0;
+}
+
+// Run each kernel over the same inputs; returns a checksum of the results
+// so every version can be compared with the generic one.
+static uint64_t kernelWork(int kernel, Chip8 *chip8, uint32_t *pixels, int iterations) {
+    uint64_t sum = 0;
+    uint32_t seed = 0x2545F491;
+    for (int i = 0; i < iterations; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        switch (kernel) {
+            case KERNEL_BLIT_ROW: {
+                int width = seed & 1 ? 16 : 8;
+                uint8_t *row = &chip8->display[(seed >> 8 & 63) * MAX_WIDTH];
+                sum += kernels.blit_row(row, seed >> 16 & 0xFF, seed >> 1 & (width == 16 ? 0xFFFF : 0xFF00),
+                                        width, EXT_WIDTH);
+                break;
+            }
+            case KERNEL_PALETTE:
+                for (int y = 0; y < EXT_HEIGHT; y++)
+                    kernels.expand_palette(&chip8->display[y * MAX_WIDTH], &pixels[y * MAX_WIDTH],
+                                           EXT_WIDTH, 0xFF00FFFF, seed);
+                sum = sum * 31 + pixels[seed % (MAX_WIDTH * MAX_HEIGHT)];
+                break;
+            default:
+                chip8->V[0] = seed;
+                sum = sum * 31 + hashState(chip8);
+                break;
+        }
+    }
+    if (kernel == KERNEL_BLIT_ROW)
+        for (int i = 0; i < MAX_WIDTH * MAX_HEIGHT; i++)
+            sum = sum * 31 + chip8->display[i];
+    return sum;
+}
+
+int runKernelBench(int iterations) {
+    static Chip8 chip8;
+    static uint32_t pixels[MAX_WIDTH * MAX_HEIGHT];
+    if (iterations <= 0)
+        iterations = 100000;
+    CpuLevel selected = selectedCpuLevel(), best = detectCpuLevel();
+    int mismatches = 0;
+    printf("%-12s %-8s %-8s %12s %8s\n", "kernel", "level", "version", "ns/call", "result");
+    for (int k = 0; k < KERNEL_COUNT; k++) {
+        // Display work is per frame, hashing per state; scale to similar run times.
+        int n = k == KERNEL_BLIT_ROW ? iterations * 10 : iterations / 10;
+        uint64_t reference = 0;
+        for (int level = CPU_LEVEL_GENERIC; level <= (int)best; level++) {
+            selectKernels(level);
+            initializeChip8(&chip8);
+            double start = nowSeconds();
+            uint64_t sum = kernelWork(k, &chip8, pixels, n);
+            double ns = (nowSeconds() - start) * 1e9 / n;
+            if (level == CPU_LEVEL_GENERIC)
+                reference = sum;
+            int ok = sum == reference;
+            mismatches += !ok;
+            printf("%-12s %-8s %-8s %12.1f %8s\n", kernelName(k), cpuLevelName(level),
+                   cpuLevelName(kernelLevel(k, level)), ns, ok ? "ok" : "MISMATCH");
+        }
+    }
+    selectKernels(selected);
+    return mismatches ? 1 : 0;
+}
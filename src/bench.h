@@ -0,0 +1,21 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Core throughput benchmarks. Each prints its results and returns a
+// process exit status.
+
+// Step `instances` machines round-robin, one frame each, for `frames`
+// frames, and report instructions per second. One instance measures the
+// hot loop; thousands measure how much state each step drags through the
+// cache.
+int runInstanceBench(const char *rom_path, int instances, int frames, int cycles_per_frame);
+
+// Time the SCHIP scroll opcodes (00CN, 00FB, 00FC) in both display modes
+// and report nanoseconds per scroll.
+int runScrollBench(int iterations);
+
+// Time every version of each dispatched kernel the CPU can run (see
+// kernels.h) and check that all give the generic version's results.
+int runKernelBench(int iterations);
+
+#endif
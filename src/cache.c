@@ -0,0 +1,65 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+// mkdir -p.
+static int makeDirs(char *path) {
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        int r = mkdir(path, 0755);
+        *p = '/';
+        if (r < 0 && errno != EEXIST)
+            return 0;
+    }
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+int cachePath(const char *kind, uint64_t key, const char *ext, char *out, size_t len) {
+    char dir[4096];
+    const char *base = getenv("CUPID8_CACHE_DIR");
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (base && *base)
+        snprintf(dir, sizeof(dir), "%s/%s", base, kind);
+    else if (xdg && *xdg)
+        snprintf(dir, sizeof(dir), "%s/cupid-8/%s", xdg, kind);
+    else if (home && *home)
+        snprintf(dir, sizeof(dir), "%s/.cache/cupid-8/%s", home, kind);
+    else
+        return 0;
+    if (!makeDirs(dir))
+        return 0;
+    return snprintf(out, len, "%s/%016llx%s", dir, (unsigned long long)key, ext) < (int)len;
+}
+
+long readCacheFile(const char *path, void *buf, size_t len) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return -1;
+    size_t n = fread(buf, 1, len, f);
+    fclose(f);
+    return (long)n;
+}
+
+int writeCacheFile(const char *path, const void *data, size_t len) {
+    static unsigned sequence;
+    char tmp[4200];
+    snprintf(tmp, sizeof(tmp), "%s.%ld.%u.tmp", path, (long)getpid(),
+             __atomic_fetch_add(&sequence, 1, __ATOMIC_RELAXED));
+    FILE *f = fopen(tmp, "wb");
+    if (!f)
+        return 0;
+    int ok = fwrite(data, 1, len, f) == len;
+    ok &= fclose(f) == 0;
+    if (ok && rename(tmp, path) == 0)
+        return 1;
+    unlink(tmp);
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-user on-disk cache, keyed by program hash (see hashProgram). Files
+// live in $CUPID8_CACHE_DIR, else $XDG_CACHE_HOME/cupid-8, else
+// ~/.cache/cupid-8, with one subdirectory per kind of entry.
+
+// Build the path of the entry for `key`, creating directories as needed.
+// Returns 0 if there is nowhere to put the cache.
+int cachePath(const char *kind, uint64_t key, const char *ext, char *out, size_t len);
+// Read up to len bytes of a cache file. Returns the size read, or -1.
+long readCacheFile(const char *path, void *buf, size_t len);
+// Replace a cache file atomically (write a temporary, then rename), so
+// concurrent readers and crashed writers never leave a torn entry.
+int writeCacheFile(const char *path, const void *data, size_t len);
+
+#endif
@@ -0,0 +1,510 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chip8.h"
+#include "kernels.h"
+
+// Standard Chip-8 fontset (each character is 5 bytes).
+const uint8_t chip8_fontset[80] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+// Initialize the Chip-8 system.
+void initializeChip8(Chip8 *chip8) {
+    memset(chip8, 0, sizeof(*chip8));
+    chip8->pc = START_ADDRESS;
+    chip8->screen_width = NORMAL_WIDTH;
+    chip8->screen_height = NORMAL_HEIGHT;
+    chip8->rng = 1;
+    memcpy(chip8->memory + FONT_ADDRESS, chip8_fontset, sizeof(chip8_fontset));
+}
+
+// Zeroed heap memory aligned for Chip8 and structs that embed one, which a
+// plain malloc doesn't guarantee. Release it with free().
+void *allocChip8(size_t size) {
+    void *p;
+    if (posix_memalign(&p, CHIP8_CACHE_LINE, size ? size : 1) != 0)
+        return NULL;
+    memset(p, 0, size);
+    return p;
+}
+
+// Seed the per-machine random number generator used by CXKK.
+void seedChip8(Chip8 *chip8, uint32_t seed) {
+    chip8->rng = seed ? seed : 1; // xorshift has a fixed point at zero.
+}
+
+// Load the Chip-8 ROM into memory.
+int loadROM(Chip8 *chip8, const char *filename) {
+    FILE *rom = fopen(filename, "rb");
+    if (!rom) {
+        perror("Failed to open ROM");
+        return 0;
+    }
+    fseek(rom, 0, SEEK_END);
+    long rom_size = ftell(rom);
+    rewind(rom);
+    if (rom_size > (MEMORY_SIZE - START_ADDRESS)) {
+        fprintf(stderr, "ROM too large for memory\n");
+        fclose(rom);
+        return 0;
+    }
+    fread(chip8->memory + START_ADDRESS, sizeof(uint8_t), rom_size, rom);
+    fclose(rom);
+    return 1;
+}
+
+// Load a ROM image that is already in host memory.
+int loadROMData(Chip8 *chip8, const uint8_t *data, size_t size) {
+    if (size > (MEMORY_SIZE - START_ADDRESS))
+        return 0;
+    memcpy(chip8->memory + START_ADDRESS, data, size);
+    return 1;
+}
+
+// Identify the loaded program: FNV-1a over the program area. Call it right
+// after loading, before the program can modify itself.
+uint64_t hashProgram(const Chip8 *chip8) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int i = START_ADDRESS; i < MEMORY_SIZE; i++) {
+        h ^= chip8->memory[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+uint64_t chip8CoreId(void) {
+    return hashMix(hashMix(CHIP8_CORE_VERSION, CHIP8_STATE_VERSION), sizeof(Chip8));
+}
+
+// Fetch the next opcode (16 bits) from memory.
+uint16_t fetchOpcode(Chip8 *chip8) {
+    return chip8->memory[chip8->pc & ADDRESS_MASK] << 8 |
+           chip8->memory[(chip8->pc + 1) & ADDRESS_MASK];
+}
+
+// SCHIP 1.1 scrolls by hires pixels even in lores mode, so there a scroll
+// moves half as many (lores) pixels.
+static int scrollAmount(const Chip8 *chip8, int n) {
+    if (!chip8->extended_mode && (chip8->quirks & QUIRK_LORES_HALF_SCROLL))
+        return n / 2;
+    return n;
+}
+
+// Shift every row by `shift` pixels, clearing the vacated edge. Inlined
+// with a constant shift, these loops vectorize and beat memmove calls on
+// rows this short.
+static inline void shiftRows(Chip8 *chip8, int direction, int shift) {
+    if (direction > 0) {
+        for (int y = 0; y < chip8->screen_height; y++) {
+            for (int x = chip8->screen_width - 1; x >= shift; x--) {
+                chip8->display[y * MAX_WIDTH + x] = chip8->display[y * MAX_WIDTH + (x - shift)];
+            }
+            for (int x = 0; x < shift; x++) {
+                chip8->display[y * MAX_WIDTH + x] = 0;
+            }
+        }
+    } else {
+        for (int y = 0; y < chip8->screen_height; y++) {
+            for (int x = 0; x < chip8->screen_width - shift; x++) {
+                chip8->display[y * MAX_WIDTH + x] = chip8->display[y * MAX_WIDTH + (x + shift)];
+            }
+            for (int x = chip8->screen_width - shift; x < chip8->screen_width; x++) {
+                chip8->display[y * MAX_WIDTH + x] = 0;
+            }
+        }
+    }
+}
+
+// Helper: Scroll display horizontally by 4 pixels (2 with the lores
+// half-scroll quirk).
+void scroll_horizontal(Chip8 *chip8, int direction) {
+    if (scrollAmount(chip8, 4) == 4)
+        shiftRows(chip8, direction, 4);
+    else
+        shiftRows(chip8, direction, 2);
+}
+
+// Helper: Scroll display down by n rows. The rows kept are one contiguous
+// block at MAX_WIDTH stride; columns past screen_width stay zero in lores,
+// so moving whole stride rows is safe.
+void scroll_down(Chip8 *chip8, int n) {
+    n = scrollAmount(chip8, n);
+    int keep = chip8->screen_height - n;
+    memmove(chip8->display + n * MAX_WIDTH, chip8->display, keep * MAX_WIDTH);
+    memset(chip8->display, 0, n * MAX_WIDTH);
+}
+
+// xorshift32: cheap, and deterministic per machine so snapshots replay.
+static uint32_t nextRandom(Chip8 *chip8) {
+    uint32_t r = chip8->rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    chip8->rng = r;
+    return r;
+}
+
+// The byte CXKK masks; exposed so translated code draws the same sequence.
+uint8_t randomByte(Chip8 *chip8) {
+    return nextRandom(chip8) & 0xFF;
+}
+
+// Emulate one cycle (fetch, decode, execute).
+// Every guest-controlled index (addresses from pc and I, the stack pointer,
+// key numbers) is masked into range, so arbitrary ROMs and snapshots cannot
+// reach outside the struct. Addresses wrap at 4 KB and the stack wraps at 16
+// levels, which costs one AND per access instead of a branch.
+void emulateCycle(Chip8 *chip8) {
+    uint16_t opcode = fetchOpcode(chip8);
+    chip8->pc += 2;
+    chip8->cycles++;
+
+    uint8_t x   = (opcode & 0x0F00) >> 8;
+    uint8_t y   = (opcode & 0x00F0) >> 4;
+    uint8_t kk  = opcode & 0x00FF;
+    uint16_t nnn = opcode & 0x0FFF;
+    uint8_t n   = opcode & 0x000F;
+
+    // SCHIP extended opcodes.
+    if ((opcode & 0xF0FF) == 0x00FB) {       // 00FB: Scroll right 4 pixels.
+        scroll_horizontal(chip8, +1);
+        return;
+    } else if ((opcode & 0xF0FF) == 0x00FC) { // 00FC: Scroll left 4 pixels.
+        scroll_horizontal(chip8, -1);
+        return;
+    } else if ((opcode & 0xF0FF) == 0x00FD) { // 00FD: Exit interpreter.
+        chip8->halted = 1;
+        return;
+    } else if ((opcode & 0xF0FF) == 0x00FE) { // 00FE: Disable extended mode.
+        chip8->extended_mode = 0;
+        chip8->screen_width = NORMAL_WIDTH;
+        chip8->screen_height = NORMAL_HEIGHT;
+        memset(chip8->display, 0, sizeof(chip8->display));
+        return;
+    } else if ((opcode & 0xF0FF) == 0x00FF) { // 00FF: Enable extended mode.
+        chip8->extended_mode = 1;
+        chip8->screen_width = EXT_WIDTH;
+        chip8->screen_height = EXT_HEIGHT;
+        memset(chip8->display, 0, sizeof(chip8->display));
+        return;
+    } else if ((opcode & 0xF000) == 0x0000 && (opcode & 0x00F0) == 0x00C0) {
+        int n_rows = opcode & 0x000F;
+        scroll_down(chip8, n_rows);
+        return;
+    }
+
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            switch (opcode) {
+                case 0x00E0: // Clear display.
+                    memset(chip8->display, 0, sizeof(chip8->display));
+                    break;
+                case 0x00EE: // Return from subroutine.
+                    chip8->sp = (chip8->sp - 1) & STACK_MASK;
+                    chip8->pc = chip8->stack[chip8->sp];
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case 0x1000:
+            chip8->pc = nnn;
+            break;
+        case 0x2000:
+            chip8->stack[chip8->sp & STACK_MASK] = chip8->pc;
+            chip8->sp = (chip8->sp + 1) & STACK_MASK;
+            chip8->pc = nnn;
+            break;
+        case 0x3000:
+            if (chip8->V[x] == kk)
+                chip8->pc += 2;
+            break;
+        case 0x4000:
+            if (chip8->V[x] != kk)
+                chip8->pc += 2;
+            break;
+        case 0x5000:
+            if (chip8->V[x] == chip8->V[y])
+                chip8->pc += 2;
+            break;
+        case 0x6000:
+            chip8->V[x] = kk;
+            break;
+        case 0x7000:
+            chip8->V[x] += kk;
+            break;
+        case 0x8000:
+            switch (opcode & 0x000F) {
+                case 0x0:
+                    chip8->V[x] = chip8->V[y];
+                    break;
+                case 0x1:
+                    chip8->V[x] |= chip8->V[y];
+                    break;
+                case 0x2:
+                    chip8->V[x] &= chip8->V[y];
+                    break;
+                case 0x3:
+                    chip8->V[x] ^= chip8->V[y];
+                    break;
+                case 0x4: {
+                    uint16_t sum = chip8->V[x] + chip8->V[y];
+                    chip8->V[0xF] = (sum > 255) ? 1 : 0;
+                    chip8->V[x] = sum & 0xFF;
+                    break;
+                }
+                case 0x5:
+                    chip8->V[0xF] = (chip8->V[x] > chip8->V[y]) ? 1 : 0;
+                    chip8->V[x] -= chip8->V[y];
+                    break;
+                case 0x6:
+                    chip8->V[0xF] = chip8->V[x] & 0x1;
+                    chip8->V[x] >>= 1;
+                    break;
+                case 0x7:
+                    chip8->V[0xF] = (chip8->V[y] > chip8->V[x]) ? 1 : 0;
+                    chip8->V[x] = chip8->V[y] - chip8->V[x];
+                    break;
+                case 0xE:
+                    chip8->V[0xF] = (chip8->V[x] & 0x80) >> 7;
+                    chip8->V[x] <<= 1;
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case 0x9000:
+            if (chip8->V[x] != chip8->V[y])
+                chip8->pc += 2;
+            break;
+        case 0xA000:
+            chip8->I = nnn;
+            break;
+        case 0xB000:
+            chip8->pc = nnn + chip8->V[0];
+            break;
+        case 0xC000:
+            chip8->V[x] = (nextRandom(chip8) & 0xFF) & kk;
+            break;
+        case 0xD000: {
+            int spriteWidth, spriteHeight;
+            // If in extended mode and n==0, draw a 16x16 sprite.
+            if (chip8->extended_mode && n == 0) {
+                spriteWidth = 16;
+                spriteHeight = 16;
+            } else {
+                spriteWidth = 8;
+                spriteHeight = n;
+            }
+            chip8->V[0xF] = 0;
+            if (x != 0xF && y != 0xF) {
+                // The coordinates are fixed for the whole sprite, so each
+                // row is a single blit.
+                int collision = 0;
+                for (int row = 0; row < spriteHeight; row++) {
+                    uint16_t bits = spriteWidth == 16
+                        ? chip8->memory[(chip8->I + row * 2) & ADDRESS_MASK] << 8 |
+                          chip8->memory[(chip8->I + row * 2 + 1) & ADDRESS_MASK]
+                        : chip8->memory[(chip8->I + row) & ADDRESS_MASK] << 8;
+                    int posY = (chip8->V[y] + row) % chip8->screen_height;
+                    collision |= kernels.blit_row(&chip8->display[posY * MAX_WIDTH], chip8->V[x], bits,
+                                                  spriteWidth, chip8->screen_width);
+                }
+                chip8->V[0xF] = collision;
+                break;
+            }
+            // VF is a coordinate: it can change mid-sprite, so go pixel by
+            // pixel, re-reading it each time.
+            if (spriteWidth == 16) {
+                // SCHIP 16x16 sprite: assume 32 bytes, 2 bytes per row.
+                for (int row = 0; row < 16; row++) {
+                    uint8_t byte1 = chip8->memory[(chip8->I + row * 2) & ADDRESS_MASK];
+                    uint8_t byte2 = chip8->memory[(chip8->I + row * 2 + 1) & ADDRESS_MASK];
+                    for (int col = 0; col < 16; col++) {
+                        int pixelBit = (col < 8)
+                            ? ((byte1 & (0x80 >> col)) != 0)
+                            : ((byte2 & (0x80 >> (col - 8))) != 0);
+                        if (pixelBit) {
+                            int posX = (chip8->V[x] + col) % chip8->screen_width;
+                            int posY = (chip8->V[y] + row) % chip8->screen_height;
+                            int idx = posY * MAX_WIDTH + posX;
+                            if (chip8->display[idx] == 1)
+                                chip8->V[0xF] = 1;
+                            chip8->display[idx] ^= 1;
+                        }
+                    }
+                }
+            } else {
+                // Standard 8xN sprite.
+                for (int row = 0; row < spriteHeight; row++) {
+                    uint8_t spriteByte = chip8->memory[(chip8->I + row) & ADDRESS_MASK];
+                    for (int col = 0; col < spriteWidth; col++) {
+                        int pixelBit = (spriteByte & (0x80 >> col)) != 0;
+                        if (pixelBit) {
+                            int posX = (chip8->V[x] + col) % chip8->screen_width;
+                            int posY = (chip8->V[y] + row) % chip8->screen_height;
+                            int idx = posY * MAX_WIDTH + posX;
+                            if (chip8->display[idx] == 1)
+                                chip8->V[0xF] = 1;
+                            chip8->display[idx] ^= 1;
+                        }
+                    }
+                }
+            }
+            break;
+        }
+        case 0xE000:
+            switch (opcode & 0x00FF) {
+                case 0x9E:
+                    if (chip8->key_mask >> (chip8->V[x] & 0xF) & 1)
+                        chip8->pc += 2;
+                    break;
+                case 0xA1:
+                    if (!(chip8->key_mask >> (chip8->V[x] & 0xF) & 1))
+                        chip8->pc += 2;
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x07:
+                    chip8->V[x] = chip8->delay_timer;
+                    break;
+                case 0x0A: {
+                    // Wait for a key: re-run this opcode until one is held.
+                    if (chip8->key_mask) {
+                        int i = 0;
+                        while (!(chip8->key_mask >> i & 1))
+                            i++;
+                        chip8->V[x] = i;
+                    } else {
+                        chip8->pc -= 2;
+                    }
+                    break;
+                }
+                case 0x15:
+                    chip8->delay_timer = chip8->V[x];
+                    break;
+                case 0x18:
+                    chip8->sound_timer = chip8->V[x];
+                    break;
+                case 0x1E:
+                    chip8->I += chip8->V[x];
+                    break;
+                case 0x29:
+                    chip8->I = FONT_ADDRESS + (chip8->V[x] * 5);
+                    break;
+                case 0x33: {
+                    uint8_t value = chip8->V[x];
+                    chip8->memory[chip8->I & ADDRESS_MASK]       = value / 100;
+                    chip8->memory[(chip8->I + 1) & ADDRESS_MASK] = (value / 10) % 10;
+                    chip8->memory[(chip8->I + 2) & ADDRESS_MASK] = value % 10;
+                    break;
+                }
+                case 0x55:
+                    for (int i = 0; i <= x; i++) {
+                        chip8->memory[(chip8->I + i) & ADDRESS_MASK] = chip8->V[i];
+                    }
+                    break;
+                case 0x65:
+                    for (int i = 0; i <= x; i++) {
+                        chip8->V[i] = chip8->memory[(chip8->I + i) & ADDRESS_MASK];
+                    }
+                    break;
+                default:
+                    break;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Count the delay and sound timers down; hosts call this at 60 Hz.
+void tickTimers(Chip8 *chip8) {
+    if (chip8->delay_timer > 0)
+        chip8->delay_timer--;
+    if (chip8->sound_timer > 0)
+        chip8->sound_timer--;
+}
+
+// Run one 60 Hz frame: a batch of cycles followed by a timer tick.
+void runFrame(Chip8 *chip8, int cycles) {
+    for (int i = 0; i < cycles && !chip8->halted; i++)
+        emulateCycle(chip8);
+    tickTimers(chip8);
+}
+
+// Same as runFrame, recording every executed address and control transfer.
+void runFrameCovered(Chip8 *chip8, int cycles, Chip8Coverage *cov) {
+    for (int i = 0; i < cycles && !chip8->halted; i++) {
+        uint16_t from = chip8->pc & ADDRESS_MASK;
+        emulateCycle(chip8);
+        uint16_t to = chip8->pc & ADDRESS_MASK;
+        cov->pcs[from >> 3] |= 1 << (from & 7);
+        uint8_t *edge = &cov->edges[((from * 0x9E37u) ^ to) & (COVERAGE_EDGES - 1)];
+        *edge += *edge != 255;
+    }
+    tickTimers(chip8);
+}
+
+// Set all 16 keys from a bitmask (bit n = key n held).
+void setKeyMask(Chip8 *chip8, uint16_t mask) {
+    chip8->key_mask = mask;
+}
+
+uint16_t getKeyMask(const Chip8 *chip8) {
+    return chip8->key_mask;
+}
+
+// Write a snapshot blob into buf. Returns the number of bytes written, or 0
+// if buf is too small.
+size_t saveState(const Chip8 *chip8, void *buf, size_t len) {
+    uint32_t header[3] = { CHIP8_STATE_MAGIC, CHIP8_STATE_VERSION, sizeof(Chip8) };
+    if (len < CHIP8_STATE_SIZE)
+        return 0;
+    memcpy(buf, header, sizeof(header));
+    memcpy((uint8_t *)buf + sizeof(header), chip8, sizeof(Chip8));
+    return CHIP8_STATE_SIZE;
+}
+
+// Restore a snapshot blob written by saveState. Returns 1 on success, 0 if
+// the blob is truncated or from an incompatible build.
+int loadState(Chip8 *chip8, const void *buf, size_t len) {
+    uint32_t header[3];
+    if (len < CHIP8_STATE_SIZE)
+        return 0;
+    memcpy(header, buf, sizeof(header));
+    if (header[0] != CHIP8_STATE_MAGIC || header[1] != CHIP8_STATE_VERSION ||
+        header[2] != sizeof(Chip8))
+        return 0;
+    Chip8 loaded;
+    memcpy(&loaded, (const uint8_t *)buf + sizeof(header), sizeof(Chip8));
+    // The display size is used as a loop bound, so only accept the two
+    // geometries the machine can actually be in.
+    if (loaded.extended_mode
+            ? (loaded.screen_width != EXT_WIDTH || loaded.screen_height != EXT_HEIGHT)
+            : (loaded.screen_width != NORMAL_WIDTH || loaded.screen_height != NORMAL_HEIGHT))
+        return 0;
+    *chip8 = loaded;
+    return 1;
+}
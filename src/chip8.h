@@ -0,0 +1,108 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEMORY_SIZE     4096
+#define REGISTER_COUNT  16
+#define STACK_SIZE      16
+#define NORMAL_WIDTH    64
+#define NORMAL_HEIGHT   32
+#define EXT_WIDTH       128
+#define EXT_HEIGHT      64
+#define MAX_WIDTH       EXT_WIDTH   // Maximum allocated display width.
+#define MAX_HEIGHT      EXT_HEIGHT  // Maximum allocated display height.
+#define START_ADDRESS   0x200
+#define FONT_ADDRESS    0x50
+#define ADDRESS_MASK    (MEMORY_SIZE - 1)
+#define STACK_MASK      (STACK_SIZE - 1)
+
+#define CHIP8_CACHE_LINE 64
+
+// Quirks: behaviour that differs between interpreters.
+#define QUIRK_LORES_HALF_SCROLL 0x01 // SCHIP 1.1: lores scrolls move n/2 pixels.
+
+// Cycles executed per 60 Hz frame by hosts that step whole frames.
+#define DEFAULT_CYCLES_PER_FRAME 10
+
+// The Chip-8 state structure. It holds everything a machine needs, so any
+// number of them can run side by side and a plain copy is a snapshot.
+//
+// Everything an instruction touches besides guest memory and the display
+// sits in the first cache line, and the struct is cache-line aligned, so
+// stepping a machine pulls in one line of registers rather than three
+// scattered ones, and neighbouring machines in an array never share one.
+typedef struct {
+    // Hot: one cache line.
+    uint16_t pc __attribute__((aligned(CHIP8_CACHE_LINE)));
+    uint16_t I;
+    uint8_t V[REGISTER_COUNT];
+    uint8_t sp;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t extended_mode; // 0 = normal, 1 = extended (SCHIP)
+    uint8_t halted;        // Set by 00FD; the host decides what exiting means.
+    uint8_t quirks;        // QUIRK_* behaviour switches, set by the host.
+    uint16_t key_mask;     // Bit n set while key n is held.
+    // Display mode (changes with 00FE/00FF).
+    uint16_t screen_width;
+    uint16_t screen_height;
+    uint32_t rng;          // xorshift32 state for CXKK.
+    uint64_t cycles;       // Instructions executed since initialization.
+
+    // Cold: touched by calls, memory access and drawing.
+    uint16_t stack[STACK_SIZE] __attribute__((aligned(CHIP8_CACHE_LINE)));
+    uint8_t memory[MEMORY_SIZE] __attribute__((aligned(CHIP8_CACHE_LINE)));
+    // Allocate maximum size; when in normal mode, only use a subset.
+    uint8_t display[MAX_WIDTH * MAX_HEIGHT];
+} Chip8;
+
+// Compile-time layout checks (C99 has no static_assert).
+typedef char chip8_hot_state_fits_one_line[offsetof(Chip8, stack) == CHIP8_CACHE_LINE ? 1 : -1];
+typedef char chip8_size_is_whole_lines[sizeof(Chip8) % CHIP8_CACHE_LINE == 0 ? 1 : -1];
+
+// Snapshot blobs are a small header followed by the raw state.
+#define CHIP8_STATE_MAGIC   0x54533843u // "C8ST"
+#define CHIP8_STATE_VERSION 2
+#define CHIP8_STATE_SIZE    (12 + sizeof(Chip8))
+
+// Bump when a change to emulation makes a program compute something
+// different. On-disk caches of emulated results are tied to it through
+// chip8CoreId.
+#define CHIP8_CORE_VERSION  1
+
+// Guest code coverage. `pcs` has a bit per address that started an
+// instruction; `edges` counts (from, to) control transfers in a hashed map,
+// saturating at 255, the way AFL does.
+#define COVERAGE_EDGE_BITS 16
+#define COVERAGE_EDGES     (1 << COVERAGE_EDGE_BITS)
+typedef struct {
+    uint8_t pcs[MEMORY_SIZE / 8];
+    uint8_t edges[COVERAGE_EDGES];
+} Chip8Coverage;
+
+extern const uint8_t chip8_fontset[80];
+
+void initializeChip8(Chip8 *chip8);
+void *allocChip8(size_t size);
+void seedChip8(Chip8 *chip8, uint32_t seed);
+int loadROM(Chip8 *chip8, const char *filename);
+int loadROMData(Chip8 *chip8, const uint8_t *data, size_t size);
+uint64_t hashProgram(const Chip8 *chip8);
+// Identifies what an on-disk cache of emulated results depends on: the
+// core version, the state format and the Chip8 layout. Store it with
+// cached results and treat any other value as a miss.
+uint64_t chip8CoreId(void);
+uint16_t fetchOpcode(Chip8 *chip8);
+void emulateCycle(Chip8 *chip8);
+uint8_t randomByte(Chip8 *chip8);
+void tickTimers(Chip8 *chip8);
+void runFrame(Chip8 *chip8, int cycles);
+void runFrameCovered(Chip8 *chip8, int cycles, Chip8Coverage *cov);
+void setKeyMask(Chip8 *chip8, uint16_t mask);
+uint16_t getKeyMask(const Chip8 *chip8);
+size_t saveState(const Chip8 *chip8, void *buf, size_t len);
+int loadState(Chip8 *chip8, const void *buf, size_t len);
+
+#endif
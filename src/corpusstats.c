@@ -0,0 +1,432 @@
+#define _DEFAULT_SOURCE
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "chip8.h"
+#include "corpusstats.h"
+
+// Opcode classes, in the order emulateCycle decodes them.
+enum {
+    OP_00E0, OP_00EE, OP_00CN, OP_00FB, OP_00FC, OP_00FD, OP_00FE, OP_00FF, OP_0NNN,
+    OP_1NNN, OP_2NNN, OP_3XKK, OP_4XKK, OP_5XY0, OP_6XKK, OP_7XKK,
+    OP_8XY0, OP_8XY1, OP_8XY2, OP_8XY3, OP_8XY4, OP_8XY5, OP_8XY6, OP_8XY7, OP_8XYE,
+    OP_9XY0, OP_ANNN, OP_BNNN, OP_CXKK, OP_DXYN, OP_EX9E, OP_EXA1,
+    OP_FX07, OP_FX0A, OP_FX15, OP_FX18, OP_FX1E, OP_FX29, OP_FX33, OP_FX55, OP_FX65,
+    OP_INVALID, OP_CLASS_COUNT
+};
+
+static const char *const class_names[OP_CLASS_COUNT] = {
+    "00E0", "00EE", "00CN", "00FB", "00FC", "00FD", "00FE", "00FF", "0NNN",
+    "1NNN", "2NNN", "3XKK", "4XKK", "5XY0", "6XKK", "7XKK",
+    "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE",
+    "9XY0", "ANNN", "BNNN", "CXKK", "DXYN", "EX9E", "EXA1",
+    "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29", "FX33", "FX55", "FX65",
+    "invalid"
+};
+
+// Behaviours that differ between interpreters, detected when a ROM does
+// something whose result depends on which one it was written for.
+enum {
+    QUIRK_SHIFT        = 1 << 0, // 8XY6/8XYE with Vx != Vy: shift Vy or Vx?
+    QUIRK_LOAD_STORE   = 1 << 1, // I read after FX55/FX65: was it advanced?
+    QUIRK_JUMP         = 1 << 2, // BXNN with Vx != V0: BNNN or BXNN?
+    QUIRK_VF_RESET     = 1 << 3, // VF read after 8XY1/2/3: was it reset?
+    QUIRK_WRAP         = 1 << 4, // Sprite crosses the screen edge: wrap or clip?
+    QUIRK_LORES_SCROLL = 1 << 5, // Scroll in lores: full or half step?
+    QUIRK_COUNT        = 6
+};
+
+static const char *const quirk_names[QUIRK_COUNT] = {
+    "shift", "load_store", "jump", "vf_reset", "wrap", "lores_scroll"
+};
+
+typedef struct {
+    char *name;
+    size_t size;
+    int ok;
+    int halted;
+    int hires;
+    int hires_frames;
+    int self_modifying;
+    int frames_run;
+    long cycles;
+    long draws;
+    long clears;
+    unsigned quirks;
+} RomStats;
+
+// Each thread aggregates into its own totals; they are summed at the end.
+typedef struct {
+    long static_ops[OP_CLASS_COUNT];
+    long dynamic_ops[OP_CLASS_COUNT];
+} OpcodeTotals;
+
+static struct {
+    const char *dir;
+    char **names;
+    RomStats *roms;
+    int count;
+    int next;
+    int frames;
+    pthread_mutex_t lock;
+} corpus = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int classifyOpcode(uint16_t op) {
+    uint8_t kk = op & 0xFF;
+    switch (op & 0xF000) {
+        case 0x0000:
+            if ((op & 0xF0FF) == 0x00FB) return OP_00FB;
+            if ((op & 0xF0FF) == 0x00FC) return OP_00FC;
+            if ((op & 0xF0FF) == 0x00FD) return OP_00FD;
+            if ((op & 0xF0FF) == 0x00FE) return OP_00FE;
+            if ((op & 0xF0FF) == 0x00FF) return OP_00FF;
+            if ((op & 0x00F0) == 0x00C0) return OP_00CN;
+            if (op == 0x00E0) return OP_00E0;
+            if (op == 0x00EE) return OP_00EE;
+            return OP_0NNN;
+        case 0x1000: return OP_1NNN;
+        case 0x2000: return OP_2NNN;
+        case 0x3000: return OP_3XKK;
+        case 0x4000: return OP_4XKK;
+        case 0x5000: return OP_5XY0;
+        case 0x6000: return OP_6XKK;
+        case 0x7000: return OP_7XKK;
+        case 0x8000:
+            switch (op & 0xF) {
+                case 0x0: return OP_8XY0;
+                case 0x1: return OP_8XY1;
+                case 0x2: return OP_8XY2;
+                case 0x3: return OP_8XY3;
+                case 0x4: return OP_8XY4;
+                case 0x5: return OP_8XY5;
+                case 0x6: return OP_8XY6;
+                case 0x7: return OP_8XY7;
+                case 0xE: return OP_8XYE;
+                default: return OP_INVALID;
+            }
+        case 0x9000: return OP_9XY0;
+        case 0xA000: return OP_ANNN;
+        case 0xB000: return OP_BNNN;
+        case 0xC000: return OP_CXKK;
+        case 0xD000: return OP_DXYN;
+        case 0xE000:
+            if (kk == 0x9E) return OP_EX9E;
+            if (kk == 0xA1) return OP_EXA1;
+            return OP_INVALID;
+        default:
+            switch (kk) {
+                case 0x07: return OP_FX07;
+                case 0x0A: return OP_FX0A;
+                case 0x15: return OP_FX15;
+                case 0x18: return OP_FX18;
+                case 0x1E: return OP_FX1E;
+                case 0x29: return OP_FX29;
+                case 0x33: return OP_FX33;
+                case 0x55: return OP_FX55;
+                case 0x65: return OP_FX65;
+                default: return OP_INVALID;
+            }
+    }
+}
+
+// Does the instruction read register r?
+static int readsRegister(int cls, uint16_t op, int r) {
+    int x = (op >> 8) & 0xF, y = (op >> 4) & 0xF;
+    switch (cls) {
+        case OP_3XKK: case OP_4XKK: case OP_7XKK: case OP_EX9E: case OP_EXA1:
+        case OP_FX15: case OP_FX18: case OP_FX1E: case OP_FX29: case OP_FX33:
+        case OP_8XY6: case OP_8XYE:
+            return r == x;
+        case OP_8XY0:
+            return r == y;
+        case OP_5XY0: case OP_9XY0: case OP_8XY1: case OP_8XY2: case OP_8XY3:
+        case OP_8XY4: case OP_8XY5: case OP_8XY7: case OP_DXYN:
+            return r == x || r == y;
+        case OP_BNNN:
+            return r == 0;
+        case OP_FX55:
+            return r <= x;
+        default:
+            return 0;
+    }
+}
+
+// Does the instruction overwrite VF?
+static int writesVF(int cls, uint16_t op) {
+    int x = (op >> 8) & 0xF;
+    switch (cls) {
+        case OP_8XY4: case OP_8XY5: case OP_8XY6: case OP_8XY7: case OP_8XYE: case OP_DXYN:
+            return 1;
+        case OP_6XKK: case OP_7XKK: case OP_8XY0: case OP_8XY1: case OP_8XY2: case OP_8XY3:
+        case OP_CXKK: case OP_FX07: case OP_FX0A: case OP_FX65:
+            return x == 0xF;
+        default:
+            return 0;
+    }
+}
+
+static int readsI(int cls) {
+    return cls == OP_DXYN || cls == OP_FX1E || cls == OP_FX33 ||
+           cls == OP_FX55 || cls == OP_FX65;
+}
+
+static void analyzeROM(RomStats *rs, OpcodeTotals *totals) {
+    static __thread Chip8 chip8;
+    static __thread uint8_t rom[MEMORY_SIZE];
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", corpus.dir, rs->name);
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return;
+    rs->size = fread(rom, 1, sizeof(rom), f);
+    fclose(f);
+    initializeChip8(&chip8);
+    seedChip8(&chip8, 0x2545F491);
+    if (!loadROMData(&chip8, rom, rs->size))
+        return;
+    rs->ok = 1;
+
+    for (size_t a = 0; a + 1 < rs->size; a += 2)
+        totals->static_ops[classifyOpcode(rom[a] << 8 | rom[a + 1])]++;
+
+    uint8_t written[MEMORY_SIZE / 8];
+    memset(written, 0, sizeof(written));
+    int vf_pending = 0, i_pending = 0;
+    for (int frame = 0; frame < corpus.frames && !chip8.halted; frame++) {
+        for (int c = 0; c < DEFAULT_CYCLES_PER_FRAME && !chip8.halted; c++) {
+            uint16_t pc = chip8.pc & ADDRESS_MASK;
+            uint16_t op = fetchOpcode(&chip8);
+            int cls = classifyOpcode(op);
+            int x = (op >> 8) & 0xF, y = (op >> 4) & 0xF;
+            totals->dynamic_ops[cls]++;
+            rs->cycles++;
+
+            if ((written[pc >> 3] >> (pc & 7)) & 1 ||
+                (written[((pc + 1) & ADDRESS_MASK) >> 3] >> ((pc + 1) & 7)) & 1)
+                rs->self_modifying = 1;
+
+            if (vf_pending && readsRegister(cls, op, 0xF))
+                rs->quirks |= QUIRK_VF_RESET;
+            if (vf_pending && (writesVF(cls, op) || readsRegister(cls, op, 0xF)))
+                vf_pending = 0;
+            if (i_pending && readsI(cls))
+                rs->quirks |= QUIRK_LOAD_STORE;
+            if (cls == OP_ANNN || cls == OP_FX29 || readsI(cls))
+                i_pending = 0;
+
+            switch (cls) {
+                case OP_8XY1: case OP_8XY2: case OP_8XY3:
+                    vf_pending = 1;
+                    break;
+                case OP_8XY6: case OP_8XYE:
+                    if (x != y && chip8.V[x] != chip8.V[y])
+                        rs->quirks |= QUIRK_SHIFT;
+                    break;
+                case OP_BNNN:
+                    if (x != 0 && chip8.V[x] != chip8.V[0])
+                        rs->quirks |= QUIRK_JUMP;
+                    break;
+                case OP_00CN: case OP_00FB: case OP_00FC:
+                    if (!chip8.extended_mode)
+                        rs->quirks |= QUIRK_LORES_SCROLL;
+                    break;
+                case OP_00E0:
+                    rs->clears++;
+                    break;
+                case OP_00FF:
+                    rs->hires = 1;
+                    break;
+                case OP_DXYN: {
+                    int w = (chip8.extended_mode && (op & 0xF) == 0) ? 16 : 8;
+                    int h = (chip8.extended_mode && (op & 0xF) == 0) ? 16 : (op & 0xF);
+                    if (chip8.V[x] % chip8.screen_width + w > chip8.screen_width ||
+                        chip8.V[y] % chip8.screen_height + h > chip8.screen_height)
+                        rs->quirks |= QUIRK_WRAP;
+                    rs->draws++;
+                    break;
+                }
+                case OP_FX33: case OP_FX55: {
+                    int n = cls == OP_FX33 ? 3 : x + 1;
+                    for (int i = 0; i < n; i++) {
+                        uint16_t a = (chip8.I + i) & ADDRESS_MASK;
+                        written[a >> 3] |= 1 << (a & 7);
+                    }
+                    if (cls == OP_FX55)
+                        i_pending = 1;
+                    break;
+                }
+                case OP_FX65:
+                    i_pending = 1;
+                    break;
+                default:
+                    break;
+            }
+            emulateCycle(&chip8);
+        }
+        tickTimers(&chip8);
+        rs->frames_run++;
+        rs->hires_frames += chip8.extended_mode;
+    }
+    rs->halted = chip8.halted;
+}
+
+static void *statsWorkerMain(void *arg) {
+    OpcodeTotals *totals = arg;
+    for (;;) {
+        pthread_mutex_lock(&corpus.lock);
+        int i = corpus.next++;
+        pthread_mutex_unlock(&corpus.lock);
+        if (i >= corpus.count)
+            return NULL;
+        analyzeROM(&corpus.roms[i], totals);
+    }
+}
+
+static void printJSONString(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if (c < 0x20)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+    putchar('"');
+}
+
+static void printOpcodeTable(const char *key, const long *counts, int last) {
+    printf("  \"%s\": {", key);
+    int first = 1;
+    for (int c = 0; c < OP_CLASS_COUNT; c++) {
+        if (!counts[c])
+            continue;
+        printf("%s\"%s\": %ld", first ? "" : ", ", class_names[c], counts[c]);
+        first = 0;
+    }
+    printf("}%s\n", last ? "" : ",");
+}
+
+static int compareNames(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int runCorpusStats(const char *dir, int frames, int threads) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        perror(dir);
+        return 1;
+    }
+    int cap = 0;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        char path[4096];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+            continue;
+        if (corpus.count == cap) {
+            cap = cap ? cap * 2 : 256;
+            corpus.names = realloc(corpus.names, cap * sizeof(char *));
+        }
+        corpus.names[corpus.count++] = strdup(ent->d_name);
+    }
+    closedir(d);
+    if (corpus.count)
+        qsort(corpus.names, corpus.count, sizeof(char *), compareNames);
+
+    corpus.dir = dir;
+    corpus.frames = frames > 0 ? frames : 600;
+    corpus.roms = calloc(corpus.count ? corpus.count : 1, sizeof(RomStats));
+    for (int i = 0; i < corpus.count; i++)
+        corpus.roms[i].name = corpus.names[i];
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+        threads = 1;
+
+    OpcodeTotals *totals = calloc(threads, sizeof(OpcodeTotals));
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    for (int t = 0; t < threads; t++)
+        pthread_create(&tids[t], NULL, statsWorkerMain, &totals[t]);
+    for (int t = 0; t < threads; t++)
+        pthread_join(tids[t], NULL);
+    for (int t = 1; t < threads; t++) {
+        for (int c = 0; c < OP_CLASS_COUNT; c++) {
+            totals[0].static_ops[c] += totals[t].static_ops[c];
+            totals[0].dynamic_ops[c] += totals[t].dynamic_ops[c];
+        }
+    }
+
+    int analyzed = 0, smc = 0, hires = 0, halted = 0;
+    int quirk_roms[QUIRK_COUNT] = { 0 };
+    long draws = 0, frames_run = 0;
+    for (int i = 0; i < corpus.count; i++) {
+        RomStats *rs = &corpus.roms[i];
+        if (!rs->ok)
+            continue;
+        analyzed++;
+        smc += rs->self_modifying;
+        hires += rs->hires;
+        halted += rs->halted;
+        draws += rs->draws;
+        frames_run += rs->frames_run;
+        for (int q = 0; q < QUIRK_COUNT; q++)
+            quirk_roms[q] += (rs->quirks >> q) & 1;
+    }
+
+    printf("{\n");
+    printf("  \"roms\": %d,\n", analyzed);
+    printf("  \"skipped\": %d,\n", corpus.count - analyzed);
+    printf("  \"frames\": %d,\n", corpus.frames);
+    printf("  \"cycles_per_frame\": %d,\n", DEFAULT_CYCLES_PER_FRAME);
+    printOpcodeTable("static_opcodes", totals[0].static_ops, 0);
+    printOpcodeTable("dynamic_opcodes", totals[0].dynamic_ops, 0);
+    printf("  \"quirk_roms\": {");
+    for (int q = 0; q < QUIRK_COUNT; q++)
+        printf("%s\"%s\": %d", q ? ", " : "", quirk_names[q], quirk_roms[q]);
+    printf("},\n");
+    printf("  \"self_modifying_roms\": %d,\n", smc);
+    printf("  \"hires_roms\": %d,\n", hires);
+    printf("  \"halted_roms\": %d,\n", halted);
+    printf("  \"draws_per_frame\": %.3f,\n", frames_run ? (double)draws / frames_run : 0.0);
+    printf("  \"per_rom\": [");
+    int first = 1;
+    for (int i = 0; i < corpus.count; i++) {
+        RomStats *rs = &corpus.roms[i];
+        if (!rs->ok)
+            continue;
+        printf("%s\n    {\"name\": ", first ? "" : ",");
+        printJSONString(rs->name);
+        printf(", \"size\": %zu, \"cycles\": %ld, \"quirks\": [", rs->size, rs->cycles);
+        int qfirst = 1;
+        for (int q = 0; q < QUIRK_COUNT; q++) {
+            if ((rs->quirks >> q) & 1) {
+                printf("%s\"%s\"", qfirst ? "" : ", ", quirk_names[q]);
+                qfirst = 0;
+            }
+        }
+        printf("], \"self_modifying\": %s, \"hires\": %s, \"hires_frames\": %d, "
+               "\"draws_per_frame\": %.3f, \"clears_per_frame\": %.3f, \"halted\": %s}",
+               rs->self_modifying ? "true" : "false", rs->hires ? "true" : "false",
+               rs->hires_frames,
+               rs->frames_run ? (double)rs->draws / rs->frames_run : 0.0,
+               rs->frames_run ? (double)rs->clears / rs->frames_run : 0.0,
+               rs->halted ? "true" : "false");
+        first = 0;
+    }
+    printf("\n  ]\n}\n");
+
+    for (int i = 0; i < corpus.count; i++)
+        free(corpus.names[i]);
+    free(corpus.names);
+    free(corpus.roms);
+    free(totals);
+    free(tids);
+    return 0;
+}
@@ -0,0 +1,9 @@
+#ifndef CORPUSSTATS_H
+#define CORPUSSTATS_H
+
+// Analyze every ROM in a directory in parallel and print a JSON summary:
+// static and dynamic opcode frequencies, apparent quirk dependencies,
+// self-modifying code, hires usage and draw rates.
+int runCorpusStats(const char *dir, int frames, int threads);
+
+#endif
@@ -5,27 +5,32 @@
 #include <time.h>
 #include <math.h>
 #include <SDL2/SDL.h>
+#include "chip8.h"
+#include "daemon.h"
+#include "inputfuzz.h"
+#include "corpusstats.h"
+#include "trace.h"
+#include "memo.h"
+#include "bench.h"
+#include "farm.h"
+#include "speculate.h"
+#include "realtime.h"
+#include "ir.h"
+#include "fairshare.h"
+#include "persist.h"
+#include "kernels.h"
+#include "launcher.h"
+#include "autospeed.h"
+#include "telemetry.h"
+#include "pool.h"
+#include "dedup.h"
+#include "framestack.h"
 
-#define MEMORY_SIZE     4096
-#define REGISTER_COUNT  16
-#define STACK_SIZE      16
-#define NORMAL_WIDTH    64
-#define NORMAL_HEIGHT   32
-#define EXT_WIDTH       128
-#define EXT_HEIGHT      64
-#define MAX_WIDTH       EXT_WIDTH   // Maximum allocated display width.
-#define MAX_HEIGHT      EXT_HEIGHT  // Maximum allocated display height.
 #define WINDOW_SCALE    10
-#define START_ADDRESS   0x200
 
 #define AUDIO_FREQUENCY 44100
 #define TONE_FREQUENCY  440
 
-// Global display dimensions (changes with mode).
-int screen_width = NORMAL_WIDTH;
-int screen_height = NORMAL_HEIGHT;
-int extended_mode = 0; // 0 = normal, 1 = extended (SCHIP)
-
 // Global color palette.
 // Normal mode: white fg on black bg.
 // Extended mode: bright cyan fg on dark blue bg.
@@ -34,21 +39,8 @@ Uint8 bg_r = 0,   bg_g = 0,   bg_b = 0;
 
 // Global SDL_Window pointer for dynamic resizing.
 SDL_Window *g_window = NULL;
-
-// The Chip-8 state structure.
-typedef struct {
-    uint8_t memory[MEMORY_SIZE];
-    uint8_t V[REGISTER_COUNT];
-    uint16_t I;
-    uint16_t pc;
-    uint16_t stack[STACK_SIZE];
-    uint8_t sp;
-    uint8_t delay_timer;
-    uint8_t sound_timer;
-    // Allocate maximum size; when in normal mode, only use a subset.
-    uint8_t display[MAX_WIDTH * MAX_HEIGHT];
-    uint8_t keys[16];
-} Chip8;
+// The display at native resolution; the renderer scales it to the window.
+SDL_Texture *g_texture = NULL;
 
 Chip8 chip8;
 
@@ -56,26 +48,6 @@ Chip8 chip8;
 static double audio_phase = 0.0;
 static double audio_phase_inc = (2.0 * M_PI * TONE_FREQUENCY) / AUDIO_FREQUENCY;
 
-// Standard Chip-8 fontset (each character is 5 bytes).
-uint8_t chip8_fontset[80] = {
-    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-    0x20, 0x60, 0x20, 0x20, 0x70, // 1
-    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-};
-
 // Audio callback: generates a sine-wave tone if sound_timer > 0.
 void audio_callback(void *userdata, Uint8 *stream, int len) {
     (void)userdata; // Unused.
@@ -93,420 +65,688 @@ void audio_callback(void *userdata, Uint8 *stream, int len) {
     }
 }
 
-// Initialize the Chip-8 system.
-void initializeChip8(Chip8 *chip8) {
-    chip8->pc = START_ADDRESS;
-    chip8->I = 0;
-    chip8->sp = 0;
-    memset(chip8->memory, 0, sizeof(chip8->memory));
-    memset(chip8->V, 0, sizeof(chip8->V));
-    memset(chip8->stack, 0, sizeof(chip8->stack));
-    memset(chip8->display, 0, sizeof(chip8->display));
-    memset(chip8->keys, 0, sizeof(chip8->keys));
-    chip8->delay_timer = 0;
-    chip8->sound_timer = 0;
-    memcpy(chip8->memory + 0x50, chip8_fontset, sizeof(chip8_fontset));
+// Render the current display using SDL2 with color support. The caller
+// presents it.
+void drawGraphics(SDL_Renderer *renderer, Chip8 *chip8) {
+    static uint32_t pixels[MAX_WIDTH * MAX_HEIGHT];
+    uint32_t fg = 0xFF000000u | fg_r << 16 | fg_g << 8 | fg_b;
+    uint32_t bg = 0xFF000000u | bg_r << 16 | bg_g << 8 | bg_b;
+    // The display is stored in a MAX_WIDTH-wide array.
+    for (int y = 0; y < chip8->screen_height; y++)
+        kernels.expand_palette(&chip8->display[y * MAX_WIDTH], &pixels[y * MAX_WIDTH],
+                               chip8->screen_width, fg, bg);
+    SDL_Rect visible = { 0, 0, chip8->screen_width, chip8->screen_height };
+    SDL_UpdateTexture(g_texture, &visible, pixels, MAX_WIDTH * sizeof(uint32_t));
+    SDL_RenderCopy(renderer, g_texture, &visible, NULL);
 }
 
-// Load the Chip-8 ROM into memory.
-int loadROM(Chip8 *chip8, const char *filename) {
-    FILE *rom = fopen(filename, "rb");
-    if (!rom) {
-        perror("Failed to open ROM");
-        return 0;
+// Apply the colors and window size for the machine's current display mode.
+// Normal mode: white fg on black bg; extended mode: cyan fg on dark blue bg.
+void applyDisplayMode(Chip8 *chip8) {
+    if (chip8->extended_mode) {
+        fg_r = 0;   fg_g = 255; fg_b = 255;
+        bg_r = 0;   bg_g = 0;   bg_b = 128;
+    } else {
+        fg_r = 255; fg_g = 255; fg_b = 255;
+        bg_r = 0;   bg_g = 0;   bg_b = 0;
     }
-    fseek(rom, 0, SEEK_END);
-    long rom_size = ftell(rom);
-    rewind(rom);
-    if (rom_size > (MEMORY_SIZE - START_ADDRESS)) {
-        fprintf(stderr, "ROM too large for memory\n");
-        fclose(rom);
-        return 0;
+    SDL_SetWindowSize(g_window, chip8->screen_width * WINDOW_SCALE,
+                      chip8->screen_height * WINDOW_SCALE);
+}
+
+int mapKey(SDL_Keycode key) {
+    switch (key) {
+        case SDLK_1: return 0x1;
+        case SDLK_2: return 0x2;
+        case SDLK_3: return 0x3;
+        case SDLK_4: return 0xC;
+        case SDLK_q: return 0x4;
+        case SDLK_w: return 0x5;
+        case SDLK_e: return 0x6;
+        case SDLK_r: return 0xD;
+        case SDLK_a: return 0x7;
+        case SDLK_s: return 0x8;
+        case SDLK_d: return 0x9;
+        case SDLK_f: return 0xE;
+        case SDLK_z: return 0xA;
+        case SDLK_x: return 0x0;
+        case SDLK_c: return 0xB;
+        case SDLK_v: return 0xF;
+        default: return -1;
     }
-    fread(chip8->memory + START_ADDRESS, sizeof(uint8_t), rom_size, rom);
-    fclose(rom);
-    return 1;
 }
 
-// Render the current display using SDL2 with color support.
-void drawGraphics(SDL_Renderer *renderer, Chip8 *chip8) {
-    SDL_SetRenderDrawColor(renderer, bg_r, bg_g, bg_b, 255);
-    SDL_RenderClear(renderer);
-    SDL_Rect pixel;
-    pixel.w = WINDOW_SCALE;
-    pixel.h = WINDOW_SCALE;
-    for (int y = 0; y < screen_height; y++) {
-        for (int x = 0; x < screen_width; x++) {
-            // The display is stored in a MAX_WIDTH-wide array.
-            if (chip8->display[y * MAX_WIDTH + x]) {
-                pixel.x = x * WINDOW_SCALE;
-                pixel.y = y * WINDOW_SCALE;
-                SDL_SetRenderDrawColor(renderer, fg_r, fg_g, fg_b, 255);
-                SDL_RenderFillRect(renderer, &pixel);
-            }
+// Apply pending SDL events to the keypad. Returns 0 once the user quits.
+static int pollInput(Chip8 *chip8) {
+    SDL_Event event;
+    int running = 1;
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_QUIT)
+            running = 0;
+        if (event.type == SDL_KEYDOWN) {
+            int keyIndex = mapKey(event.key.keysym.sym);
+            if (keyIndex != -1)
+                chip8->key_mask |= 1u << keyIndex;
+        }
+        if (event.type == SDL_KEYUP) {
+            int keyIndex = mapKey(event.key.keysym.sym);
+            if (keyIndex != -1)
+                chip8->key_mask &= ~(1u << keyIndex);
         }
     }
-    SDL_RenderPresent(renderer);
+    return running;
 }
 
-// Fetch the next opcode (16 bits) from memory.
-uint16_t fetchOpcode(Chip8 *chip8) {
-    return chip8->memory[chip8->pc] << 8 | chip8->memory[chip8->pc + 1];
+// Frontend benchmark (--frontend-bench): the normal SDL loop, fed scripted
+// key events through the event queue, with each phase of it timed.
+enum { PHASE_INPUT, PHASE_EMULATE, PHASE_DRAW, PHASE_PRESENT, PHASE_OTHER, PHASE_PACING, PHASE_COUNT };
+
+static const char *phase_names[PHASE_COUNT] = {
+    "input", "emulate", "draw", "present", "other", "pacing",
+};
+
+static struct {
+    int active;
+    int frames;       // Frames to run.
+    uint16_t *script; // Key mask per frame, or NULL for the built-in pattern.
+    int script_len;
+    int frame;        // Frames finished.
+    int scripted;     // Frames whose input has been pushed.
+    uint16_t held;
+    uint64_t iterations;
+    Uint64 start, last;
+    Uint64 phase[PHASE_COUNT];
+} bench;
+
+// The host key for each keypad key (the inverse of mapKey).
+static const SDL_Keycode keypad_keys[16] = {
+    SDLK_x, SDLK_1, SDLK_2, SDLK_3, SDLK_q, SDLK_w, SDLK_e, SDLK_a,
+    SDLK_s, SDLK_d, SDLK_z, SDLK_c, SDLK_4, SDLK_r, SDLK_f, SDLK_v,
+};
+
+// Charge the time since the last lap to a phase.
+static void lap(int phase) {
+    if (!bench.active)
+        return;
+    Uint64 now = SDL_GetPerformanceCounter();
+    bench.phase[phase] += now - bench.last;
+    bench.last = now;
 }
 
-// Helper: Scroll display horizontally.
-void scroll_horizontal(Chip8 *chip8, int direction) {
-    int shift = 4;
-    if (direction > 0) {
-        for (int y = 0; y < screen_height; y++) {
-            for (int x = screen_width - 1; x >= shift; x--) {
-                chip8->display[y * MAX_WIDTH + x] = chip8->display[y * MAX_WIDTH + (x - shift)];
-            }
-            for (int x = 0; x < shift; x++) {
-                chip8->display[y * MAX_WIDTH + x] = 0;
-            }
-        }
-    } else {
-        for (int y = 0; y < screen_height; y++) {
-            for (int x = 0; x < screen_width - shift; x++) {
-                chip8->display[y * MAX_WIDTH + x] = chip8->display[y * MAX_WIDTH + (x + shift)];
-            }
-            for (int x = screen_width - shift; x < screen_width; x++) {
-                chip8->display[y * MAX_WIDTH + x] = 0;
-            }
-        }
+// Press and release keys for the coming frame as key events, so the
+// benchmark goes through the same event path as a player.
+static void pushScriptedInput(void) {
+    if (!bench.active || bench.scripted > bench.frame)
+        return;
+    int f = bench.frame;
+    uint16_t want;
+    if (bench.script)
+        want = f < bench.script_len ? bench.script[f] : 0;
+    else
+        want = f % 20 < 10 ? (uint16_t)(1u << (f / 20 % 16)) : 0; // Tap each key in turn.
+    for (int k = 0; k < 16; k++) {
+        if (!((want ^ bench.held) >> k & 1))
+            continue;
+        SDL_Event event;
+        memset(&event, 0, sizeof(event));
+        event.type = want >> k & 1 ? SDL_KEYDOWN : SDL_KEYUP;
+        event.key.keysym.sym = keypad_keys[k];
+        SDL_PushEvent(&event);
     }
+    bench.held = want;
+    bench.scripted = f + 1;
 }
 
-// Helper: Scroll display down by n rows.
-void scroll_down(Chip8 *chip8, int n) {
-    for (int y = screen_height - 1; y >= n; y--) {
-        for (int x = 0; x < screen_width; x++) {
-            chip8->display[y * MAX_WIDTH + x] = chip8->display[(y - n) * MAX_WIDTH + x];
-        }
+// Count a finished frame. Returns 0 once the benchmark has run them all.
+static int benchFrameDone(void) {
+    return !bench.active || ++bench.frame < bench.frames;
+}
+
+// Key masks, one little-endian u16 per frame, as --input-fuzz writes them.
+static int loadKeyScript(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror("Failed to open key file");
+        return 0;
     }
-    for (int y = 0; y < n; y++) {
-        for (int x = 0; x < screen_width; x++) {
-            chip8->display[y * MAX_WIDTH + x] = 0;
+    uint8_t le[2];
+    int cap = 0;
+    while (fread(le, 1, 2, f) == 2) {
+        if (bench.script_len == cap) {
+            cap = cap ? cap * 2 : 1024;
+            bench.script = realloc(bench.script, cap * sizeof(uint16_t));
         }
+        bench.script[bench.script_len++] = le[0] | le[1] << 8;
     }
+    fclose(f);
+    return 1;
 }
 
-// Emulate one cycle (fetch, decode, execute).
-void emulateCycle(Chip8 *chip8) {
-    uint16_t opcode = fetchOpcode(chip8);
-    chip8->pc += 2;
+static void reportFrontendBench(SDL_Renderer *renderer) {
+    double freq = (double)SDL_GetPerformanceFrequency();
+    double wall = (bench.last - bench.start) / freq;
+    int frames = bench.frame > 0 ? bench.frame : 1;
+    SDL_RendererInfo info;
+    const char *render_name = SDL_GetRendererInfo(renderer, &info) == 0 ? info.name : "?";
+    const char *video = SDL_GetCurrentVideoDriver(), *audio = SDL_GetCurrentAudioDriver();
+    printf("frontend: %d frames, video %s, audio %s, renderer %s, %s input\n", bench.frame,
+           video ? video : "none", audio ? audio : "none", render_name,
+           bench.script ? "scripted" : "built-in");
+    printf("wall:     %.2f s, %.1f fps, %.1f loop iterations per frame\n", wall,
+           wall > 0 ? bench.frame / wall : 0.0, (double)bench.iterations / frames);
+    printf("%-9s %9s %7s\n", "phase", "ms/frame", "share");
+    double busy = 0;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        double t = bench.phase[p] / freq;
+        if (p != PHASE_PACING)
+            busy += t;
+        printf("%-9s %9.3f %6.1f%%\n", phase_names[p], t / frames * 1e3, wall > 0 ? 100 * t / wall : 0.0);
+    }
+    printf("busy:     %.3f ms/frame without pacing, up to %.0f fps\n", busy / frames * 1e3,
+           busy > 0 ? frames / busy : 0.0);
+}
 
-    uint8_t x   = (opcode & 0x0F00) >> 8;
-    uint8_t y   = (opcode & 0x00F0) >> 4;
-    uint8_t kk  = opcode & 0x00FF;
-    uint16_t nnn = opcode & 0x0FFF;
-    uint8_t n   = opcode & 0x000F;
+#define TILE_SCALE   4
+#define TILE_WIDTH   (64 * TILE_SCALE)
+#define TILE_HEIGHT  (32 * TILE_SCALE)
+#define TILE_PAD     8
+#define TILE_COLUMNS 4
+#define TILE_ROWS    3
 
-    // SCHIP extended opcodes.
-    if ((opcode & 0xF0FF) == 0x00FB) {       // 00FB: Scroll right 4 pixels.
-        scroll_horizontal(chip8, +1);
-        return;
-    } else if ((opcode & 0xF0FF) == 0x00FC) { // 00FC: Scroll left 4 pixels.
-        scroll_horizontal(chip8, -1);
-        return;
-    } else if ((opcode & 0xF0FF) == 0x00FD) { // 00FD: Exit interpreter.
-        exit(0);
-    } else if ((opcode & 0xF0FF) == 0x00FE) { // 00FE: Disable extended mode.
-        extended_mode = 0;
-        screen_width = NORMAL_WIDTH;
-        screen_height = NORMAL_HEIGHT;
-        // Set colors for normal mode.
-        fg_r = 255; fg_g = 255; fg_b = 255;
-        bg_r = 0;   bg_g = 0;   bg_b = 0;
-        memset(chip8->display, 0, sizeof(chip8->display));
-        SDL_SetWindowSize(g_window, screen_width * WINDOW_SCALE, screen_height * WINDOW_SCALE);
-        return;
-    } else if ((opcode & 0xF0FF) == 0x00FF) { // 00FF: Enable extended mode.
-        extended_mode = 1;
-        screen_width = EXT_WIDTH;
-        screen_height = EXT_HEIGHT;
-        // Set colors for extended mode.
-        fg_r = 0;   fg_g = 255; fg_b = 255;
-        bg_r = 0;   bg_g = 0;   bg_b = 128;
-        memset(chip8->display, 0, sizeof(chip8->display));
-        SDL_SetWindowSize(g_window, screen_width * WINDOW_SCALE, screen_height * WINDOW_SCALE);
-        return;
-    } else if ((opcode & 0xF000) == 0x0000 && (opcode & 0x00F0) == 0x00C0) {
-        int n_rows = opcode & 0x000F;
-        scroll_down(chip8, n_rows);
-        return;
+// Pick a ROM from a directory by its thumbnail. The chosen ROM's warm-up
+// snapshot (launcher.h) is copied to *out, so play resumes from the frame
+// shown. Returns the ROM's path (free it), or NULL if the user quit.
+static char *runLauncher(const char *dir, Chip8 *out, uint64_t *program_hash) {
+    RomLibrary *library = scanLibrary(dir, LIBRARY_WARMUP_FRAMES, 0);
+    if (!library)
+        return NULL;
+    printf("library: %d ROMs, %d built, %d from cache, in %.2f s\n", library->count,
+           library->built, library->cached, library->seconds);
+    LibraryEntry **shown = malloc((library->count + 1) * sizeof(LibraryEntry *));
+    int count = 0;
+    for (int i = 0; i < library->count; i++)
+        if (library->entries[i].ok)
+            shown[count++] = &library->entries[i];
+    if (count == 0) {
+        fprintf(stderr, "No ROMs in %s\n", dir);
+        free(shown);
+        freeLibrary(library);
+        return NULL;
+    }
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        fprintf(stderr, "SDL could not initialize: %s\n", SDL_GetError());
+        free(shown);
+        freeLibrary(library);
+        return NULL;
     }
 
-    switch (opcode & 0xF000) {
-        case 0x0000:
-            switch (opcode) {
-                case 0x00E0: // Clear display.
-                    memset(chip8->display, 0, sizeof(chip8->display));
-                    break;
-                case 0x00EE: // Return from subroutine.
-                    chip8->sp--;
-                    chip8->pc = chip8->stack[chip8->sp];
-                    break;
-                default:
-                    break;
-            }
-            break;
-        case 0x1000:
-            chip8->pc = nnn;
-            break;
-        case 0x2000:
-            chip8->stack[chip8->sp] = chip8->pc;
-            chip8->sp++;
-            chip8->pc = nnn;
-            break;
-        case 0x3000:
-            if (chip8->V[x] == kk)
-                chip8->pc += 2;
-            break;
-        case 0x4000:
-            if (chip8->V[x] != kk)
-                chip8->pc += 2;
-            break;
-        case 0x5000:
-            if (chip8->V[x] == chip8->V[y])
-                chip8->pc += 2;
-            break;
-        case 0x6000:
-            chip8->V[x] = kk;
-            break;
-        case 0x7000:
-            chip8->V[x] += kk;
-            break;
-        case 0x8000:
-            switch (opcode & 0x000F) {
-                case 0x0:
-                    chip8->V[x] = chip8->V[y];
-                    break;
-                case 0x1:
-                    chip8->V[x] |= chip8->V[y];
-                    break;
-                case 0x2:
-                    chip8->V[x] &= chip8->V[y];
-                    break;
-                case 0x3:
-                    chip8->V[x] ^= chip8->V[y];
-                    break;
-                case 0x4: {
-                    uint16_t sum = chip8->V[x] + chip8->V[y];
-                    chip8->V[0xF] = (sum > 255) ? 1 : 0;
-                    chip8->V[x] = sum & 0xFF;
-                    break;
-                }
-                case 0x5:
-                    chip8->V[0xF] = (chip8->V[x] > chip8->V[y]) ? 1 : 0;
-                    chip8->V[x] -= chip8->V[y];
-                    break;
-                case 0x6:
-                    chip8->V[0xF] = chip8->V[x] & 0x1;
-                    chip8->V[x] >>= 1;
-                    break;
-                case 0x7:
-                    chip8->V[0xF] = (chip8->V[y] > chip8->V[x]) ? 1 : 0;
-                    chip8->V[x] = chip8->V[y] - chip8->V[x];
-                    break;
-                case 0xE:
-                    chip8->V[0xF] = (chip8->V[x] & 0x80) >> 7;
-                    chip8->V[x] <<= 1;
-                    break;
-                default:
-                    break;
-            }
-            break;
-        case 0x9000:
-            if (chip8->V[x] != chip8->V[y])
-                chip8->pc += 2;
-            break;
-        case 0xA000:
-            chip8->I = nnn;
-            break;
-        case 0xB000:
-            chip8->pc = nnn + chip8->V[0];
-            break;
-        case 0xC000:
-            chip8->V[x] = (rand() % 256) & kk;
-            break;
-        case 0xD000: {
-            int spriteWidth, spriteHeight;
-            // If in extended mode and n==0, draw a 16x16 sprite.
-            if (extended_mode && n == 0) {
-                spriteWidth = 16;
-                spriteHeight = 16;
-            } else {
-                spriteWidth = 8;
-                spriteHeight = n;
-            }
-            chip8->V[0xF] = 0;
-            if (spriteWidth == 16) {
-                // SCHIP 16x16 sprite: assume 32 bytes, 2 bytes per row.
-                for (int row = 0; row < 16; row++) {
-                    uint8_t byte1 = chip8->memory[chip8->I + row * 2];
-                    uint8_t byte2 = chip8->memory[chip8->I + row * 2 + 1];
-                    for (int col = 0; col < 16; col++) {
-                        int pixelBit = (col < 8)
-                            ? ((byte1 & (0x80 >> col)) != 0)
-                            : ((byte2 & (0x80 >> (col - 8))) != 0);
-                        if (pixelBit) {
-                            int posX = (chip8->V[x] + col) % screen_width;
-                            int posY = (chip8->V[y] + row) % screen_height;
-                            int idx = posY * MAX_WIDTH + posX;
-                            if (chip8->display[idx] == 1)
-                                chip8->V[0xF] = 1;
-                            chip8->display[idx] ^= 1;
-                        }
-                    }
-                }
-            } else {
-                // Standard 8xN sprite.
-                for (int row = 0; row < spriteHeight; row++) {
-                    uint8_t spriteByte = chip8->memory[chip8->I + row];
-                    for (int col = 0; col < spriteWidth; col++) {
-                        int pixelBit = (spriteByte & (0x80 >> col)) != 0;
-                        if (pixelBit) {
-                            int posX = (chip8->V[x] + col) % screen_width;
-                            int posY = (chip8->V[y] + row) % screen_height;
-                            int idx = posY * MAX_WIDTH + posX;
-                            if (chip8->display[idx] == 1)
-                                chip8->V[0xF] = 1;
-                            chip8->display[idx] ^= 1;
-                        }
-                    }
+    int rows = (count + TILE_COLUMNS - 1) / TILE_COLUMNS;
+    int visible_rows = rows < TILE_ROWS ? rows : TILE_ROWS;
+    SDL_Window *window = SDL_CreateWindow("cupid-8 library", SDL_WINDOWPOS_CENTERED,
+                                          SDL_WINDOWPOS_CENTERED,
+                                          TILE_COLUMNS * (TILE_WIDTH + TILE_PAD) + TILE_PAD,
+                                          visible_rows * (TILE_HEIGHT + TILE_PAD) + TILE_PAD,
+                                          SDL_WINDOW_SHOWN);
+    SDL_Renderer *renderer = window ? SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED) : NULL;
+    SDL_Texture **thumbs = calloc(count, sizeof(SDL_Texture *));
+    if (renderer) {
+        // Thumbnails use the colors the game will start in.
+        static uint32_t pixels[MAX_WIDTH * MAX_HEIGHT];
+        for (int i = 0; i < count; i++) {
+            const Chip8 *snap = shown[i]->snapshot;
+            uint32_t fg = snap->extended_mode ? 0xFF00FFFFu : 0xFFFFFFFFu;
+            uint32_t bg = snap->extended_mode ? 0xFF000080u : 0xFF000000u;
+            thumbs[i] = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                          SDL_TEXTUREACCESS_STATIC, MAX_WIDTH, MAX_HEIGHT);
+            if (!thumbs[i])
+                continue;
+            for (int y = 0; y < snap->screen_height; y++)
+                kernels.expand_palette(&snap->display[y * MAX_WIDTH], &pixels[y * MAX_WIDTH],
+                                       snap->screen_width, fg, bg);
+            SDL_Rect area = { 0, 0, snap->screen_width, snap->screen_height };
+            SDL_UpdateTexture(thumbs[i], &area, pixels, MAX_WIDTH * sizeof(uint32_t));
+        }
+    } else {
+        fprintf(stderr, "Launcher window could not be created: %s\n", SDL_GetError());
+    }
+
+    int selected = 0, top = 0, chosen = -1, running = renderer != NULL;
+    while (running) {
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                running = 0;
+            } else if (event.type == SDL_KEYDOWN) {
+                switch (event.key.keysym.sym) {
+                    case SDLK_ESCAPE: running = 0; break;
+                    case SDLK_RETURN: chosen = selected; break;
+                    case SDLK_LEFT:   selected--; break;
+                    case SDLK_RIGHT:  selected++; break;
+                    case SDLK_UP:     selected -= TILE_COLUMNS; break;
+                    case SDLK_DOWN:   selected += TILE_COLUMNS; break;
+                    default: break;
                 }
+            } else if (event.type == SDL_MOUSEBUTTONDOWN) {
+                // Clicks in the padding around and between tiles pick nothing.
+                int x = event.button.x - TILE_PAD, y = event.button.y - TILE_PAD;
+                if (x < 0 || y < 0 || x % (TILE_WIDTH + TILE_PAD) >= TILE_WIDTH ||
+                    y % (TILE_HEIGHT + TILE_PAD) >= TILE_HEIGHT)
+                    continue;
+                int col = x / (TILE_WIDTH + TILE_PAD);
+                int row = y / (TILE_HEIGHT + TILE_PAD);
+                int i = (top + row) * TILE_COLUMNS + col;
+                if (col < TILE_COLUMNS && row < visible_rows && i < count)
+                    chosen = i;
             }
-            break;
         }
-        case 0xE000:
-            switch (opcode & 0x00FF) {
-                case 0x9E:
-                    if (chip8->keys[chip8->V[x]])
-                        chip8->pc += 2;
-                    break;
-                case 0xA1:
-                    if (!chip8->keys[chip8->V[x]])
-                        chip8->pc += 2;
-                    break;
-                default:
-                    break;
-            }
+        if (chosen >= 0)
             break;
-        case 0xF000:
-            switch (opcode & 0x00FF) {
-                case 0x07:
-                    chip8->V[x] = chip8->delay_timer;
-                    break;
-                case 0x0A: {
-                    int key_pressed = 0;
-                    SDL_Event event;
-                    while (!key_pressed) {
-                        while (SDL_PollEvent(&event)) {
-                            if (event.type == SDL_KEYDOWN) {
-                                switch (event.key.keysym.sym) {
-                                    case SDLK_1: chip8->V[x] = 0x1; key_pressed = 1; break;
-                                    case SDLK_2: chip8->V[x] = 0x2; key_pressed = 1; break;
-                                    case SDLK_3: chip8->V[x] = 0x3; key_pressed = 1; break;
-                                    case SDLK_4: chip8->V[x] = 0xC; key_pressed = 1; break;
-                                    case SDLK_q: chip8->V[x] = 0x4; key_pressed = 1; break;
-                                    case SDLK_w: chip8->V[x] = 0x5; key_pressed = 1; break;
-                                    case SDLK_e: chip8->V[x] = 0x6; key_pressed = 1; break;
-                                    case SDLK_r: chip8->V[x] = 0xD; key_pressed = 1; break;
-                                    case SDLK_a: chip8->V[x] = 0x7; key_pressed = 1; break;
-                                    case SDLK_s: chip8->V[x] = 0x8; key_pressed = 1; break;
-                                    case SDLK_d: chip8->V[x] = 0x9; key_pressed = 1; break;
-                                    case SDLK_f: chip8->V[x] = 0xE; key_pressed = 1; break;
-                                    case SDLK_z: chip8->V[x] = 0xA; key_pressed = 1; break;
-                                    case SDLK_x: chip8->V[x] = 0x0; key_pressed = 1; break;
-                                    case SDLK_c: chip8->V[x] = 0xB; key_pressed = 1; break;
-                                    case SDLK_v: chip8->V[x] = 0xF; key_pressed = 1; break;
-                                    default: break;
-                                }
-                            } else if (event.type == SDL_QUIT) {
-                                exit(0);
-                            }
-                        }
-                    }
-                    break;
-                }
-                case 0x15:
-                    chip8->delay_timer = chip8->V[x];
-                    break;
-                case 0x18:
-                    chip8->sound_timer = chip8->V[x];
-                    break;
-                case 0x1E:
-                    chip8->I += chip8->V[x];
-                    break;
-                case 0x29:
-                    chip8->I = 0x50 + (chip8->V[x] * 5);
-                    break;
-                case 0x33: {
-                    uint8_t value = chip8->V[x];
-                    chip8->memory[chip8->I]     = value / 100;
-                    chip8->memory[chip8->I + 1] = (value / 10) % 10;
-                    chip8->memory[chip8->I + 2] = value % 10;
-                    break;
-                }
-                case 0x55:
-                    for (int i = 0; i <= x; i++) {
-                        chip8->memory[chip8->I + i] = chip8->V[i];
-                    }
-                    break;
-                case 0x65:
-                    for (int i = 0; i <= x; i++) {
-                        chip8->V[i] = chip8->memory[chip8->I + i];
-                    }
-                    break;
-                default:
-                    break;
+        if (selected < 0)
+            selected = 0;
+        if (selected >= count)
+            selected = count - 1;
+        // Scroll to keep the selection on screen.
+        int row = selected / TILE_COLUMNS;
+        if (row < top)
+            top = row;
+        if (row >= top + visible_rows)
+            top = row - visible_rows + 1;
+
+        SDL_SetRenderDrawColor(renderer, 32, 32, 32, 255);
+        SDL_RenderClear(renderer);
+        for (int i = top * TILE_COLUMNS; i < count && i < (top + visible_rows) * TILE_COLUMNS; i++) {
+            const Chip8 *snap = shown[i]->snapshot;
+            SDL_Rect tile = { TILE_PAD + (i % TILE_COLUMNS) * (TILE_WIDTH + TILE_PAD),
+                              TILE_PAD + (i / TILE_COLUMNS - top) * (TILE_HEIGHT + TILE_PAD),
+                              TILE_WIDTH, TILE_HEIGHT };
+            SDL_Rect area = { 0, 0, snap->screen_width, snap->screen_height };
+            if (thumbs[i])
+                SDL_RenderCopy(renderer, thumbs[i], &area, &tile);
+            if (i == selected) {
+                SDL_Rect frame = { tile.x - 3, tile.y - 3, tile.w + 6, tile.h + 6 };
+                SDL_SetRenderDrawColor(renderer, 255, 192, 0, 255);
+                SDL_RenderDrawRect(renderer, &frame);
+                SDL_RenderDrawRect(renderer, &tile);
             }
-            break;
-        default:
-            break;
+        }
+        SDL_RenderPresent(renderer);
+        char title[256];
+        snprintf(title, sizeof(title), "cupid-8 library - %s", shown[selected]->name);
+        SDL_SetWindowTitle(window, title);
+        SDL_Delay(16);
     }
 
-    if (chip8->delay_timer > 0)
-        chip8->delay_timer--;
-    if (chip8->sound_timer > 0)
-        chip8->sound_timer--;
+    char *path = NULL;
+    if (chosen >= 0) {
+        *out = *shown[chosen]->snapshot;
+        *program_hash = shown[chosen]->hash;
+        path = malloc(strlen(shown[chosen]->path) + 1);
+        strcpy(path, shown[chosen]->path);
+    }
+    for (int i = 0; i < count; i++)
+        if (thumbs[i])
+            SDL_DestroyTexture(thumbs[i]);
+    free(thumbs);
+    if (renderer)
+        SDL_DestroyRenderer(renderer);
+    if (window)
+        SDL_DestroyWindow(window);
+    free(shown);
+    freeLibrary(library);
+    return path;
 }
 
-int mapKey(SDL_Keycode key) {
-    switch (key) {
-        case SDLK_1: return 0x1;
-        case SDLK_2: return 0x2;
-        case SDLK_3: return 0x3;
-        case SDLK_4: return 0xC;
-        case SDLK_q: return 0x4;
-        case SDLK_w: return 0x5;
-        case SDLK_e: return 0x6;
-        case SDLK_r: return 0xD;
-        case SDLK_a: return 0x7;
-        case SDLK_s: return 0x8;
-        case SDLK_d: return 0x9;
-        case SDLK_f: return 0xE;
-        case SDLK_z: return 0xA;
-        case SDLK_x: return 0x0;
-        case SDLK_c: return 0xB;
-        case SDLK_v: return 0xF;
-        default: return -1;
-    }
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--cpu-level <generic|sse2|avx2|avx512>] <ROM file|mode> ...\n", prog);
+    fprintf(stderr, "       %s <ROM file> [--lores-half-scroll] [--latency] [--auto-speed]\n", prog);
+    fprintf(stderr, "                  [--persist <state file>] [--telemetry <watch file> <out file>]\n");
+    fprintf(stderr, "                  [--frontend-bench [frames] [key file]]\n");
+    fprintf(stderr, "       %s --launcher <ROM dir> [same options as above]\n", prog);
+    fprintf(stderr, "       %s --daemon <socket> [workers]\n", prog);
+    fprintf(stderr, "       %s --client <socket> <ROM file> [frames]\n", prog);
+    fprintf(stderr, "       %s --loadtest <socket> <ROM file> [clients] [seconds]\n", prog);
+    fprintf(stderr, "       %s --input-fuzz <ROM file> <out dir> [threads] [seconds]\n", prog);
+    fprintf(stderr, "       %s --corpus-stats <ROM dir> [frames] [threads]\n", prog);
+    fprintf(stderr, "       %s --trace-export <ROM file> <out> [instructions] [text|binary] [cycles/frame]\n", prog);
+    fprintf(stderr, "       %s --trace-compare <ref trace> <ROM file> [ignore,fields|-] [cycles/frame]\n", prog);
+    fprintf(stderr, "       %s --memo-bench <ROM file> [frames] [cycles/frame] [verify]\n", prog);
+    fprintf(stderr, "       %s --instance-bench <ROM file> [instances] [frames] [cycles/frame]\n", prog);
+    fprintf(stderr, "       %s --scroll-bench [iterations]\n", prog);
+    fprintf(stderr, "       %s --farm <job file> [workers] [results.csv] [--checkpoint <dir>] "
+                    "[--checkpoint-every <seconds>] [--resume]\n", prog);
+    fprintf(stderr, "       %s --realtime-host <ROM file> [sessions] [threads] [seconds] [report.csv]\n", prog);
+    fprintf(stderr, "       %s --ir-diff <ROM file|random> [blocks]\n", prog);
+    fprintf(stderr, "       %s --fair-share <tenant file> [seconds] [quantum]\n", prog);
+    fprintf(stderr, "       %s --persist-run <ROM file> <state file> [frames] [cycles/frame]\n", prog);
+    fprintf(stderr, "       %s --cpu-features\n", prog);
+    fprintf(stderr, "       %s --kernel-bench [iterations]\n", prog);
+    fprintf(stderr, "       %s --library-scan <ROM dir> [frames] [threads]\n", prog);
+    fprintf(stderr, "       %s --auto-speed-report <ROM file> [frames]\n", prog);
+    fprintf(stderr, "       %s --telemetry-bench <ROM file> <watch file> <out file> [instances] [frames]\n", prog);
+    fprintf(stderr, "       %s --telemetry-dump <telemetry file>\n", prog);
+    fprintf(stderr, "       %s --pool-bench <ROM file> [instances] [frames] [threads] [numa]\n", prog);
+    fprintf(stderr, "       %s --dedup-bench <ROM file> [instances] [frames] [actions] [episode]\n", prog);
+    fprintf(stderr, "       %s --framestack-bench <ROM file> [instances] [frames] [depth]\n", prog);
 }
 
 int main(int argc, char **argv) {
+    // Force a kernel level (kernels.h) ahead of any mode.
+    if (argc > 2 && strcmp(argv[1], "--cpu-level") == 0) {
+        int level = parseCpuLevel(argv[2]);
+        if (level < 0 || !selectKernels(level)) {
+            fprintf(stderr, "CPU level %s is unknown or not supported here\n", argv[2]);
+            return 1;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <ROM file>\n", argv[0]);
+        usage(argv[0]);
         return 1;
     }
 
-    srand(time(NULL));
+    if (strcmp(argv[1], "--cpu-features") == 0) {
+        printCpuFeatures(stdout);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "--kernel-bench") == 0)
+        return runKernelBench(argc > 2 ? atoi(argv[2]) : 0);
+
+    if (strcmp(argv[1], "--daemon") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runDaemon(argv[2], argc > 3 ? atoi(argv[3]) : 0);
+    }
+    if (strcmp(argv[1], "--client") == 0) {
+        if (argc < 4) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runDaemonClient(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 60);
+    }
+    if (strcmp(argv[1], "--loadtest") == 0) {
+        if (argc < 4) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runDaemonLoadTest(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 4,
+                                 argc > 5 ? atof(argv[5]) : 5.0);
+    }
+
+    if (strcmp(argv[1], "--input-fuzz") == 0) {
+        if (argc < 4) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runInputFuzz(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 0,
+                            argc > 5 ? atof(argv[5]) : 60.0);
+    }
+
+    if (strcmp(argv[1], "--corpus-stats") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runCorpusStats(argv[2], argc > 3 ? atoi(argv[3]) : 600,
+                              argc > 4 ? atoi(argv[4]) : 0);
+    }
+
+    if (strcmp(argv[1], "--trace-export") == 0) {
+        if (argc < 4) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runTraceExport(argv[2], argv[3], argc > 4 ? atol(argv[4]) : 1000000,
+                              argc > 5 && strcmp(argv[5], "binary") == 0,
+                              argc > 6 ? atoi(argv[6]) : 0);
+    }
+
+    if (strcmp(argv[1], "--trace-compare") == 0) {
+        if (argc < 4) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runTraceCompare(argv[2], argv[3],
+                               argc > 4 && strcmp(argv[4], "-") != 0 ? argv[4] : NULL,
+                               argc > 5 ? atoi(argv[5]) : 0);
+    }
+
+    if (strcmp(argv[1], "--memo-bench") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runMemoBench(argv[2], argc > 3 ? atoi(argv[3]) : 100000,
+                            argc > 4 ? atoi(argv[4]) : 0,
+                            argc > 5 && strcmp(argv[5], "verify") == 0);
+    }
+    if (strcmp(argv[1], "--instance-bench") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runInstanceBench(argv[2], argc > 3 ? atoi(argv[3]) : 1,
+                                argc > 4 ? atoi(argv[4]) : 100000,
+                                argc > 5 ? atoi(argv[5]) : 0);
+    }
+    if (strcmp(argv[1], "--scroll-bench") == 0)
+        return runScrollBench(argc > 2 ? atoi(argv[2]) : 0);
+
+    if (strcmp(argv[1], "--farm") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        // Positional arguments, then options.
+        const char *positional[2] = { NULL, NULL };
+        FarmCheckpoints ckpt = { NULL, 0, 0 };
+        int npositional = 0;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+                ckpt.dir = argv[++i];
+            } else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+                ckpt.interval = atof(argv[++i]);
+            } else if (strcmp(argv[i], "--resume") == 0) {
+                ckpt.resume = 1;
+            } else if (argv[i][0] != '-' && npositional < 2) {
+                positional[npositional++] = argv[i];
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        // Resuming without a directory uses the default one, next to the job file.
+        static char default_dir[4096];
+        if (!ckpt.dir && (ckpt.resume || ckpt.interval > 0)) {
+            snprintf(default_dir, sizeof(default_dir), "%s.ckpt", argv[2]);
+            ckpt.dir = default_dir;
+        }
+        return runFarm(argv[2], positional[0] ? atoi(positional[0]) : 0, positional[1],
+                       ckpt.dir ? &ckpt : NULL);
+    }
+    if (strcmp(argv[1], "--realtime-host") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runRealtimeHost(argv[2], argc > 3 ? atoi(argv[3]) : 1000,
+                               argc > 4 ? atoi(argv[4]) : 0, argc > 5 ? atof(argv[5]) : 10.0,
+                               argc > 6 ? argv[6] : NULL);
+    }
+
+    if (strcmp(argv[1], "--ir-diff") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runIrDiffTest(argv[2], argc > 3 ? atol(argv[3]) : 100000);
+    }
+
+    if (strcmp(argv[1], "--fair-share") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runFairShare(argv[2], argc > 3 ? atof(argv[3]) : 10.0, argc > 4 ? atoi(argv[4]) : 1000);
+    }
+
+    if (strcmp(argv[1], "--persist-run") == 0) {
+        if (argc < 4) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runPersistentRun(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 600,
+                                argc > 5 ? atoi(argv[5]) : DEFAULT_CYCLES_PER_FRAME);
+    }
+
+    if (strcmp(argv[1], "--library-scan") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runLibraryScan(argv[2], argc > 3 ? atoi(argv[3]) : LIBRARY_WARMUP_FRAMES,
+                              argc > 4 ? atoi(argv[4]) : 0);
+    }
+
+    if (strcmp(argv[1], "--auto-speed-report") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runAutoSpeedReport(argv[2], argc > 3 ? atoi(argv[3]) : 1800);
+    }
+
+    if (strcmp(argv[1], "--telemetry-bench") == 0) {
+        if (argc < 5) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runTelemetryBench(argv[2], argv[3], argv[4], argc > 5 ? atoi(argv[5]) : 1000,
+                                 argc > 6 ? atoi(argv[6]) : 600);
+    }
+    if (strcmp(argv[1], "--telemetry-dump") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runTelemetryDump(argv[2]);
+    }
+
+    if (strcmp(argv[1], "--pool-bench") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runPoolBench(argv[2], argc > 3 ? atoi(argv[3]) : 100000, argc > 4 ? atoi(argv[4]) : 60,
+                            argc > 5 ? atoi(argv[5]) : 0, argc > 6 && strcmp(argv[6], "numa") == 0);
+    }
+
+    if (strcmp(argv[1], "--dedup-bench") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runDedupBench(argv[2], argc > 3 ? atoi(argv[3]) : 4096, argc > 4 ? atoi(argv[4]) : 600,
+                             argc > 5 ? atoi(argv[5]) : 4, argc > 6 ? atoi(argv[6]) : 0);
+    }
+    if (strcmp(argv[1], "--framestack-bench") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runFrameStackBench(argv[2], argc > 3 ? atoi(argv[3]) : 1024, argc > 4 ? atoi(argv[4]) : 300,
+                                  argc > 5 ? atoi(argv[5]) : 4);
+    }
+
     initializeChip8(&chip8);
-    if (!loadROM(&chip8, argv[1]))
-        return 1;
+    seedChip8(&chip8, (uint32_t)time(NULL));
+    char *rom_path = argv[1];
+    uint64_t program_hash = 0;
+    int first_option = 2;
+    if (strcmp(argv[1], "--launcher") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+        // The snapshot has run for a while, so hash the ROM as loaded
+        // rather than its memory now.
+        rom_path = runLauncher(argv[2], &chip8, &program_hash);
+        if (!rom_path)
+            return 0;
+        first_option = 3;
+    } else {
+        if (!loadROM(&chip8, rom_path))
+            return 1;
+        program_hash = hashProgram(&chip8);
+    }
+    int latency_mode = 0, auto_speed_mode = 0;
+    const char *persist_path = NULL;
+    const char *watch_path = NULL, *telemetry_path = NULL;
+    for (int i = first_option; i < argc; i++) {
+        if (strcmp(argv[i], "--lores-half-scroll") == 0) {
+            chip8.quirks |= QUIRK_LORES_HALF_SCROLL;
+        } else if (strcmp(argv[i], "--latency") == 0) {
+            latency_mode = 1;
+        } else if (strcmp(argv[i], "--auto-speed") == 0) {
+            auto_speed_mode = 1;
+        } else if (strcmp(argv[i], "--persist") == 0 && i + 1 < argc) {
+            persist_path = argv[++i];
+        } else if (strcmp(argv[i], "--telemetry") == 0 && i + 2 < argc) {
+            watch_path = argv[++i];
+            telemetry_path = argv[++i];
+        } else if (strcmp(argv[i], "--frontend-bench") == 0) {
+            bench.active = 1;
+            bench.frames = 600;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9')
+                bench.frames = atoi(argv[++i]);
+            if (i + 1 < argc && argv[i + 1][0] != '-' && !loadKeyScript(argv[++i]))
+                return 1;
+            if (bench.frames <= 0)
+                bench.frames = 600;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // With a state file, pick up where the last run of this ROM left off
+    // and commit every frame from here on.
+    PersistentState *persist = NULL;
+    if (persist_path) {
+        persist = openPersistentState(persist_path, program_hash, 60);
+        if (!persist)
+            return 1;
+        uint8_t quirks = chip8.quirks;
+        uint64_t frame = resumePersistentState(persist, &chip8);
+        chip8.quirks |= quirks;
+        if (frame)
+            printf("Resumed %s at frame %llu\n", rom_path, (unsigned long long)frame);
+    }
+
+    // Telemetry samples the watch list once per frame; a .csv name gets
+    // CSV, anything else the binary format.
+    Telemetry *telemetry = NULL;
+    if (watch_path) {
+        Watch watches[TELEMETRY_MAX_WATCHES];
+        int count = loadWatchList(watch_path, watches, TELEMETRY_MAX_WATCHES);
+        size_t len = strlen(telemetry_path);
+        if (count > 0)
+            telemetry = openTelemetry(telemetry_path,
+                                      len > 4 && strcmp(telemetry_path + len - 4, ".csv") == 0,
+                                      watches, count, 1, 0);
+        if (!telemetry)
+            return 1;
+    }
 
+    // The benchmark runs headless unless drivers were picked explicitly.
+    if (bench.active) {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+        SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+    }
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) < 0) {
         fprintf(stderr, "SDL could not initialize: %s\n", SDL_GetError());
         return 1;
@@ -529,8 +769,8 @@ int main(int argc, char **argv) {
     SDL_Window *window = SDL_CreateWindow("cupid-8 Chip8 Emulator",
                                           SDL_WINDOWPOS_CENTERED,
                                           SDL_WINDOWPOS_CENTERED,
-                                          screen_width * WINDOW_SCALE,
-                                          screen_height * WINDOW_SCALE,
+                                          chip8.screen_width * WINDOW_SCALE,
+                                          chip8.screen_height * WINDOW_SCALE,
                                           SDL_WINDOW_SHOWN);
     if (!window) {
         fprintf(stderr, "Window could not be created: %s\n", SDL_GetError());
@@ -538,50 +778,137 @@ int main(int argc, char **argv) {
         return 1;
     }
     g_window = window; // Set the global window pointer.
+    int display_mode = chip8.extended_mode;
+    // A resumed machine may already be in extended mode.
+    if (display_mode)
+        applyDisplayMode(&chip8);
     
     SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    // Headless video drivers only have the software renderer.
+    if (!renderer)
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
     if (!renderer) {
         fprintf(stderr, "Renderer could not be created: %s\n", SDL_GetError());
         SDL_DestroyWindow(window);
         SDL_Quit();
         return 1;
     }
+    g_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                  MAX_WIDTH, MAX_HEIGHT);
+    if (!g_texture) {
+        fprintf(stderr, "Texture could not be created: %s\n", SDL_GetError());
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+
+    // Latency mode steps whole frames. While one is on screen, idle cores
+    // compute the next for the likely inputs, so once input is read the
+    // frame can usually be shown without emulating it.
+    // Auto-speed also steps whole frames, calibrating IPF as it goes (see
+    // autospeed.h). Latency mode takes the saved value as it is, since its
+    // frames are computed ahead.
+    AutoSpeed auto_speed;
+    if (auto_speed_mode)
+        initAutoSpeed(&auto_speed, program_hash, DEFAULT_CYCLES_PER_FRAME);
+    Speculator *spec = NULL;
+    if (latency_mode) {
+        spec = createSpeculator(0, auto_speed_mode ? auto_speed.ipf : DEFAULT_CYCLES_PER_FRAME);
+        speculateFrame(spec, &chip8);
+        auto_speed_mode = 0;
+    }
 
     int running = 1;
-    SDL_Event event;
     const int cycleDelay = 2;
     uint32_t timer_last = SDL_GetTicks();
+    uint32_t frame_start = SDL_GetTicks();
+    if (bench.active)
+        bench.start = bench.last = SDL_GetPerformanceCounter();
     while (running) {
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT)
-                running = 0;
-            if (event.type == SDL_KEYDOWN) {
-                int keyIndex = mapKey(event.key.keysym.sym);
-                if (keyIndex != -1)
-                    chip8.keys[keyIndex] = 1;
+        pushScriptedInput();
+        running = pollInput(&chip8);
+        lap(PHASE_INPUT);
+
+        if (spec)
+            commitFrame(spec, &chip8, getKeyMask(&chip8));
+        else if (auto_speed_mode)
+            runAutoFrame(&auto_speed, &chip8);
+        else
+            emulateCycle(&chip8);
+        if (chip8.halted)
+            running = 0;
+        lap(PHASE_EMULATE);
+        if (chip8.extended_mode != display_mode) {
+            display_mode = chip8.extended_mode;
+            applyDisplayMode(&chip8);
+        }
+        drawGraphics(renderer, &chip8);
+        lap(PHASE_DRAW);
+        SDL_RenderPresent(renderer);
+        lap(PHASE_PRESENT);
+
+        if (spec || auto_speed_mode) {
+            if (persist)
+                commitPersistentState(persist, &chip8);
+            if (telemetry) {
+                recordTelemetry(telemetry, 0, &chip8);
+                endTelemetryFrame(telemetry);
             }
-            if (event.type == SDL_KEYUP) {
-                int keyIndex = mapKey(event.key.keysym.sym);
-                if (keyIndex != -1)
-                    chip8.keys[keyIndex] = 0;
+            if (spec)
+                speculateFrame(spec, &chip8);
+            lap(PHASE_OTHER);
+            uint32_t elapsed = SDL_GetTicks() - frame_start;
+            if (elapsed < 16)
+                SDL_Delay(16 - elapsed);
+            frame_start = SDL_GetTicks();
+            lap(PHASE_PACING);
+            if (!benchFrameDone())
+                running = 0;
+        } else {
+            SDL_Delay(cycleDelay);
+            lap(PHASE_PACING);
+            if (SDL_GetTicks() - timer_last >= 16) {
+                tickTimers(&chip8);
+                timer_last = SDL_GetTicks();
+                if (persist)
+                    commitPersistentState(persist, &chip8);
+                if (telemetry) {
+                    recordTelemetry(telemetry, 0, &chip8);
+                    endTelemetryFrame(telemetry);
+                }
+                if (!benchFrameDone())
+                    running = 0;
             }
+            lap(PHASE_OTHER);
         }
+        bench.iterations++;
+    }
+    if (bench.active) {
+        reportFrontendBench(renderer);
+        free(bench.script);
+    }
 
-        emulateCycle(&chip8);
-        drawGraphics(renderer, &chip8);
-        SDL_Delay(cycleDelay);
-        if (SDL_GetTicks() - timer_last >= 16) {
-            if (chip8.delay_timer > 0)
-                chip8.delay_timer--;
-            if (chip8.sound_timer > 0)
-                chip8.sound_timer--;
-            timer_last = SDL_GetTicks();
-        }
+    if (spec) {
+        SpeculatorStats st;
+        getSpeculatorStats(spec, &st);
+        printf("speculation: %llu frames, %.1f%% hit (%llu late, %llu unpredicted)\n",
+               (unsigned long long)st.frames, st.frames ? 100.0 * st.hits / st.frames : 0.0,
+               (unsigned long long)st.late, (unsigned long long)st.unpredicted);
+        destroySpeculator(spec);
     }
 
+    if (auto_speed_mode)
+        printf("auto speed: %d IPF (%s-paced%s)\n", auto_speed.ipf, guestPaceName(auto_speed.pace),
+               auto_speed.converged ? ", saved" : ", still calibrating");
+
+    closeTelemetry(telemetry, NULL);
+    closePersistentState(persist);
     SDL_CloseAudioDevice(audio_dev);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
+    if (rom_path != argv[1])
+        free(rom_path);
     return 0;
 }
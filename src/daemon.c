@@ -0,0 +1,840 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "daemon.h"
+
+#define DAEMON_MAX_CONNS 1024
+
+// One emulated machine. The session table holds one reference and every
+// job that is using the session holds another.
+typedef struct {
+    uint32_t id;
+    int owner; // Connection slot that created it; destroyed when it closes.
+    int refs;  // Guarded by session_lock.
+    int cycles_per_frame;
+    pthread_mutex_t lock;
+    Chip8 chip8;
+    DaemonFrame *frame;
+    int frame_fd;
+} Session;
+
+typedef struct {
+    int fd;   // -1 when the slot is free.
+    int busy; // A request from this connection is queued or executing.
+    int dead; // A worker failed to write the reply.
+    // The request being received. Sockets are non-blocking, so a request
+    // may arrive over several polls.
+    DaemonRequest req;
+    uint8_t *payload;
+    size_t got; // Bytes of header and payload so far.
+} Conn;
+
+typedef struct Job {
+    int conn;
+    DaemonRequest req;
+    uint8_t *payload;
+    struct Job *next;
+} Job;
+
+static Session **sessions = NULL;
+static int session_cap = 0;
+static pthread_mutex_t session_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static Conn conns[DAEMON_MAX_CONNS];
+static pthread_mutex_t conn_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static Job *queue_head = NULL, *queue_tail = NULL;
+static int queue_stop = 0;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static int wake_pipe[2] = { -1, -1 };
+static volatile sig_atomic_t daemon_stop = 0;
+
+static void onStopSignal(int sig) {
+    (void)sig;
+    daemon_stop = 1;
+}
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int readFull(int fd, void *buf, size_t len) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t r = read(fd, p, len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return 0;
+        p += r;
+        len -= r;
+    }
+    return 1;
+}
+
+// Send a header and payload in one message, optionally passing a descriptor.
+static int sendMessage(int fd, const void *header, size_t header_len,
+                       const void *payload, size_t payload_len, int pass_fd) {
+    struct iovec iov[2] = {
+        { (void *)header, header_len },
+        { (void *)payload, payload_len },
+    };
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = payload_len ? 2 : 1;
+    if (pass_fd >= 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+    }
+    size_t total = header_len + payload_len;
+    while (total > 0) {
+        ssize_t w = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Daemon sockets are non-blocking; wait for the client to drain.
+            struct pollfd p = { fd, POLLOUT, 0 };
+            if (poll(&p, 1, -1) < 0 && errno != EINTR)
+                return 0;
+            continue;
+        }
+        if (w <= 0)
+            return 0;
+        total -= w;
+        // Only the first chunk carries the descriptor; advance past what
+        // was written for any remainder.
+        msg.msg_control = NULL;
+        msg.msg_controllen = 0;
+        while (w > 0 && msg.msg_iovlen > 0) {
+            if ((size_t)w >= msg.msg_iov->iov_len) {
+                w -= msg.msg_iov->iov_len;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            } else {
+                msg.msg_iov->iov_base = (uint8_t *)msg.msg_iov->iov_base + w;
+                msg.msg_iov->iov_len -= w;
+                w = 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Copy the display into the session's shared framebuffer (seqlock writer).
+static uint32_t publishFrame(Session *s) {
+    uint32_t seq = s->frame->seq;
+    __atomic_store_n(&s->frame->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    s->frame->width = s->chip8.screen_width;
+    s->frame->height = s->chip8.screen_height;
+    memcpy(s->frame->pixels, s->chip8.display, sizeof(s->frame->pixels));
+    __atomic_store_n(&s->frame->seq, seq + 2, __ATOMIC_RELEASE);
+    return seq + 2;
+}
+
+static Session *acquireSession(uint32_t id) {
+    Session *s = NULL;
+    pthread_mutex_lock(&session_lock);
+    if (id >= 1 && (int)id <= session_cap && sessions[id - 1]) {
+        s = sessions[id - 1];
+        s->refs++;
+    }
+    pthread_mutex_unlock(&session_lock);
+    return s;
+}
+
+static void releaseSession(Session *s) {
+    pthread_mutex_lock(&session_lock);
+    int last = --s->refs == 0;
+    pthread_mutex_unlock(&session_lock);
+    if (!last)
+        return;
+    munmap(s->frame, sizeof(DaemonFrame));
+    close(s->frame_fd);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+// Unlink a session from the table and drop the table's reference.
+static void removeSession(uint32_t id) {
+    Session *s = NULL;
+    pthread_mutex_lock(&session_lock);
+    if (id >= 1 && (int)id <= session_cap) {
+        s = sessions[id - 1];
+        sessions[id - 1] = NULL;
+    }
+    pthread_mutex_unlock(&session_lock);
+    if (s)
+        releaseSession(s);
+}
+
+static Session *createSession(int owner, const uint8_t *rom, uint32_t rom_len,
+                              uint32_t cycles_per_frame, int32_t *status) {
+    Session *s = allocChip8(sizeof(Session));
+    if (!s) {
+        *status = DAEMON_ERR_NO_MEMORY;
+        return NULL;
+    }
+    initializeChip8(&s->chip8);
+    if (!loadROMData(&s->chip8, rom, rom_len)) {
+        free(s);
+        *status = DAEMON_ERR_BAD_PAYLOAD;
+        return NULL;
+    }
+    s->frame_fd = memfd_create("cupid8-frame", MFD_CLOEXEC);
+    if (s->frame_fd < 0 || ftruncate(s->frame_fd, sizeof(DaemonFrame)) < 0 ||
+        (s->frame = mmap(NULL, sizeof(DaemonFrame), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, s->frame_fd, 0)) == MAP_FAILED) {
+        if (s->frame_fd >= 0)
+            close(s->frame_fd);
+        free(s);
+        *status = DAEMON_ERR_NO_MEMORY;
+        return NULL;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    s->owner = owner;
+    s->refs = 1;
+    s->cycles_per_frame = cycles_per_frame ? (int)cycles_per_frame : DEFAULT_CYCLES_PER_FRAME;
+    seedChip8(&s->chip8, (uint32_t)time(NULL) ^ (uint32_t)(uintptr_t)s);
+    publishFrame(s);
+
+    pthread_mutex_lock(&session_lock);
+    int slot = 0;
+    while (slot < session_cap && sessions[slot])
+        slot++;
+    if (slot == session_cap) {
+        int cap = session_cap ? session_cap * 2 : 64;
+        Session **grown = realloc(sessions, cap * sizeof(Session *));
+        if (!grown) {
+            pthread_mutex_unlock(&session_lock);
+            munmap(s->frame, sizeof(DaemonFrame));
+            close(s->frame_fd);
+            pthread_mutex_destroy(&s->lock);
+            free(s);
+            *status = DAEMON_ERR_NO_MEMORY;
+            return NULL;
+        }
+        memset(grown + session_cap, 0, (cap - session_cap) * sizeof(Session *));
+        sessions = grown;
+        session_cap = cap;
+    }
+    s->id = slot + 1;
+    sessions[slot] = s;
+    pthread_mutex_unlock(&session_lock);
+    *status = DAEMON_OK;
+    return s;
+}
+
+// Execute one request and send its reply. Returns 0 if the reply could not
+// be written.
+static int executeJob(Job *job) {
+    static __thread uint8_t out[CHIP8_STATE_SIZE];
+    DaemonRequest *req = &job->req;
+    DaemonReply reply = { DAEMON_OK, 0, 0 };
+    int pass_fd = -1;
+
+    if (req->op == DAEMON_OP_CREATE) {
+        Session *s = createSession(job->conn, job->payload, req->len, req->arg, &reply.status);
+        if (s) {
+            reply.value = s->id;
+            pass_fd = s->frame_fd;
+        }
+        return sendMessage(conns[job->conn].fd, &reply, sizeof(reply), NULL, 0, pass_fd);
+    }
+
+    Session *s = acquireSession(req->session);
+    if (s && s->owner != job->conn) {
+        releaseSession(s);
+        s = NULL;
+    }
+    if (!s) {
+        reply.status = DAEMON_ERR_NO_SESSION;
+        return sendMessage(conns[job->conn].fd, &reply, sizeof(reply), NULL, 0, -1);
+    }
+    if (req->op == DAEMON_OP_DESTROY) {
+        releaseSession(s);
+        removeSession(req->session);
+        return sendMessage(conns[job->conn].fd, &reply, sizeof(reply), NULL, 0, -1);
+    }
+    if (req->op == DAEMON_OP_STEP && req->arg > DAEMON_MAX_STEP_FRAMES) {
+        releaseSession(s);
+        reply.status = DAEMON_ERR_BAD_ARG;
+        return sendMessage(conns[job->conn].fd, &reply, sizeof(reply), NULL, 0, -1);
+    }
+    pthread_mutex_lock(&s->lock);
+    switch (req->op) {
+        case DAEMON_OP_STEP:
+            for (uint32_t i = 0; i < req->arg && !s->chip8.halted; i++)
+                runFrame(&s->chip8, s->cycles_per_frame);
+            if (req->flags & DAEMON_FLAG_PUBLISH)
+                publishFrame(s);
+            reply.value = s->chip8.halted;
+            break;
+        case DAEMON_OP_SET_KEYS:
+            setKeyMask(&s->chip8, (uint16_t)req->arg);
+            break;
+        case DAEMON_OP_SAVE:
+            reply.len = saveState(&s->chip8, out, sizeof(out));
+            break;
+        case DAEMON_OP_LOAD:
+            if (!loadState(&s->chip8, job->payload, req->len))
+                reply.status = DAEMON_ERR_BAD_PAYLOAD;
+            break;
+        case DAEMON_OP_FRAME:
+            reply.value = publishFrame(s);
+            break;
+        default:
+            reply.status = DAEMON_ERR_BAD_OP;
+            break;
+    }
+    pthread_mutex_unlock(&s->lock);
+    releaseSession(s);
+    return sendMessage(conns[job->conn].fd, &reply, sizeof(reply), out, reply.len, -1);
+}
+
+static void *workerMain(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&queue_lock);
+        while (!queue_head && !queue_stop)
+            pthread_cond_wait(&queue_cond, &queue_lock);
+        Job *job = queue_head;
+        if (!job) {
+            pthread_mutex_unlock(&queue_lock);
+            return NULL;
+        }
+        queue_head = job->next;
+        if (!queue_head)
+            queue_tail = NULL;
+        pthread_mutex_unlock(&queue_lock);
+
+        int ok = executeJob(job);
+        pthread_mutex_lock(&conn_lock);
+        conns[job->conn].busy = 0;
+        if (!ok)
+            conns[job->conn].dead = 1;
+        pthread_mutex_unlock(&conn_lock);
+        free(job->payload);
+        free(job);
+        char byte = 0;
+        if (write(wake_pipe[1], &byte, 1) < 0) {
+            // The pipe is only a wakeup; the main loop also polls on a timeout.
+        }
+    }
+}
+
+static void enqueueJob(Job *job) {
+    pthread_mutex_lock(&queue_lock);
+    job->next = NULL;
+    if (queue_tail)
+        queue_tail->next = job;
+    else
+        queue_head = job;
+    queue_tail = job;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+static void closeConn(int slot) {
+    close(conns[slot].fd);
+    conns[slot].fd = -1;
+    conns[slot].dead = 0;
+    free(conns[slot].payload);
+    conns[slot].payload = NULL;
+    conns[slot].got = 0;
+    for (;;) {
+        uint32_t id = 0;
+        pthread_mutex_lock(&session_lock);
+        for (int i = 0; i < session_cap && !id; i++)
+            if (sessions[i] && sessions[i]->owner == slot)
+                id = sessions[i]->id;
+        pthread_mutex_unlock(&session_lock);
+        if (!id)
+            break;
+        removeSession(id);
+    }
+}
+
+// Read what has arrived of the connection's next request without blocking,
+// and queue it once the header and all `len` payload bytes are in. Returns
+// 0 if the connection should be closed.
+static int readRequest(int slot) {
+    Conn *c = &conns[slot];
+    for (;;) {
+        size_t want;
+        uint8_t *dst;
+        if (c->got < sizeof(c->req)) {
+            want = sizeof(c->req) - c->got;
+            dst = (uint8_t *)&c->req + c->got;
+        } else {
+            want = sizeof(c->req) + c->req.len - c->got;
+            dst = c->payload + (c->got - sizeof(c->req));
+        }
+        if (want == 0)
+            break;
+        ssize_t r = read(c->fd, dst, want);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 1;
+        if (r <= 0)
+            return 0;
+        c->got += r;
+        if (c->got == sizeof(c->req) && c->req.len) {
+            if (c->req.len > DAEMON_MAX_PAYLOAD || !(c->payload = malloc(c->req.len)))
+                return 0;
+        }
+    }
+
+    Job *job = calloc(1, sizeof(Job));
+    if (!job)
+        return 0;
+    job->conn = slot;
+    job->req = c->req;
+    job->payload = c->payload;
+    c->payload = NULL;
+    c->got = 0;
+    pthread_mutex_lock(&conn_lock);
+    c->busy = 1;
+    pthread_mutex_unlock(&conn_lock);
+    enqueueJob(job);
+    return 1;
+}
+
+// Serve sessions on a Unix-domain socket until SIGINT/SIGTERM. The main
+// thread multiplexes connections with poll() and hands complete requests to
+// a pool of workers; any worker can run any session.
+int runDaemon(const char *socket_path, int workers) {
+    if (workers <= 0)
+        workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers <= 0)
+        workers = 1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 64) < 0) {
+        perror("Failed to listen on socket");
+        close(listen_fd);
+        return 1;
+    }
+    if (pipe(wake_pipe) < 0) {
+        perror("pipe");
+        close(listen_fd);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onStopSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < DAEMON_MAX_CONNS; i++)
+        conns[i].fd = -1;
+    pthread_t *threads = calloc(workers, sizeof(pthread_t));
+    for (int i = 0; i < workers; i++)
+        pthread_create(&threads[i], NULL, workerMain, NULL);
+    fprintf(stderr, "cupid-8 daemon listening on %s with %d workers\n", socket_path, workers);
+
+    struct pollfd fds[DAEMON_MAX_CONNS + 2];
+    int slots[DAEMON_MAX_CONNS + 2];
+    while (!daemon_stop) {
+        int nfds = 0;
+        fds[nfds].fd = listen_fd;
+        fds[nfds++].events = POLLIN;
+        fds[nfds].fd = wake_pipe[0];
+        fds[nfds++].events = POLLIN;
+        pthread_mutex_lock(&conn_lock);
+        for (int i = 0; i < DAEMON_MAX_CONNS; i++) {
+            if (conns[i].fd < 0 || conns[i].busy)
+                continue;
+            if (conns[i].dead) {
+                pthread_mutex_unlock(&conn_lock);
+                closeConn(i);
+                pthread_mutex_lock(&conn_lock);
+                continue;
+            }
+            slots[nfds] = i;
+            fds[nfds].fd = conns[i].fd;
+            fds[nfds++].events = POLLIN;
+        }
+        pthread_mutex_unlock(&conn_lock);
+
+        if (poll(fds, nfds, 500) <= 0)
+            continue;
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            if (read(wake_pipe[0], drain, sizeof(drain)) < 0) {
+                // Nothing to do; the next poll picks up finished connections.
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd >= 0) {
+                int slot = 0;
+                while (slot < DAEMON_MAX_CONNS && conns[slot].fd >= 0)
+                    slot++;
+                if (slot == DAEMON_MAX_CONNS) {
+                    close(fd);
+                } else {
+                    conns[slot].fd = fd;
+                    conns[slot].busy = 0;
+                    conns[slot].dead = 0;
+                    conns[slot].got = 0;
+                }
+            }
+        }
+        for (int i = 2; i < nfds; i++) {
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                if (!readRequest(slots[i]))
+                    closeConn(slots[i]);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&queue_lock);
+    queue_stop = 1;
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    for (int i = 0; i < workers; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    for (int i = 0; i < DAEMON_MAX_CONNS; i++)
+        if (conns[i].fd >= 0)
+            closeConn(i);
+    for (int i = 0; i < session_cap; i++)
+        if (sessions[i])
+            removeSession(i + 1);
+    free(sessions);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    close(listen_fd);
+    unlink(socket_path);
+    return 0;
+}
+
+int daemonConnect(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Send one request and wait for its reply. Payload bytes beyond out_cap are
+// discarded. If the reply carries a descriptor and passed_fd is non-NULL it
+// is stored there (otherwise closed). Returns 0 on a transport error.
+int daemonCall(int fd, const DaemonRequest *req, const void *payload,
+               DaemonReply *reply, void *out, uint32_t out_cap, int *passed_fd) {
+    if (passed_fd)
+        *passed_fd = -1;
+    if (!sendMessage(fd, req, sizeof(*req), payload, req->len, -1))
+        return 0;
+
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov = { reply, sizeof(*reply) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t r;
+    do {
+        r = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (r < 0 && errno == EINTR);
+    if (r <= 0)
+        return 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+            int got;
+            memcpy(&got, CMSG_DATA(c), sizeof(int));
+            if (passed_fd)
+                *passed_fd = got;
+            else
+                close(got);
+        }
+    }
+    if ((size_t)r < sizeof(*reply) &&
+        !readFull(fd, (uint8_t *)reply + r, sizeof(*reply) - r))
+        return 0;
+
+    uint32_t keep = reply->len < out_cap ? reply->len : out_cap;
+    if (keep && !readFull(fd, out, keep))
+        return 0;
+    for (uint32_t left = reply->len - keep; left > 0;) {
+        uint8_t sink[256];
+        uint32_t chunk = left < sizeof(sink) ? left : sizeof(sink);
+        if (!readFull(fd, sink, chunk))
+            return 0;
+        left -= chunk;
+    }
+    return 1;
+}
+
+DaemonFrame *daemonMapFrame(int memfd) {
+    void *p = mmap(NULL, sizeof(DaemonFrame), PROT_READ, MAP_SHARED, memfd, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+// Copy a consistent frame out of shared memory (seqlock reader). Returns the
+// sequence number that was read.
+int daemonReadFrame(const DaemonFrame *frame, uint8_t *pixels, int *width, int *height) {
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&frame->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+        *width = frame->width;
+        *height = frame->height;
+        memcpy(pixels, frame->pixels, sizeof(frame->pixels));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&frame->seq, __ATOMIC_RELAXED) == seq)
+            return (int)seq;
+    }
+}
+
+static uint8_t *readFile(const char *path, uint32_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror("Failed to open ROM");
+        return NULL;
+    }
+    uint8_t *buf = malloc(MEMORY_SIZE);
+    size_t n = buf ? fread(buf, 1, MEMORY_SIZE, f) : 0;
+    fclose(f);
+    if (n > MEMORY_SIZE - START_ADDRESS) {
+        fprintf(stderr, "ROM too large for memory\n");
+        free(buf);
+        return NULL;
+    }
+    *len = (uint32_t)n;
+    return buf;
+}
+
+static int createRemoteSession(int fd, const uint8_t *rom, uint32_t rom_len,
+                               uint32_t *session, int *frame_fd) {
+    DaemonRequest req = { DAEMON_OP_CREATE, 0, 0, 0, 0, rom_len };
+    DaemonReply reply;
+    if (!daemonCall(fd, &req, rom, &reply, NULL, 0, frame_fd) || reply.status != DAEMON_OK) {
+        fprintf(stderr, "CREATE failed\n");
+        return 0;
+    }
+    *session = reply.value;
+    return 1;
+}
+
+// Minimal client: run a ROM remotely for some frames and print the display.
+int runDaemonClient(const char *socket_path, const char *rom_path, int frames) {
+    uint32_t rom_len;
+    uint8_t *rom = readFile(rom_path, &rom_len);
+    if (!rom)
+        return 1;
+    int fd = daemonConnect(socket_path);
+    if (fd < 0) {
+        perror("Failed to connect to daemon");
+        free(rom);
+        return 1;
+    }
+    uint32_t session;
+    int frame_fd;
+    if (!createRemoteSession(fd, rom, rom_len, &session, &frame_fd)) {
+        close(fd);
+        free(rom);
+        return 1;
+    }
+    free(rom);
+    DaemonFrame *frame = frame_fd >= 0 ? daemonMapFrame(frame_fd) : NULL;
+
+    DaemonRequest req = { DAEMON_OP_STEP, DAEMON_FLAG_PUBLISH, 0, session, 0, 0 };
+    DaemonReply reply;
+    int halted = 0;
+    double start = nowSeconds();
+    for (int left = frames; left > 0 && !halted;) {
+        req.arg = left < DAEMON_MAX_STEP_FRAMES ? (uint32_t)left : DAEMON_MAX_STEP_FRAMES;
+        if (!daemonCall(fd, &req, NULL, &reply, NULL, 0, NULL) || reply.status != DAEMON_OK) {
+            fprintf(stderr, "STEP failed\n");
+            break;
+        }
+        halted = reply.value;
+        left -= req.arg;
+    }
+    double elapsed = nowSeconds() - start;
+
+    if (frame) {
+        static uint8_t pixels[MAX_WIDTH * MAX_HEIGHT];
+        int width, height;
+        daemonReadFrame(frame, pixels, &width, &height);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++)
+                putchar(pixels[y * MAX_WIDTH + x] ? '#' : '.');
+            putchar('\n');
+        }
+        munmap(frame, sizeof(DaemonFrame));
+    }
+    if (frame_fd >= 0)
+        close(frame_fd);
+
+    req.op = DAEMON_OP_SAVE;
+    req.flags = 0;
+    if (daemonCall(fd, &req, NULL, &reply, NULL, 0, NULL))
+        printf("session %u: %d frames in %.3f ms, state %u bytes%s\n", session, frames,
+               elapsed * 1e3, reply.len, halted ? ", halted" : "");
+    req.op = DAEMON_OP_DESTROY;
+    daemonCall(fd, &req, NULL, &reply, NULL, 0, NULL);
+    close(fd);
+    return 0;
+}
+
+typedef struct {
+    const char *socket_path;
+    const uint8_t *rom;
+    uint32_t rom_len;
+    double deadline;
+    double *latencies;
+    size_t count;
+    size_t cap;
+    int failed;
+} LoadClient;
+
+static void *loadClientMain(void *arg) {
+    LoadClient *c = arg;
+    int fd = daemonConnect(c->socket_path);
+    uint32_t session;
+    int frame_fd;
+    if (fd < 0 || !createRemoteSession(fd, c->rom, c->rom_len, &session, &frame_fd)) {
+        c->failed = 1;
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    if (frame_fd >= 0)
+        close(frame_fd);
+    DaemonRequest req = { DAEMON_OP_STEP, DAEMON_FLAG_PUBLISH, 0, session, 1, 0 };
+    DaemonReply reply;
+    for (double t = nowSeconds(); t < c->deadline;) {
+        if (!daemonCall(fd, &req, NULL, &reply, NULL, 0, NULL)) {
+            c->failed = 1;
+            break;
+        }
+        double done = nowSeconds();
+        if (c->count == c->cap) {
+            c->cap = c->cap ? c->cap * 2 : 4096;
+            c->latencies = realloc(c->latencies, c->cap * sizeof(double));
+        }
+        c->latencies[c->count++] = done - t;
+        t = done;
+    }
+    req.op = DAEMON_OP_DESTROY;
+    daemonCall(fd, &req, NULL, &reply, NULL, 0, NULL);
+    close(fd);
+    return NULL;
+}
+
+static int compareDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Drive the daemon with concurrent clients, each stepping its own session
+// one frame per request, and report throughput and step latency.
+int runDaemonLoadTest(const char *socket_path, const char *rom_path, int clients, double seconds) {
+    uint32_t rom_len;
+    uint8_t *rom = readFile(rom_path, &rom_len);
+    if (!rom)
+        return 1;
+    if (clients < 1)
+        clients = 1;
+    LoadClient *c = calloc(clients, sizeof(LoadClient));
+    pthread_t *threads = calloc(clients, sizeof(pthread_t));
+    double start = nowSeconds();
+    for (int i = 0; i < clients; i++) {
+        c[i].socket_path = socket_path;
+        c[i].rom = rom;
+        c[i].rom_len = rom_len;
+        c[i].deadline = start + seconds;
+        pthread_create(&threads[i], NULL, loadClientMain, &c[i]);
+    }
+    size_t total = 0;
+    int failed = 0;
+    for (int i = 0; i < clients; i++) {
+        pthread_join(threads[i], NULL);
+        total += c[i].count;
+        failed += c[i].failed;
+    }
+    double elapsed = nowSeconds() - start;
+
+    double *all = malloc((total ? total : 1) * sizeof(double));
+    size_t n = 0;
+    for (int i = 0; i < clients; i++) {
+        memcpy(all + n, c[i].latencies, c[i].count * sizeof(double));
+        n += c[i].count;
+        free(c[i].latencies);
+    }
+    qsort(all, n, sizeof(double), compareDouble);
+    printf("clients:     %d%s\n", clients, failed ? " (some failed)" : "");
+    printf("requests:    %zu in %.2f s\n", n, elapsed);
+    printf("requests/s:  %.0f\n", n / elapsed);
+    if (n) {
+        printf("step p50:    %.1f us\n", all[n / 2] * 1e6);
+        printf("step p99:    %.1f us\n", all[(size_t)(n * 0.99)] * 1e6);
+        printf("step max:    %.1f us\n", all[n - 1] * 1e6);
+    }
+    free(all);
+    free(c);
+    free(threads);
+    free(rom);
+    return failed ? 1 : 0;
+}
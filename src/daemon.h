@@ -0,0 +1,79 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdint.h>
+#include "chip8.h"
+
+// Wire protocol for --daemon. Every request is a fixed 16-byte header
+// followed by `len` payload bytes; every reply is a 12-byte header followed
+// by `len` payload bytes. Fields are in host byte order since the socket is
+// local. A connection has at most one request in flight.
+enum {
+    DAEMON_OP_CREATE = 1, // payload: ROM bytes, arg: cycles/frame (0 = default)
+                          // reply value: session id, plus the frame memfd
+    DAEMON_OP_DESTROY,    // session
+    DAEMON_OP_STEP,       // session, arg: frames to run (<= DAEMON_MAX_STEP_FRAMES)
+    DAEMON_OP_SET_KEYS,   // session, arg: 16-bit key mask
+    DAEMON_OP_SAVE,       // session; reply payload: state blob
+    DAEMON_OP_LOAD,       // session, payload: state blob
+    DAEMON_OP_FRAME,      // session; publish the display, reply value: seq
+};
+
+// Request flags.
+#define DAEMON_FLAG_PUBLISH 0x01 // STEP: also publish the display afterwards.
+
+// Reply status codes.
+enum {
+    DAEMON_OK = 0,
+    DAEMON_ERR_BAD_OP = -1,
+    DAEMON_ERR_NO_SESSION = -2,
+    DAEMON_ERR_BAD_PAYLOAD = -3,
+    DAEMON_ERR_NO_MEMORY = -4,
+    DAEMON_ERR_BAD_ARG = -5,
+};
+
+typedef struct {
+    uint8_t op;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t session;
+    uint32_t arg;
+    uint32_t len;
+} DaemonRequest;
+
+typedef struct {
+    int32_t status;
+    uint32_t value;
+    uint32_t len;
+} DaemonReply;
+
+// Sessions can only be used by the connection that created them; other
+// connections get DAEMON_ERR_NO_SESSION.
+
+// Most frames one STEP may run, so one request cannot hold a worker for long.
+#define DAEMON_MAX_STEP_FRAMES 3600
+
+// Largest payload the daemon accepts (a ROM or a state blob).
+#define DAEMON_MAX_PAYLOAD (CHIP8_STATE_SIZE > MEMORY_SIZE ? CHIP8_STATE_SIZE : MEMORY_SIZE)
+
+// Shared framebuffer, one per session, handed to the client as a memfd in
+// the CREATE reply. `seq` is a seqlock: odd while the daemon is writing.
+typedef struct {
+    uint32_t seq;
+    uint16_t width;
+    uint16_t height;
+    uint8_t pixels[MAX_WIDTH * MAX_HEIGHT]; // MAX_WIDTH-wide, 0 or 1 each.
+} DaemonFrame;
+
+int runDaemon(const char *socket_path, int workers);
+
+// Client side.
+int daemonConnect(const char *socket_path);
+int daemonCall(int fd, const DaemonRequest *req, const void *payload,
+               DaemonReply *reply, void *out, uint32_t out_cap, int *passed_fd);
+DaemonFrame *daemonMapFrame(int memfd);
+int daemonReadFrame(const DaemonFrame *frame, uint8_t *pixels, int *width, int *height);
+int runDaemonClient(const char *socket_path, const char *rom_path, int frames);
+int runDaemonLoadTest(const char *socket_path, const char *rom_path, int clients, double seconds);
+
+#endif
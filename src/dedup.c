@@ -0,0 +1,365 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dedup.h"
+#include "kernels.h"
+#include "pool.h"
+
+typedef struct {
+    Chip8 *chip8;
+    int refs;      // Instances using it, plus the batch for the initial state.
+    int step_refs; // Instances using it in the current step.
+    int claimed;   // Taken by a group to step in place.
+} Shared;
+
+typedef struct {
+    Shared *from;
+    uint16_t keys;
+    int leader;     // Group whose frame this one takes; itself if it runs.
+    Shared *to;     // For leaders: the state that runs.
+    int copied;     // `to` is a copy made this step.
+    uint64_t print; // Hash of line.
+    uint64_t line[CHIP8_CACHE_LINE / 8]; // from's first line with keys applied.
+} Group;
+
+struct DedupBatch {
+    int instances;
+    Shared **slots;
+    Shared *initial;
+    InstancePool *pool;
+    Group *groups;
+    int *group_of;   // Per instance, this step.
+    int *table;      // Open addressing over groups, then over prints.
+    int table_mask;
+    DedupStats stats;
+};
+
+static Shared *newShared(DedupBatch *b, const Chip8 *from) {
+    Shared *s = calloc(1, sizeof(Shared));
+    if (!s)
+        return NULL;
+    s->chip8 = poolAlloc(b->pool);
+    if (!s->chip8) {
+        free(s);
+        return NULL;
+    }
+    *s->chip8 = *from;
+    b->stats.states++;
+    return s;
+}
+
+static void releaseShared(DedupBatch *b, Shared *s) {
+    if (--s->refs > 0)
+        return;
+    poolFree(b->pool, s->chip8);
+    free(s);
+    b->stats.states--;
+}
+
+DedupBatch *createDedupBatch(int instances, const Chip8 *initial) {
+    if (instances <= 0)
+        return NULL;
+    DedupBatch *b = calloc(1, sizeof(DedupBatch));
+    if (!b)
+        return NULL;
+    b->instances = instances;
+    b->pool = createInstancePool(POOL_THP, -1);
+    b->slots = calloc(instances, sizeof(Shared *));
+    b->groups = calloc(instances, sizeof(Group));
+    b->group_of = calloc(instances, sizeof(int));
+    int size = 1;
+    while (size < 2 * instances)
+        size <<= 1;
+    b->table = malloc(size * sizeof(int));
+    b->table_mask = size - 1;
+    if (!b->pool || !b->slots || !b->groups || !b->group_of || !b->table) {
+        destroyDedupBatch(b);
+        return NULL;
+    }
+    b->initial = newShared(b, initial);
+    if (!b->initial) {
+        destroyDedupBatch(b);
+        return NULL;
+    }
+    b->initial->refs = instances + 1;
+    for (int i = 0; i < instances; i++)
+        b->slots[i] = b->initial;
+    return b;
+}
+
+void destroyDedupBatch(DedupBatch *b) {
+    if (!b)
+        return;
+    // States live in the pool, so only the bookkeeping needs freeing.
+    if (b->slots && b->initial) {
+        for (int i = 0; i < b->instances; i++)
+            if (--b->slots[i]->refs == 0)
+                free(b->slots[i]);
+        if (--b->initial->refs == 0)
+            free(b->initial);
+    }
+    destroyInstancePool(b->pool);
+    free(b->slots);
+    free(b->groups);
+    free(b->group_of);
+    free(b->table);
+    free(b);
+}
+
+// The first line of `from` as it will be once `keys` are held, and its hash.
+static void groupLine(Group *g) {
+    memcpy(g->line, g->from->chip8, sizeof(g->line));
+    memcpy((uint8_t *)g->line + offsetof(Chip8, key_mask), &g->keys, sizeof(g->keys));
+    uint64_t h = 0;
+    for (size_t k = 0; k < sizeof(g->line) / sizeof(g->line[0]); k++)
+        h = hashMix(h, g->line[k]);
+    g->print = h;
+}
+
+static int sameStart(const Group *a, const Group *b) {
+    if (a->print != b->print || memcmp(a->line, b->line, sizeof(a->line)) != 0)
+        return 0;
+    return a->from == b->from ||
+           memcmp((const uint8_t *)a->from->chip8 + CHIP8_CACHE_LINE,
+                  (const uint8_t *)b->from->chip8 + CHIP8_CACHE_LINE,
+                  sizeof(Chip8) - CHIP8_CACHE_LINE) == 0;
+}
+
+int stepDedupBatch(DedupBatch *b, const uint16_t *keys, int cycles) {
+    int n = b->instances, groups = 0;
+
+    // Group instances by (state, keys).
+    memset(b->table, -1, (b->table_mask + 1) * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        b->slots[i]->step_refs = 0;
+        b->slots[i]->claimed = 0;
+    }
+    for (int i = 0; i < n; i++) {
+        Shared *s = b->slots[i];
+        s->step_refs++;
+        uint32_t h = (uint32_t)(hashMix(keys[i], (uint64_t)(uintptr_t)s) >> 32) & b->table_mask;
+        while (b->table[h] >= 0) {
+            Group *g = &b->groups[b->table[h]];
+            if (g->from == s && g->keys == keys[i])
+                break;
+            h = (h + 1) & b->table_mask;
+        }
+        if (b->table[h] < 0) {
+            b->table[h] = groups;
+            b->groups[groups++] = (Group){ .from = s, .keys = keys[i] };
+        }
+        b->group_of[i] = b->table[h];
+    }
+
+    // Groups that would start the frame from identical states, such as
+    // states that differed only in the keys held last frame, share one run.
+    memset(b->table, -1, (b->table_mask + 1) * sizeof(int));
+    for (int g = 0; g < groups; g++) {
+        Group *gr = &b->groups[g];
+        groupLine(gr);
+        uint32_t h = (uint32_t)(gr->print >> 32) & b->table_mask;
+        while (b->table[h] >= 0 && !sameStart(&b->groups[b->table[h]], gr))
+            h = (h + 1) & b->table_mask;
+        if (b->table[h] < 0) {
+            b->table[h] = g;
+            gr->leader = g;
+        } else {
+            gr->leader = b->table[h];
+            b->stats.merges++;
+        }
+    }
+
+    // A run may use any of its groups' states in place if no one else
+    // holds it; otherwise it gets a copy. All copies are taken before
+    // anything runs.
+    for (int g = 0; g < groups; g++) {
+        Group *gr = &b->groups[g], *leader = &b->groups[gr->leader];
+        Shared *s = gr->from;
+        if (!leader->to && !s->claimed && s->refs == s->step_refs) {
+            s->claimed = 1;
+            leader->to = s;
+        }
+    }
+    for (int g = 0; g < groups; g++) {
+        Group *gr = &b->groups[g];
+        if (gr->leader == g && !gr->to) {
+            gr->to = newShared(b, gr->from->chip8);
+            if (!gr->to) {
+                // Nothing has run yet: drop this step's copies and give up.
+                for (int c = 0; c < g; c++) {
+                    Group *done = &b->groups[c];
+                    if (done->copied) {
+                        releaseShared(b, done->to);
+                        b->stats.copies--;
+                    }
+                }
+                return 0;
+            }
+            gr->copied = 1;
+            b->stats.copies++;
+        }
+    }
+
+    for (int g = 0; g < groups; g++) {
+        Group *gr = &b->groups[g];
+        if (gr->leader == g) {
+            setKeyMask(gr->to->chip8, gr->keys);
+            runFrame(gr->to->chip8, cycles);
+            b->stats.executed++;
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        Group *gr = &b->groups[b->group_of[i]];
+        Shared *to = b->groups[gr->leader].to;
+        if (to != b->slots[i]) {
+            to->refs++;
+            releaseShared(b, b->slots[i]);
+            b->slots[i] = to;
+        }
+    }
+    b->stats.steps++;
+    b->stats.instance_frames += n;
+    return 1;
+}
+
+void resetDedupInstance(DedupBatch *b, int instance) {
+    if (b->slots[instance] == b->initial)
+        return;
+    b->initial->refs++;
+    releaseShared(b, b->slots[instance]);
+    b->slots[instance] = b->initial;
+}
+
+const Chip8 *getDedupInstance(const DedupBatch *b, int instance) {
+    return b->slots[instance]->chip8;
+}
+
+void getDedupStats(const DedupBatch *b, DedupStats *stats) {
+    *stats = b->stats;
+}
+
+// ---- Benchmark ----
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t mixInts(uint32_t a, uint32_t b) {
+    uint32_t h = a * 0x85EBCA6Bu ^ b * 0xC2B2AE35u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    return h ^ h >> 13;
+}
+
+// Action 0 holds nothing; action k holds key k - 1.
+static uint16_t benchKeys(int instance, int frame, int actions) {
+    int action = actions > 1 ? (int)(mixInts(instance, frame) % (uint32_t)actions) : 0;
+    return action ? (uint16_t)(1u << ((action - 1) & 15)) : 0;
+}
+
+static int benchReset(int instance, int frame, int episode) {
+    return episode > 0 && frame > 0 && mixInts(instance ^ 0x5BD1E995, frame) % (uint32_t)episode == 0;
+}
+
+int runDedupBench(const char *rom_path, int instances, int frames, int actions, int episode) {
+    if (instances <= 0)
+        instances = 4096;
+    if (frames <= 0)
+        frames = 600;
+    Chip8 *initial = allocChip8(sizeof(Chip8));
+    Chip8 *machines = allocChip8((size_t)instances * sizeof(Chip8));
+    uint16_t *keys = calloc(instances, sizeof(uint16_t));
+    if (!initial || !machines || !keys) {
+        fprintf(stderr, "Out of memory for %d instances\n", instances);
+        free(initial);
+        free(machines);
+        free(keys);
+        return 1;
+    }
+    initializeChip8(initial);
+    seedChip8(initial, 0x2545F491);
+    if (!loadROM(initial, rom_path)) {
+        free(initial);
+        free(machines);
+        free(keys);
+        return 1;
+    }
+
+    // Every instance on its own.
+    for (int i = 0; i < instances; i++)
+        machines[i] = *initial;
+    double start = nowSeconds();
+    for (int f = 0; f < frames; f++) {
+        for (int i = 0; i < instances; i++) {
+            if (benchReset(i, f, episode))
+                machines[i] = *initial;
+            setKeyMask(&machines[i], benchKeys(i, f, actions));
+            runFrame(&machines[i], DEFAULT_CYCLES_PER_FRAME);
+        }
+    }
+    double plain = nowSeconds() - start;
+
+    DedupBatch *batch = createDedupBatch(instances, initial);
+    if (!batch) {
+        fprintf(stderr, "Out of memory for %d instances\n", instances);
+        free(initial);
+        free(machines);
+        free(keys);
+        return 1;
+    }
+    int min_states = instances, max_states = 0;
+    start = nowSeconds();
+    for (int f = 0; f < frames; f++) {
+        for (int i = 0; i < instances; i++) {
+            if (benchReset(i, f, episode))
+                resetDedupInstance(batch, i);
+            keys[i] = benchKeys(i, f, actions);
+        }
+        if (!stepDedupBatch(batch, keys, DEFAULT_CYCLES_PER_FRAME)) {
+            fprintf(stderr, "Out of memory for deduplicated states at frame %d\n", f);
+            destroyDedupBatch(batch);
+            free(initial);
+            free(machines);
+            free(keys);
+            return 1;
+        }
+        int states = batch->stats.states;
+        if (states < min_states)
+            min_states = states;
+        if (states > max_states)
+            max_states = states;
+    }
+    double dedup = nowSeconds() - start;
+
+    int mismatches = 0;
+    for (int i = 0; i < instances; i++)
+        mismatches += memcmp(getDedupInstance(batch, i), &machines[i], sizeof(Chip8)) != 0;
+    DedupStats st;
+    getDedupStats(batch, &st);
+
+    printf("instances:  %d x %d frames, %d action%s, %s\n", instances, frames, actions,
+           actions == 1 ? "" : "s", episode > 0 ? "resets" : "no resets");
+    if (episode > 0)
+        printf("episodes:   about %d frames\n", episode);
+    printf("states:     %d at the end, %d-%d during the run\n", st.states, min_states, max_states);
+    printf("executed:   %llu of %llu frames (%.1f%%), %llu copies, %llu merges\n",
+           (unsigned long long)st.executed, (unsigned long long)st.instance_frames,
+           100.0 * st.executed / st.instance_frames, (unsigned long long)st.copies,
+           (unsigned long long)st.merges);
+    printf("time:       %.3f s alone, %.3f s deduplicated, %.2fx effective speedup\n", plain, dedup,
+           dedup > 0 ? plain / dedup : 0.0);
+    printf("verified:   %s\n", mismatches ? "MISMATCH" : "every instance matches stepping alone");
+    if (mismatches)
+        printf("            %d instances differ\n", mismatches);
+    destroyDedupBatch(batch);
+    free(initial);
+    free(machines);
+    free(keys);
+    return mismatches != 0;
+}
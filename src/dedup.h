@@ -0,0 +1,53 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+#include "chip8.h"
+
+// Deduplicated batch stepping. Instances refer to shared, reference
+// counted states rather than owning one each. A step groups the instances
+// by (state, input). Each group runs its frame once, and every instance
+// in it takes the result:
+//
+// - A state whose instances all press the same keys, and that nothing
+//   else holds, is stepped in place.
+// - When instances sharing a state press different keys, each extra group
+//   gets its own copy first (copy-on-write).
+// - Groups whose states have become identical, such as instances that
+//   were reset, or copies whose different inputs were ignored, are merged.
+//   Candidates are found by a hash of the first cache line, then confirmed
+//   by comparing whole states.
+//
+// Results are exactly those of stepping every instance on its own.
+
+typedef struct DedupBatch DedupBatch;
+
+typedef struct {
+    uint64_t steps;
+    uint64_t instance_frames; // Frames requested: instances x steps.
+    uint64_t executed;        // Frames actually run.
+    uint64_t copies;          // Copy-on-write splits.
+    uint64_t merges;          // Groups folded into an identical state.
+    int states;               // Distinct states now.
+} DedupStats;
+
+// Every instance starts as `initial`, which also serves as the reset state.
+// Returns NULL on bad arguments or out of memory.
+DedupBatch *createDedupBatch(int instances, const Chip8 *initial);
+void destroyDedupBatch(DedupBatch *batch);
+// Run one frame of every instance, with keys[i] held by instance i.
+// Returns 0, leaving every instance as it was, if a copy could not be made.
+int stepDedupBatch(DedupBatch *batch, const uint16_t *keys, int cycles);
+// Put an instance back to the initial state.
+void resetDedupInstance(DedupBatch *batch, int instance);
+// Read-only: the state may be shared with other instances.
+const Chip8 *getDedupInstance(const DedupBatch *batch, int instance);
+void getDedupStats(const DedupBatch *batch, DedupStats *stats);
+
+// Step a population with and without deduplication, check that they
+// match, and report the effective speedup. Each instance picks one of
+// `actions` key masks per frame and restarts after about `episode` frames
+// (0 = never).
+int runDedupBench(const char *rom_path, int instances, int frames, int actions, int episode);
+
+#endif
@@ -0,0 +1,410 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fairshare.h"
+#include "memo.h"
+
+#define FRAME_NS     (1000000000ull / 60)
+#define SPIN_WINDOW  4096 // Longest anchor span when looking for a spin.
+
+enum { INST_RUNNABLE, INST_THROTTLED, INST_SLEEPING, INST_HALTED };
+
+typedef struct FairInstance {
+    Chip8 chip8;
+    struct FairInstance *next; // Tenant run queue.
+    int tenant;
+    int state;
+    int wait_timer;      // Sleeping until the delay timer ticks.
+    int max_per_frame;
+    int ran_this_frame;  // Instructions since the last tick.
+    int woken;           // Became runnable and hasn't run since.
+    uint64_t woken_ns;
+} FairInstance;
+
+typedef struct {
+    char name[32];
+    int weight;
+    uint64_t vtime;
+    FairInstance *head, *tail; // Runnable machines, in turn order.
+    TenantStats stats;
+} FairTenant;
+
+struct FairScheduler {
+    FairTenant tenants[FAIR_MAX_TENANTS];
+    int ntenants;
+    FairInstance **instances;
+    int ninstances;
+    int quantum;
+    uint64_t vclock; // Virtual time of the last quantum handed out.
+};
+
+static uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void enqueue(FairScheduler *sched, FairInstance *in) {
+    FairTenant *t = &sched->tenants[in->tenant];
+    // A tenant that was idle rejoins at the current virtual time instead
+    // of spending credit it saved up while it had nothing to run.
+    if (!t->head && t->vtime < sched->vclock)
+        t->vtime = sched->vclock;
+    in->next = NULL;
+    if (t->tail)
+        t->tail->next = in;
+    else
+        t->head = in;
+    t->tail = in;
+    in->state = INST_RUNNABLE;
+}
+
+static FairInstance *dequeue(FairTenant *t) {
+    FairInstance *in = t->head;
+    t->head = in->next;
+    if (!t->head)
+        t->tail = NULL;
+    return in;
+}
+
+FairScheduler *createFairScheduler(int quantum) {
+    FairScheduler *sched = calloc(1, sizeof(FairScheduler));
+    if (sched)
+        sched->quantum = quantum > 0 ? quantum : 1000;
+    return sched;
+}
+
+void destroyFairScheduler(FairScheduler *sched) {
+    if (!sched)
+        return;
+    for (int i = 0; i < sched->ninstances; i++)
+        free(sched->instances[i]);
+    free(sched->instances);
+    free(sched);
+}
+
+int addTenant(FairScheduler *sched, const char *name, int weight) {
+    if (sched->ntenants == FAIR_MAX_TENANTS)
+        return -1;
+    FairTenant *t = &sched->tenants[sched->ntenants];
+    snprintf(t->name, sizeof(t->name), "%s", name);
+    t->weight = weight > 0 ? weight : 1;
+    t->vtime = sched->vclock;
+    return sched->ntenants++;
+}
+
+int addInstance(FairScheduler *sched, int tenant, const Chip8 *initial, int max_per_frame) {
+    if (tenant < 0 || tenant >= sched->ntenants)
+        return -1;
+    FairInstance **grown = realloc(sched->instances, (sched->ninstances + 1) * sizeof(FairInstance *));
+    if (!grown)
+        return -1;
+    sched->instances = grown;
+    FairInstance *in = allocChip8(sizeof(FairInstance));
+    if (!in)
+        return -1;
+    in->chip8 = *initial;
+    in->tenant = tenant;
+    in->max_per_frame = max_per_frame;
+    enqueue(sched, in);
+    sched->instances[sched->ninstances] = in;
+    return sched->ninstances++;
+}
+
+Chip8 *getInstance(FairScheduler *sched, int instance) {
+    return &sched->instances[instance]->chip8;
+}
+
+static void wake(FairScheduler *sched, FairInstance *in, uint64_t now) {
+    in->woken = 1;
+    in->woken_ns = now;
+    sched->tenants[in->tenant].stats.wakeups++;
+    enqueue(sched, in);
+}
+
+void setInstanceKeys(FairScheduler *sched, int instance, uint16_t mask) {
+    FairInstance *in = sched->instances[instance];
+    if (getKeyMask(&in->chip8) == mask)
+        return;
+    setKeyMask(&in->chip8, mask);
+    if (in->state == INST_SLEEPING)
+        wake(sched, in, nowNs());
+}
+
+// hashState of everything but the instruction counter.
+static uint64_t spinHash(Chip8 *chip8) {
+    uint64_t cycles = chip8->cycles;
+    chip8->cycles = 0;
+    uint64_t h = hashState(chip8);
+    chip8->cycles = cycles;
+    return h;
+}
+
+// Whether an instruction may write the stack, memory or display, which
+// the register snapshot below doesn't cover.
+static int writesColdState(uint16_t opcode) {
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            return opcode != 0x00EE;
+        case 0x2000:
+        case 0xD000:
+            return 1;
+        case 0xF000:
+            return (opcode & 0xFF) == 0x33 || (opcode & 0xFF) == 0x55;
+        default:
+            return 0;
+    }
+}
+
+// Run up to n instructions. Returns how many ran; *spinning is set when
+// the machine came back to a state it had already been in, so it would
+// repeat the same loop until something outside changes it.
+//
+// Spins are found Brent-style: the registers are snapshotted at an anchor
+// instruction, and the anchor moves forward at doubling intervals, so any
+// loop shorter than half of SPIN_WINDOW is caught. A return to the anchor
+// with the same registers is a spin if nothing since could have written
+// the stack, memory or display. Loops that do write (a flickering sprite)
+// need two returns with the same hash of the whole machine.
+static int runQuantum(Chip8 *chip8, int n, int *spinning) {
+    uint8_t anchor[offsetof(Chip8, cycles)];
+    uint16_t anchor_pc = chip8->pc;
+    int span = 2, since = 0, dirty = 0, hashed = 0;
+    uint64_t last_hash = 0;
+    memcpy(anchor, chip8, sizeof(anchor));
+    *spinning = 0;
+    for (int i = 0; i < n; i++) {
+        if (chip8->halted)
+            return i;
+        dirty |= writesColdState(fetchOpcode(chip8));
+        emulateCycle(chip8);
+        since++;
+        if (chip8->pc == anchor_pc && memcmp(anchor, chip8, sizeof(anchor)) == 0) {
+            if (!dirty) {
+                *spinning = 1;
+                return i + 1;
+            }
+            uint64_t h = spinHash(chip8);
+            if (hashed && h == last_hash) {
+                *spinning = 1;
+                return i + 1;
+            }
+            hashed = 1;
+            last_hash = h;
+            dirty = 0;
+        } else if (since == span && span < SPIN_WINDOW) {
+            memcpy(anchor, chip8, sizeof(anchor));
+            anchor_pc = chip8->pc;
+            span *= 2;
+            since = 0;
+            dirty = 0;
+            hashed = 0;
+        }
+    }
+    return n;
+}
+
+static FairTenant *pickTenant(FairScheduler *sched) {
+    FairTenant *best = NULL;
+    for (int t = 0; t < sched->ntenants; t++) {
+        FairTenant *tenant = &sched->tenants[t];
+        if (tenant->head && (!best || tenant->vtime < best->vtime))
+            best = tenant;
+    }
+    return best;
+}
+
+int runSchedulerUntil(FairScheduler *sched, uint64_t deadline_ns) {
+    int quanta = 0;
+    uint64_t now = nowNs();
+    while (now < deadline_ns) {
+        FairTenant *t = pickTenant(sched);
+        if (!t)
+            break;
+        FairInstance *in = dequeue(t);
+        if (in->woken) {
+            in->woken = 0;
+            uint64_t latency = now > in->woken_ns ? now - in->woken_ns : 0;
+            t->stats.wake_latency_ns += latency;
+            if (latency > t->stats.max_wake_latency_ns)
+                t->stats.max_wake_latency_ns = latency;
+        }
+        sched->vclock = t->vtime;
+
+        int n = sched->quantum;
+        if (in->max_per_frame && in->max_per_frame - in->ran_this_frame < n)
+            n = in->max_per_frame - in->ran_this_frame;
+        int spinning;
+        int ran = runQuantum(&in->chip8, n, &spinning);
+        uint64_t end = nowNs();
+
+        in->ran_this_frame += ran;
+        t->vtime += (end - now + 1) / t->weight;
+        t->stats.instructions += ran;
+        t->stats.cpu_ns += end - now;
+        t->stats.quanta++;
+        quanta++;
+        now = end;
+
+        if (in->chip8.halted) {
+            in->state = INST_HALTED;
+        } else if (spinning) {
+            // Only the delay timer is both counted down by ticks and
+            // readable, so nothing else about a tick can end a spin.
+            in->state = INST_SLEEPING;
+            in->wait_timer = in->chip8.delay_timer > 0;
+            t->stats.sleeps++;
+        } else if (in->max_per_frame && in->ran_this_frame >= in->max_per_frame) {
+            in->state = INST_THROTTLED;
+        } else {
+            enqueue(sched, in);
+        }
+    }
+    return quanta;
+}
+
+void tickScheduler(FairScheduler *sched) {
+    uint64_t now = nowNs();
+    for (int i = 0; i < sched->ninstances; i++) {
+        FairInstance *in = sched->instances[i];
+        if (in->state == INST_RUNNABLE && in->ran_this_frame == 0)
+            sched->tenants[in->tenant].stats.starved_frames++;
+        in->ran_this_frame = 0;
+        tickTimers(&in->chip8);
+        if (in->state == INST_THROTTLED)
+            enqueue(sched, in);
+        else if (in->state == INST_SLEEPING && in->wait_timer)
+            wake(sched, in, now);
+    }
+}
+
+void getTenantStats(const FairScheduler *sched, int tenant, TenantStats *stats) {
+    *stats = sched->tenants[tenant].stats;
+}
+
+static uint32_t xorshift(uint32_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+static int parseTenants(FairScheduler *sched, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("Failed to open tenant file");
+        return 0;
+    }
+    char line[1024];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        char name[32], rom[256];
+        int weight, instances = 1, max_per_frame = 0;
+        int fields = sscanf(line, "%31s %d %255s %d %d", name, &weight, rom, &instances, &max_per_frame);
+        if (fields <= 0)
+            continue;
+        if (fields < 3 || weight <= 0 || instances <= 0 || max_per_frame < 0) {
+            fprintf(stderr, "%s:%d: expected <name> <weight> <ROM file> [instances] [max instructions/frame]\n",
+                    path, lineno);
+            fclose(f);
+            return 0;
+        }
+        int tenant = addTenant(sched, name, weight);
+        if (tenant < 0) {
+            fprintf(stderr, "%s:%d: more than %d tenants\n", path, lineno, FAIR_MAX_TENANTS);
+            fclose(f);
+            return 0;
+        }
+        static Chip8 boot;
+        initializeChip8(&boot);
+        if (!loadROM(&boot, rom)) {
+            fclose(f);
+            return 0;
+        }
+        for (int i = 0; i < instances; i++) {
+            seedChip8(&boot, sched->ninstances + 1);
+            if (addInstance(sched, tenant, &boot, max_per_frame) < 0) {
+                fprintf(stderr, "Out of memory for instances\n");
+                fclose(f);
+                return 0;
+            }
+        }
+    }
+    fclose(f);
+    if (!sched->ntenants) {
+        fprintf(stderr, "%s: no tenants\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+int runFairShare(const char *tenants_path, double seconds, int quantum) {
+    FairScheduler *sched = createFairScheduler(quantum);
+    if (!sched || !parseTenants(sched, tenants_path)) {
+        destroyFairScheduler(sched);
+        return 1;
+    }
+
+    // Each machine sees a key go down or up about twice a second.
+    uint32_t input_seed = 0x2545F491;
+    uint64_t start = nowNs(), busy = 0, frames = 0, overruns = 0;
+    uint64_t total_frames = (uint64_t)(seconds * 60);
+    for (uint64_t frame = 0; frame < total_frames; frame++) {
+        uint64_t deadline = start + (frame + 1) * FRAME_NS;
+        uint64_t before = nowNs();
+        runSchedulerUntil(sched, deadline);
+        uint64_t after = nowNs();
+        busy += after - before;
+        if (after > deadline + FRAME_NS / 10)
+            overruns++;
+        struct timespec ts = { (time_t)(deadline / 1000000000ull), (long)(deadline % 1000000000ull) };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+        for (int i = 0; i < sched->ninstances; i++) {
+            if (xorshift(&input_seed) % 30 == 0) {
+                uint16_t mask = getKeyMask(getInstance(sched, i)) ^ (1u << (xorshift(&input_seed) & 0xF));
+                setInstanceKeys(sched, i, mask);
+            }
+        }
+        tickScheduler(sched);
+        frames++;
+    }
+    double elapsed = (nowNs() - start) / 1e9;
+
+    uint64_t total_ns = 0;
+    int total_weight = 0;
+    for (int t = 0; t < sched->ntenants; t++) {
+        total_ns += sched->tenants[t].stats.cpu_ns;
+        if (sched->tenants[t].stats.quanta)
+            total_weight += sched->tenants[t].weight;
+    }
+    printf("fair share: %d tenants, %d machines, %llu frames in %.2f s, quantum %d\n",
+           sched->ntenants, sched->ninstances, (unsigned long long)frames, elapsed, sched->quantum);
+    printf("host:       %.1f%% busy, %llu frames overran\n", 100.0 * busy / (elapsed * 1e9),
+           (unsigned long long)overruns);
+    printf("%-12s %6s %8s %9s %9s %10s %9s %8s %8s %10s %10s %8s\n", "tenant", "weight", "entitled",
+           "cpu ms", "cpu share", "M instr", "quanta", "sleeps", "wakeups", "mean lat", "max lat",
+           "starved");
+    for (int t = 0; t < sched->ntenants; t++) {
+        FairTenant *tenant = &sched->tenants[t];
+        TenantStats *s = &tenant->stats;
+        double share = s->quanta && total_weight ? 100.0 * tenant->weight / total_weight : 0.0;
+        printf("%-12s %6d %7.1f%% %9.1f %8.1f%% %10.2f %9llu %8llu %8llu %8.2fms %8.2fms %8llu\n",
+               tenant->name, tenant->weight, share, s->cpu_ns / 1e6,
+               total_ns ? 100.0 * s->cpu_ns / total_ns : 0.0, s->instructions / 1e6,
+               (unsigned long long)s->quanta, (unsigned long long)s->sleeps,
+               (unsigned long long)s->wakeups,
+               s->wakeups ? s->wake_latency_ns / 1e6 / s->wakeups : 0.0,
+               s->max_wake_latency_ns / 1e6, (unsigned long long)s->starved_frames);
+    }
+    destroyFairScheduler(sched);
+    return 0;
+}
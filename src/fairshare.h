@@ -0,0 +1,62 @@
+#ifndef FAIRSHARE_H
+#define FAIRSHARE_H
+
+#include <stdint.h>
+#include "chip8.h"
+
+// Weighted fair-share scheduler for many tenants' machines on one thread.
+//
+// Machines are not paced by cycles per frame. Runnable machines get CPU in
+// quanta of `quantum` instructions. A quantum goes to the tenant with the
+// least virtual time (CPU time used / weight), so tenants share the CPU in
+// proportion to their weights however their ROMs behave. Within a
+// tenant, its machines take turns. A per-machine instruction budget per
+// frame can also cap how fast one machine runs.
+//
+// A machine that returns to exactly the same state (everything but the
+// instruction counter) is spinning: waiting on FX0A, polling the delay
+// timer, or parked in a `JP` to itself. It can't do anything else until an
+// event changes its state, so it is descheduled. It wakes at the next timer
+// tick if its delay timer is running, or when its keys change. Otherwise
+// it costs nothing.
+
+#define FAIR_MAX_TENANTS 64
+
+typedef struct FairScheduler FairScheduler;
+
+typedef struct {
+    uint64_t instructions;
+    uint64_t cpu_ns;        // Wall time inside this tenant's quanta.
+    uint64_t quanta;
+    uint64_t sleeps;        // Times a machine was descheduled as idle.
+    uint64_t wakeups;
+    uint64_t wake_latency_ns;     // Sum over wakeups: event to next run.
+    uint64_t max_wake_latency_ns;
+    uint64_t starved_frames;      // Runnable for a whole frame without running.
+} TenantStats;
+
+FairScheduler *createFairScheduler(int quantum);
+void destroyFairScheduler(FairScheduler *sched);
+// Returns the tenant index, or -1 when full.
+int addTenant(FairScheduler *sched, const char *name, int weight);
+// Adds a copy of `initial`. max_per_frame of 0 means no instruction budget
+// beyond the fair share. Returns the machine index, or -1.
+int addInstance(FairScheduler *sched, int tenant, const Chip8 *initial, int max_per_frame);
+Chip8 *getInstance(FairScheduler *sched, int instance);
+// An input event: a machine sleeping for input wakes when its keys change.
+void setInstanceKeys(FairScheduler *sched, int instance, uint16_t mask);
+// Hand out quanta until deadline_ns (CLOCK_MONOTONIC) or until nothing is
+// runnable. Returns how many quanta ran.
+int runSchedulerUntil(FairScheduler *sched, uint64_t deadline_ns);
+// The 60 Hz frame boundary: tick every machine's timers, wake machines
+// waiting on the delay timer and refill per-frame budgets.
+void tickScheduler(FairScheduler *sched);
+void getTenantStats(const FairScheduler *sched, int tenant, TenantStats *stats);
+
+// Host the machines described in a tenant file for `seconds` of real time
+// and report per-tenant CPU accounting. One line per tenant ('#' starts a
+// comment):
+//   <name> <weight> <ROM file> [instances] [max instructions/frame]
+int runFairShare(const char *tenants_path, double seconds, int quantum);
+
+#endif
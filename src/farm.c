@@ -0,0 +1,811 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "farm.h"
+#include "cache.h"
+#include "chip8.h"
+#include "kernels.h"
+#include "memo.h"
+#include "warmstart.h"
+
+#define FARM_PATH_MAX     256
+#define FARM_MAX_ATTEMPTS 3 // A job that takes down this many workers fails.
+#define FARM_SNAP_MAGIC   0x43464343u // "CCFC"
+#define FARM_SNAP_HEADER  32
+
+enum { JOB_PENDING, JOB_RUNNING, JOB_DONE, JOB_FAILED };
+
+static const char *state_names[] = { "pending", "running", "done", "failed" };
+
+enum { WARM_NONE, WARM_HIT, WARM_MISS, WARM_STALE };
+
+typedef struct {
+    char rom[FARM_PATH_MAX];
+    char input[FARM_PATH_MAX]; // Empty when no keys are pressed.
+    int frames;
+    int warm;                  // Frames of input prefix to warm-start.
+} FarmJob;
+
+typedef struct {
+    int state;
+    int attempts;
+    int worker;
+    int halted;
+    uint32_t frames_run;
+    uint64_t instructions;
+    uint32_t loaded_frames;        // Loaded from a snapshot or the warm-start cache.
+    uint64_t loaded_instructions;
+    int warm;                      // WARM_*.
+    uint64_t hash; // hashState of the final machine.
+    double seconds;
+} FarmResult;
+
+typedef struct {
+    pid_t pid;
+    int cpu;
+    int node;
+    int restarts;
+    int current;   // Job being run, or -1.
+    uint64_t jobs;
+    uint64_t frames;
+    double busy;   // CPU seconds spent running jobs.
+} FarmWorker;
+
+// A ring of job indices. The mutex is process-shared and robust, so a
+// worker dying while holding it doesn't wedge the farm.
+typedef struct {
+    pthread_mutex_t lock;
+    int head;
+    int count;
+    uint32_t checkpoint; // Raised by the coordinator to ask for snapshots.
+} FarmQueue;
+
+// A worker's copy of its machine for a checkpoint. Between frames, a
+// worker that sees a new checkpoint number copies its machine here and
+// then publishes the number; it doesn't touch the slot again until the
+// next one, so the coordinator can read it at leisure.
+typedef struct {
+    Chip8 chip8;
+    uint32_t checkpoint;
+    int job;
+    uint32_t frame; // Frames already run.
+} FarmSlot;
+
+// The queue, ring, results and worker table live in one shared mapping
+// created before forking; the job list is read-only and simply inherited.
+static struct {
+    FarmJob *jobs;
+    int njobs;
+    int nworkers;
+    FarmQueue *queue;
+    int *ring;
+    FarmResult *results;
+    FarmWorker *workers;
+    FarmSlot *slots;            // NULL without checkpoints.
+    const FarmCheckpoints *ckpt;
+    uint64_t jobs_hash;
+} farm;
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpuSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void lockQueue(void) {
+    // EOWNERDEAD: a worker died inside the lock. Queue updates are a few
+    // stores with no failure point, so the state is usable as is.
+    if (pthread_mutex_lock(&farm.queue->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&farm.queue->lock);
+}
+
+static void unlockQueue(void) {
+    pthread_mutex_unlock(&farm.queue->lock);
+}
+
+// Called with the queue locked.
+static void pushJob(int j) {
+    farm.ring[(farm.queue->head + farm.queue->count) % farm.njobs] = j;
+    farm.queue->count++;
+}
+
+static int parseJobs(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("Failed to open job file");
+        return 0;
+    }
+    char line[1024];
+    int cap = 0, lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        char rom[FARM_PATH_MAX], input[FARM_PATH_MAX] = "";
+        int frames, warm = 0;
+        int fields = sscanf(line, "%255s %d %255s %d", rom, &frames, input, &warm);
+        if (fields <= 0)
+            continue;
+        if (fields < 2 || frames <= 0 || warm < 0) {
+            fprintf(stderr, "%s:%d: expected <ROM file> <frames> [key file|-] [warm-start frames]\n",
+                    path, lineno);
+            fclose(f);
+            return 0;
+        }
+        if (farm.njobs == cap) {
+            cap = cap ? cap * 2 : 64;
+            farm.jobs = realloc(farm.jobs, cap * sizeof(FarmJob));
+        }
+        FarmJob *job = &farm.jobs[farm.njobs++];
+        memcpy(job->rom, rom, sizeof(rom));
+        strcpy(job->input, strcmp(input, "-") == 0 ? "" : input);
+        job->frames = frames;
+        job->warm = warm < frames ? warm : frames;
+    }
+    fclose(f);
+    return 1;
+}
+
+// Load a key file; returns the number of frames it covers.
+static int loadKeys(const char *path, uint16_t **keys) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return -1;
+    int cap = 0, n = 0;
+    uint8_t le[2];
+    *keys = NULL;
+    while (fread(le, 1, 2, f) == 2) {
+        if (n == cap) {
+            cap = cap ? cap * 2 : 1024;
+            *keys = realloc(*keys, cap * sizeof(uint16_t));
+        }
+        (*keys)[n++] = le[0] | le[1] << 8;
+    }
+    fclose(f);
+    return n;
+}
+
+static void snapshotPath(int j, char *out, size_t len) {
+    snprintf(out, len, "%s/job-%d.snap", farm.ckpt->dir, j);
+}
+
+// Continue job j from its snapshot, if there is one for this job file and
+// ROM. Returns the frames it had run, or 0.
+static int resumeJob(int j, Chip8 *chip8) {
+    static uint8_t buf[FARM_SNAP_HEADER + CHIP8_STATE_SIZE];
+    char path[FARM_PATH_MAX + 64];
+    snapshotPath(j, path, sizeof(path));
+    if (readCacheFile(path, buf, sizeof(buf)) != (long)sizeof(buf))
+        return 0;
+    uint32_t magic, job, frame;
+    uint64_t jobs_hash, program_hash;
+    memcpy(&magic, buf, 4);
+    memcpy(&job, buf + 4, 4);
+    memcpy(&frame, buf + 8, 4);
+    memcpy(&jobs_hash, buf + 16, 8);
+    memcpy(&program_hash, buf + 24, 8);
+    if (magic != FARM_SNAP_MAGIC || job != (uint32_t)j || jobs_hash != farm.jobs_hash ||
+        program_hash != hashProgram(chip8) || !loadState(chip8, buf + FARM_SNAP_HEADER, CHIP8_STATE_SIZE))
+        return 0;
+    return (int)frame;
+}
+
+static int runJob(int j, FarmResult *r, FarmSlot *slot) {
+    static Chip8 chip8;
+    const FarmJob *job = &farm.jobs[j];
+    uint16_t *keys = NULL;
+    int nkeys = 0;
+    if (job->input[0] && (nkeys = loadKeys(job->input, &keys)) < 0) {
+        fprintf(stderr, "farm: can't read key file %s\n", job->input);
+        return 0;
+    }
+    initializeChip8(&chip8);
+    seedChip8(&chip8, 0x2545F491);
+    if (!loadROM(&chip8, job->rom)) {
+        free(keys);
+        return 0;
+    }
+    int f = farm.ckpt && farm.ckpt->resume ? resumeJob(j, &chip8) : 0;
+    r->loaded_frames = f;
+    r->loaded_instructions = chip8.cycles;
+    r->warm = WARM_NONE;
+    if (f == 0 && job->warm > 0) {
+        WarmStartStats before, after;
+        int hit;
+        getWarmStartStats(&before);
+        f = warmStart(&chip8, job->warm, DEFAULT_CYCLES_PER_FRAME, keys, nkeys, &hit);
+        getWarmStartStats(&after);
+        r->warm = hit ? WARM_HIT : after.stale > before.stale ? WARM_STALE : WARM_MISS;
+        if (hit) {
+            r->loaded_frames = f;
+            r->loaded_instructions = chip8.cycles;
+        }
+    }
+    for (; f < job->frames && !chip8.halted; f++) {
+        if (slot) {
+            uint32_t checkpoint = __atomic_load_n(&farm.queue->checkpoint, __ATOMIC_ACQUIRE);
+            if (checkpoint != slot->checkpoint) {
+                slot->chip8 = chip8;
+                slot->job = j;
+                slot->frame = f;
+                __atomic_store_n(&slot->checkpoint, checkpoint, __ATOMIC_RELEASE);
+            }
+        }
+        setKeyMask(&chip8, f < nkeys ? keys[f] : 0);
+        runFrame(&chip8, DEFAULT_CYCLES_PER_FRAME);
+    }
+    r->frames_run = f;
+    r->instructions = chip8.cycles;
+    r->halted = chip8.halted;
+    r->hash = hashState(&chip8);
+    free(keys);
+    return 1;
+}
+
+static void workerMain(int w) {
+    FarmWorker *me = &farm.workers[w];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(me->cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+
+    for (;;) {
+        int j = -1;
+        lockQueue();
+        if (farm.queue->count > 0) {
+            j = farm.ring[farm.queue->head];
+            farm.queue->head = (farm.queue->head + 1) % farm.njobs;
+            farm.queue->count--;
+            farm.results[j].state = JOB_RUNNING;
+            farm.results[j].attempts++;
+            farm.results[j].worker = w;
+            me->current = j;
+        }
+        unlockQueue();
+        if (j < 0)
+            break;
+
+        FarmResult r = farm.results[j];
+        double start = nowSeconds(), cpu = cpuSeconds();
+        int ok = runJob(j, &r, farm.slots ? &farm.slots[w] : NULL);
+        r.seconds = nowSeconds() - start;
+        cpu = cpuSeconds() - cpu;
+        r.state = ok ? JOB_DONE : JOB_FAILED;
+
+        lockQueue();
+        farm.results[j] = r;
+        me->current = -1;
+        me->jobs++;
+        me->frames += r.frames_run - r.loaded_frames;
+        me->busy += cpu;
+        unlockQueue();
+    }
+    _exit(0);
+}
+
+static int spawnWorker(int w) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 0;
+    }
+    if (pid == 0)
+        workerMain(w);
+    farm.workers[w].pid = pid;
+    return 1;
+}
+
+// NUMA node of a CPU from sysfs, or -1 when the kernel doesn't say.
+static int cpuNode(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (!dir)
+        return -1;
+    int node = -1;
+    struct dirent *de;
+    while ((de = readdir(dir))) {
+        if (strncmp(de->d_name, "node", 4) == 0 && de->d_name[4] >= '0' && de->d_name[4] <= '9') {
+            node = atoi(de->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+// Assign CPUs from our affinity mask, taking one per NUMA node in turn so
+// small farms use every node's memory bandwidth. Pinned workers allocate
+// their machines after the fork, so first touch keeps them node-local.
+static void assignCpus(void) {
+    cpu_set_t allowed;
+    int cpus[CPU_SETSIZE], nodes[CPU_SETSIZE], used[CPU_SETSIZE];
+    int ncpus = 0, maxnode = 0;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+        CPU_SET(0, &allowed);
+    }
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (!CPU_ISSET(c, &allowed))
+            continue;
+        cpus[ncpus] = c;
+        nodes[ncpus] = cpuNode(c);
+        if (nodes[ncpus] > maxnode)
+            maxnode = nodes[ncpus];
+        used[ncpus++] = 0;
+    }
+    int order[CPU_SETSIZE], n = 0;
+    while (n < ncpus) {
+        for (int node = -1; node <= maxnode; node++) {
+            for (int i = 0; i < ncpus; i++) {
+                if (!used[i] && nodes[i] == node) {
+                    used[i] = 1;
+                    order[n++] = i;
+                    break;
+                }
+            }
+        }
+    }
+    for (int w = 0; w < farm.nworkers; w++) {
+        farm.workers[w].cpu = cpus[order[w % ncpus]];
+        farm.workers[w].node = nodes[order[w % ncpus]];
+    }
+}
+
+// ---- Checkpoints ----
+
+// Identifies the job list, so a checkpoint is only resumed by the sweep
+// that wrote it.
+static uint64_t hashJobs(void) {
+    uint64_t h = (uint64_t)farm.njobs;
+    for (int j = 0; j < farm.njobs; j++) {
+        const FarmJob *job = &farm.jobs[j];
+        for (const char *c = job->rom; *c; c++)
+            h = hashMix(h, (uint8_t)*c);
+        h = hashMix(h, '\n');
+        for (const char *c = job->input; *c; c++)
+            h = hashMix(h, (uint8_t)*c);
+        h = hashMix(h, (uint64_t)job->frames);
+    }
+    return h;
+}
+
+static void manifestPath(char *out, size_t len) {
+    snprintf(out, len, "%s/manifest", farm.ckpt->dir);
+}
+
+// The manifest lists finished jobs (done or failed) with their results:
+//   jobs <count> <job list hash>
+//   <job> <state> <attempts> <worker> <frames run> <instructions> <halted> <hash> <seconds>
+static int writeManifest(const FarmResult *results) {
+    size_t cap = 128 + (size_t)farm.njobs * 128, n = 0;
+    char *text = malloc(cap);
+    if (!text)
+        return 0;
+    n += snprintf(text, cap, "# cupid-8 farm checkpoint\njobs %d %016llx\n", farm.njobs,
+                  (unsigned long long)farm.jobs_hash);
+    for (int j = 0; j < farm.njobs; j++) {
+        const FarmResult *r = &results[j];
+        if (r->state != JOB_DONE && r->state != JOB_FAILED)
+            continue;
+        n += snprintf(text + n, cap - n, "%d %s %d %d %u %llu %d %016llx %.6f\n", j,
+                      state_names[r->state], r->attempts, r->worker, r->frames_run,
+                      (unsigned long long)r->instructions, r->halted,
+                      (unsigned long long)r->hash, r->seconds);
+    }
+    char path[FARM_PATH_MAX + 64];
+    manifestPath(path, sizeof(path));
+    int ok = writeCacheFile(path, text, n);
+    free(text);
+    return ok;
+}
+
+// Mark the jobs a manifest lists as finished. Returns 0 if it can't be
+// read or belongs to another job list.
+static int readManifest(void) {
+    char path[FARM_PATH_MAX + 64], line[512];
+    manifestPath(path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "farm: no checkpoint to resume in %s\n", farm.ckpt->dir);
+        return 0;
+    }
+    int njobs = -1, finished = 0;
+    unsigned long long jobs_hash = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#')
+            continue;
+        if (njobs < 0) {
+            if (sscanf(line, "jobs %d %llx", &njobs, &jobs_hash) != 2 || njobs != farm.njobs ||
+                jobs_hash != farm.jobs_hash) {
+                fprintf(stderr, "farm: the checkpoint in %s is for a different job file\n", farm.ckpt->dir);
+                fclose(f);
+                return 0;
+            }
+            continue;
+        }
+        FarmResult r = { 0 };
+        char state[16];
+        unsigned long long instructions, hash;
+        int j;
+        if (sscanf(line, "%d %15s %d %d %u %llu %d %llx %lf", &j, state, &r.attempts, &r.worker,
+                   &r.frames_run, &instructions, &r.halted, &hash, &r.seconds) != 9 ||
+            j < 0 || j >= farm.njobs)
+            continue;
+        r.state = strcmp(state, "done") == 0 ? JOB_DONE : JOB_FAILED;
+        r.instructions = instructions;
+        r.hash = hash;
+        farm.results[j] = r;
+        finished++;
+    }
+    fclose(f);
+    fprintf(stderr, "farm: resuming %s: %d of %d jobs already finished\n", farm.ckpt->dir, finished,
+            farm.njobs);
+    return 1;
+}
+
+// Drop snapshots left by an earlier sweep.
+static void clearSnapshots(void) {
+    DIR *dir = opendir(farm.ckpt->dir);
+    if (!dir)
+        return;
+    struct dirent *de;
+    char path[FARM_PATH_MAX + 300];
+    while ((de = readdir(dir))) {
+        if (strncmp(de->d_name, "job-", 4) == 0) {
+            snprintf(path, sizeof(path), "%s/%s", farm.ckpt->dir, de->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+}
+
+// The coordinator's checkpoint thread. Workers only copy their machine
+// into shared memory; the writing happens here.
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int stop;
+    FarmResult *results;  // Copy taken under the queue lock.
+    uint8_t *on_disk;     // Jobs with a snapshot file.
+    uint8_t *snap;        // Snapshot file buffer.
+    int written;
+    int snapshots;        // In-flight snapshots in the last checkpoint.
+    double slowest;       // Seconds, over all checkpoints.
+} ckpt;
+
+static void takeCheckpoint(void) {
+    double start = nowSeconds();
+    uint32_t number = __atomic_add_fetch(&farm.queue->checkpoint, 1, __ATOMIC_RELEASE);
+
+    // Running workers copy their machines at their next frame boundary.
+    // Don't wait long for one that's stuck or has died.
+    for (;;) {
+        int waiting = 0;
+        lockQueue();
+        for (int w = 0; w < farm.nworkers; w++)
+            waiting += farm.workers[w].current >= 0 &&
+                       __atomic_load_n(&farm.slots[w].checkpoint, __ATOMIC_ACQUIRE) != number;
+        unlockQueue();
+        if (!waiting || nowSeconds() - start > 1.0)
+            break;
+        struct timespec ms = { 0, 1000000 };
+        nanosleep(&ms, NULL);
+    }
+    lockQueue();
+    memcpy(ckpt.results, farm.results, farm.njobs * sizeof(FarmResult));
+    unlockQueue();
+
+    // Snapshots go first: a manifest never lists a job as unfinished
+    // without the newest snapshot of it already being in place.
+    char path[FARM_PATH_MAX + 64];
+    int snapshots = 0;
+    for (int w = 0; w < farm.nworkers; w++) {
+        FarmSlot *slot = &farm.slots[w];
+        if (__atomic_load_n(&slot->checkpoint, __ATOMIC_ACQUIRE) != number)
+            continue;
+        int j = slot->job, state = ckpt.results[j].state;
+        if (state == JOB_DONE || state == JOB_FAILED)
+            continue;
+        uint32_t magic = FARM_SNAP_MAGIC, job = (uint32_t)j, frame = slot->frame, pad = 0;
+        uint64_t program_hash = hashProgram(&slot->chip8);
+        memcpy(ckpt.snap, &magic, 4);
+        memcpy(ckpt.snap + 4, &job, 4);
+        memcpy(ckpt.snap + 8, &frame, 4);
+        memcpy(ckpt.snap + 12, &pad, 4);
+        memcpy(ckpt.snap + 16, &farm.jobs_hash, 8);
+        memcpy(ckpt.snap + 24, &program_hash, 8);
+        saveState(&slot->chip8, ckpt.snap + FARM_SNAP_HEADER, CHIP8_STATE_SIZE);
+        snapshotPath(j, path, sizeof(path));
+        if (writeCacheFile(path, ckpt.snap, FARM_SNAP_HEADER + CHIP8_STATE_SIZE)) {
+            ckpt.on_disk[j] = 1;
+            snapshots++;
+        }
+    }
+    if (!writeManifest(ckpt.results)) {
+        fprintf(stderr, "farm: can't write checkpoint manifest in %s\n", farm.ckpt->dir);
+        return;
+    }
+    for (int j = 0; j < farm.njobs; j++) {
+        int state = ckpt.results[j].state;
+        if (ckpt.on_disk[j] && (state == JOB_DONE || state == JOB_FAILED)) {
+            snapshotPath(j, path, sizeof(path));
+            unlink(path);
+            ckpt.on_disk[j] = 0;
+        }
+    }
+    ckpt.written++;
+    ckpt.snapshots = snapshots;
+    double took = nowSeconds() - start;
+    if (took > ckpt.slowest)
+        ckpt.slowest = took;
+}
+
+static void *checkpointMain(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&ckpt.lock);
+    while (!ckpt.stop) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        double interval = farm.ckpt->interval > 0 ? farm.ckpt->interval : 30.0;
+        until.tv_sec += (time_t)interval;
+        until.tv_nsec += (long)((interval - (time_t)interval) * 1e9);
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        if (pthread_cond_timedwait(&ckpt.wake, &ckpt.lock, &until) == ETIMEDOUT && !ckpt.stop) {
+            pthread_mutex_unlock(&ckpt.lock);
+            takeCheckpoint();
+            pthread_mutex_lock(&ckpt.lock);
+        }
+    }
+    pthread_mutex_unlock(&ckpt.lock);
+    return NULL;
+}
+
+// Set up the checkpoint directory, loading the manifest when resuming.
+static int startCheckpoints(void) {
+    farm.jobs_hash = hashJobs();
+    if (mkdir(farm.ckpt->dir, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "farm: can't create %s: %s\n", farm.ckpt->dir, strerror(errno));
+        return 0;
+    }
+    if (farm.ckpt->resume) {
+        if (!readManifest())
+            return 0;
+    } else {
+        clearSnapshots();
+    }
+    ckpt.results = malloc(farm.njobs * sizeof(FarmResult));
+    ckpt.on_disk = calloc(farm.njobs, 1);
+    ckpt.snap = malloc(FARM_SNAP_HEADER + CHIP8_STATE_SIZE);
+    if (!ckpt.results || !ckpt.on_disk || !ckpt.snap)
+        return 0;
+    // Unfinished jobs may have snapshots from the interrupted run.
+    for (int j = 0; j < farm.njobs; j++)
+        ckpt.on_disk[j] = farm.ckpt->resume && farm.results[j].state == JOB_PENDING;
+    pthread_mutex_init(&ckpt.lock, NULL);
+    pthread_cond_init(&ckpt.wake, NULL);
+    return 1;
+}
+
+static void writeResults(FILE *out) {
+    fprintf(out, "job,rom,frames,status,attempts,worker,frames_run,instructions,halted,hash,seconds\n");
+    for (int j = 0; j < farm.njobs; j++) {
+        const FarmResult *r = &farm.results[j];
+        fprintf(out, "%d,%s,%d,%s,%d,%d,%u,%llu,%d,%016llx,%.6f\n", j, farm.jobs[j].rom,
+                farm.jobs[j].frames, state_names[r->state], r->attempts, r->worker,
+                r->frames_run, (unsigned long long)r->instructions, r->halted,
+                (unsigned long long)r->hash, r->seconds);
+    }
+}
+
+int runFarm(const char *jobs_path, int workers, const char *results_path, const FarmCheckpoints *checkpoints) {
+    if (!parseJobs(jobs_path))
+        return 1;
+    if (farm.njobs == 0) {
+        fprintf(stderr, "No jobs in %s\n", jobs_path);
+        return 1;
+    }
+    if (workers <= 0)
+        workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers > farm.njobs)
+        workers = farm.njobs;
+    if (workers < 1)
+        workers = 1;
+    farm.nworkers = workers;
+
+    farm.ckpt = checkpoints && checkpoints->dir ? checkpoints : NULL;
+
+    // Checkpoint slots hold machines, so they come first, page aligned.
+    size_t slots_size = farm.ckpt ? workers * sizeof(FarmSlot) : 0;
+    size_t shared_size = slots_size + sizeof(FarmQueue) + farm.njobs * (sizeof(int) + sizeof(FarmResult)) +
+                         workers * sizeof(FarmWorker) + 64;
+    uint8_t *shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    farm.slots = farm.ckpt ? (FarmSlot *)shared : NULL;
+    farm.queue = (FarmQueue *)(shared + slots_size);
+    farm.results = (FarmResult *)((uint8_t *)farm.queue + ((sizeof(FarmQueue) + 7) & ~(size_t)7));
+    farm.workers = (FarmWorker *)(farm.results + farm.njobs);
+    farm.ring = (int *)(farm.workers + workers);
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&farm.queue->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    for (int j = 0; j < farm.njobs; j++)
+        farm.results[j].worker = -1;
+    if (farm.ckpt && !startCheckpoints()) {
+        pthread_mutex_destroy(&farm.queue->lock);
+        munmap(shared, shared_size);
+        free(farm.jobs);
+        return 1;
+    }
+    // Jobs a resumed sweep finished before count towards results but not
+    // towards this run's throughput.
+    uint8_t *carried = calloc(farm.njobs, 1);
+    int ncarried = 0;
+    for (int j = 0; j < farm.njobs; j++) {
+        if (farm.results[j].state == JOB_PENDING)
+            pushJob(j);
+        else if (carried)
+            ncarried += carried[j] = 1;
+    }
+    // Resumed sweeps may have fewer jobs left than workers.
+    if (farm.nworkers > farm.queue->count)
+        farm.nworkers = farm.queue->count;
+    for (int w = 0; w < workers; w++) {
+        farm.workers[w].current = -1;
+        if (farm.slots)
+            farm.slots[w].job = -1;
+    }
+    assignCpus();
+
+    double start = nowSeconds();
+    int live = 0;
+    for (int w = 0; w < farm.nworkers; w++)
+        live += spawnWorker(w);
+    if (farm.ckpt)
+        pthread_create(&ckpt.thread, NULL, checkpointMain, NULL);
+
+    while (live > 0) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        int w = 0;
+        while (w < farm.nworkers && farm.workers[w].pid != pid)
+            w++;
+        if (w == farm.nworkers)
+            continue;
+        live--;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+            continue;
+
+        // The worker crashed: requeue its job unless it keeps doing this.
+        lockQueue();
+        int j = farm.workers[w].current;
+        if (j >= 0 && farm.results[j].state == JOB_RUNNING) {
+            if (farm.results[j].attempts >= FARM_MAX_ATTEMPTS) {
+                farm.results[j].state = JOB_FAILED;
+            } else {
+                farm.results[j].state = JOB_PENDING;
+                pushJob(j);
+            }
+        }
+        farm.workers[w].current = -1;
+        int pending = farm.queue->count;
+        unlockQueue();
+        if (WIFSIGNALED(status))
+            fprintf(stderr, "farm: worker %d (pid %d) killed by signal %d", w, pid, WTERMSIG(status));
+        else
+            fprintf(stderr, "farm: worker %d (pid %d) exited with %d", w, pid, WEXITSTATUS(status));
+        if (j >= 0)
+            fprintf(stderr, " during job %d (%s)", j, state_names[farm.results[j].state]);
+        fprintf(stderr, "\n");
+        if (pending > 0) {
+            farm.workers[w].restarts++;
+            live += spawnWorker(w);
+        }
+    }
+    double elapsed = nowSeconds() - start;
+    if (farm.ckpt) {
+        pthread_mutex_lock(&ckpt.lock);
+        ckpt.stop = 1;
+        pthread_cond_signal(&ckpt.wake);
+        pthread_mutex_unlock(&ckpt.lock);
+        pthread_join(ckpt.thread, NULL);
+        takeCheckpoint();
+    }
+
+    FILE *out = stdout;
+    if (results_path && !(out = fopen(results_path, "w"))) {
+        perror("Failed to open results file");
+        out = stdout;
+    }
+    writeResults(out);
+    if (out != stdout)
+        fclose(out);
+
+    int done = 0, failed = 0, restarts = 0;
+    uint64_t frames = 0, instructions = 0;
+    for (int j = 0; j < farm.njobs; j++) {
+        done += farm.results[j].state == JOB_DONE;
+        failed += farm.results[j].state != JOB_DONE;
+        if (carried && carried[j])
+            continue;
+        frames += farm.results[j].frames_run - farm.results[j].loaded_frames;
+        instructions += farm.results[j].instructions - farm.results[j].loaded_instructions;
+    }
+    fprintf(stderr, "farm: %d jobs on %d workers in %.2f s: %d done, %d failed\n",
+            farm.njobs, farm.nworkers, elapsed, done, failed);
+    if (ncarried)
+        fprintf(stderr, "resumed: %d jobs were already finished\n", ncarried);
+    int warm[4] = { 0, 0, 0, 0 };
+    uint64_t warm_frames = 0;
+    for (int j = 0; j < farm.njobs; j++) {
+        if (carried && carried[j])
+            continue;
+        warm[farm.results[j].warm]++;
+        if (farm.results[j].warm == WARM_HIT)
+            warm_frames += farm.results[j].loaded_frames;
+    }
+    if (warm[WARM_HIT] + warm[WARM_MISS] + warm[WARM_STALE])
+        fprintf(stderr, "warm start: %d hits, %d misses (%d from another core version), %llu frames loaded\n",
+                warm[WARM_HIT], warm[WARM_MISS] + warm[WARM_STALE], warm[WARM_STALE],
+                (unsigned long long)warm_frames);
+    fprintf(stderr, "throughput: %.1f jobs/s, %.0f frames/s, %.1f M instructions/s\n",
+            (farm.njobs - ncarried) / elapsed, frames / elapsed, instructions / elapsed / 1e6);
+    if (farm.ckpt)
+        fprintf(stderr, "checkpoints: %d written to %s, slowest %.1f ms\n", ckpt.written,
+                farm.ckpt->dir, ckpt.slowest * 1e3);
+    fprintf(stderr, "%-7s %4s %5s %8s %8s %12s %8s %6s %9s\n",
+            "worker", "cpu", "node", "pid", "jobs", "frames", "cpu s", "util", "restarts");
+    for (int w = 0; w < farm.nworkers; w++) {
+        FarmWorker *fw = &farm.workers[w];
+        restarts += fw->restarts;
+        fprintf(stderr, "%-7d %4d %5d %8d %8llu %12llu %8.2f %5.1f%% %9d\n", w, fw->cpu, fw->node,
+                (int)fw->pid, (unsigned long long)fw->jobs, (unsigned long long)fw->frames,
+                fw->busy, elapsed > 0 ? 100.0 * fw->busy / elapsed : 0.0, fw->restarts);
+    }
+    if (restarts)
+        fprintf(stderr, "%d worker restarts\n", restarts);
+
+    pthread_mutex_destroy(&farm.queue->lock);
+    munmap(shared, shared_size);
+    free(farm.jobs);
+    free(ckpt.results);
+    free(ckpt.on_disk);
+    free(ckpt.snap);
+    free(carried);
+    return failed ? 1 : 0;
+}
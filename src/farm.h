@@ -0,0 +1,38 @@
+#ifndef FARM_H
+#define FARM_H
+
+// Multi-process evaluation farm. A coordinator forks worker processes, each
+// pinned to one CPU (spread across NUMA nodes), that take jobs from a queue
+// in shared memory and write results into a shared table. A crashing worker
+// loses only the job it was running: completed results stay in the table,
+// the job is requeued and the worker is restarted.
+//
+// Job file, one job per line ('#' starts a comment):
+//   <ROM file> <frames> [key file|-] [warm-start frames]
+// A key file holds one little-endian u16 key mask per frame, as written by
+// --input-fuzz; frames past its end run with no keys held. With warm-start
+// frames, that many leading frames come from the warm-start cache when an
+// earlier job ran the same ROM with the same keys (see warmstart.h).
+//
+// Results are written as CSV, one row per job, to results_path (or stdout
+// when it is NULL), followed by throughput and per-worker utilization on
+// stderr.
+//
+// With checkpoints, a thread in the coordinator writes `dir/manifest`
+// every `interval` seconds, listing the finished jobs and their results,
+// and a snapshot of each running job's machine (`dir/job-<n>.snap`).
+// Workers only copy their machine into shared memory between frames;
+// all file writing is done by the coordinator. Files are replaced
+// atomically. A resumed sweep skips the finished jobs and continues
+// running ones from their snapshots. Jobs are deterministic, so the
+// results match an uninterrupted sweep.
+typedef struct {
+    const char *dir;
+    double interval; // Seconds; <= 0 means 30.
+    int resume;
+} FarmCheckpoints;
+
+// checkpoints may be NULL.
+int runFarm(const char *jobs_path, int workers, const char *results_path, const FarmCheckpoints *checkpoints);
+
+#endif
@@ -0,0 +1,340 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "framestack.h"
+
+struct FrameStack {
+    int instances, depth, width, height, flags;
+    size_t row_bytes, frame_bytes, instance_stride;
+    int head;      // Slot the next frame goes to, below depth.
+    uint8_t *data; // Per instance: 2 x depth slots.
+    uint8_t *last; // Per instance: the previous raw frame, for max-pooling.
+};
+
+FrameStack *createFrameStack(int instances, int depth, int width, int height, int flags) {
+    if (instances <= 0 || depth <= 0 ||
+        !((width == 64 && height == 32) || (width == MAX_WIDTH && height == MAX_HEIGHT)))
+        return NULL;
+    FrameStack *s = calloc(1, sizeof(FrameStack));
+    if (!s)
+        return NULL;
+    s->instances = instances;
+    s->depth = depth;
+    s->width = width;
+    s->height = height;
+    s->flags = flags;
+    s->row_bytes = width / 8;
+    s->frame_bytes = s->row_bytes * height;
+    s->instance_stride = 2 * depth * s->frame_bytes;
+    s->data = allocChip8(instances * s->instance_stride);
+    if (flags & FRAMESTACK_MAX_POOL)
+        s->last = allocChip8(instances * s->frame_bytes);
+    if (!s->data || ((flags & FRAMESTACK_MAX_POOL) && !s->last)) {
+        destroyFrameStack(s);
+        return NULL;
+    }
+    return s;
+}
+
+void destroyFrameStack(FrameStack *s) {
+    if (!s)
+        return;
+    free(s->data);
+    free(s->last);
+    free(s);
+}
+
+// Display bytes are 0 or 1. The multiply gathers eight of them into one
+// byte, the first pixel in the top bit.
+static void packFrame(const uint8_t *display, uint8_t *out, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        const uint8_t *row = display + y * MAX_WIDTH;
+        for (int x = 0; x < width; x += 8) {
+            uint64_t w;
+            memcpy(&w, row + x, sizeof(w));
+            *out++ = (uint8_t)((w * 0x8040201008040201ull) >> 56);
+        }
+    }
+}
+
+void storeFrame(FrameStack *s, int instance, const Chip8 *chip8) {
+    uint8_t *ring = s->data + instance * s->instance_stride;
+    uint8_t *slot = ring + s->head * s->frame_bytes;
+    if (s->flags & FRAMESTACK_MAX_POOL) {
+        uint8_t *last = s->last + instance * s->frame_bytes;
+        uint8_t now[MAX_WIDTH / 8 * MAX_HEIGHT];
+        packFrame(chip8->display, now, s->width, s->height);
+        for (size_t i = 0; i < s->frame_bytes; i++)
+            slot[i] = now[i] | last[i];
+        memcpy(last, now, s->frame_bytes);
+    } else {
+        packFrame(chip8->display, slot, s->width, s->height);
+    }
+    memcpy(slot + s->depth * s->frame_bytes, slot, s->frame_bytes);
+}
+
+void advanceFrameStack(FrameStack *s) {
+    s->head = (s->head + 1) % s->depth;
+}
+
+void pushFrames(FrameStack *s, const Chip8 *machines) {
+    for (int i = 0; i < s->instances; i++)
+        storeFrame(s, i, &machines[i]);
+    advanceFrameStack(s);
+}
+
+void clearFrameStack(FrameStack *s, int instance) {
+    memset(s->data + instance * s->instance_stride, 0, s->instance_stride);
+    if (s->last)
+        memset(s->last + instance * s->frame_bytes, 0, s->frame_bytes);
+}
+
+FrameView getFrameView(const FrameStack *s, int k) {
+    if (k <= 0 || k > s->depth)
+        k = s->depth;
+    // The newest frame is in slot head - 1 and its copy head + depth - 1.
+    FrameView v = {
+        .data = s->data + (size_t)(s->head + s->depth - k) * s->frame_bytes,
+        .instances = s->instances,
+        .frames = k,
+        .width = s->width,
+        .height = s->height,
+        .instance_stride = s->instance_stride,
+        .frame_stride = s->frame_bytes,
+        .row_stride = s->row_bytes,
+    };
+    return v;
+}
+
+void regionSize(const FrameRegion *r, int *out_width, int *out_height) {
+    int f = r->factor > 0 ? r->factor : 1;
+    *out_width = (r->width + f - 1) / f;
+    *out_height = (r->height + f - 1) / f;
+}
+
+// A packed row as two words, pixel 0 in the top bit of the first.
+static void loadRow(const uint8_t *p, size_t bytes, uint64_t row[2]) {
+    uint64_t w[2] = { 0, 0 };
+    memcpy(w, p, bytes);
+    row[0] |= __builtin_bswap64(w[0]);
+    row[1] |= __builtin_bswap64(w[1]);
+}
+
+int sampleFrames(const FrameView *v, int instance, const FrameRegion *r, uint8_t *out) {
+    int f = r->factor > 0 ? r->factor : 1;
+    if (r->x < 0 || r->y < 0 || r->width <= 0 || r->height <= 0 || f > 64 ||
+        r->x + r->width > v->width || r->y + r->height > v->height)
+        return 0;
+    int out_w, out_h;
+    regionSize(r, &out_w, &out_h);
+    const uint8_t *frames = v->data + instance * v->instance_stride;
+    int y_end = r->y + r->height;
+    for (int i = 0; i < v->frames; i++) {
+        const uint8_t *frame = frames + i * v->frame_stride;
+        for (int y0 = r->y; y0 < y_end; y0 += f) {
+            // OR the block's rows together, align the crop to the top
+            // bit, then take f bits per output pixel.
+            uint64_t row[2] = { 0, 0 };
+            for (int y = y0; y < y0 + f && y < y_end; y++)
+                loadRow(frame + y * v->row_stride, v->row_stride, row);
+            uint64_t hi = row[0], lo = row[1];
+            if (r->x >= 64) {
+                hi = lo << (r->x - 64);
+                lo = 0;
+            } else if (r->x > 0) {
+                hi = hi << r->x | lo >> (64 - r->x);
+                lo <<= r->x;
+            }
+            // Clear pixels right of the crop.
+            if (r->width <= 64) {
+                hi &= ~0ull << (64 - r->width);
+                lo = 0;
+            } else if (r->width < 128) {
+                lo &= ~0ull << (128 - r->width);
+            }
+            if ((f & (f - 1)) == 0) {
+                // Power of two: blocks never straddle the words, so fold
+                // each block into its first bit and read those.
+                int per_word = 64 / f, left = out_w;
+                for (int w = 0; w < 2 && left > 0; w++) {
+                    uint64_t m = w ? lo : hi;
+                    for (int shift = 1; shift < f; shift <<= 1)
+                        m |= m << shift;
+                    int count = left < per_word ? left : per_word;
+                    for (int ox = 0; ox < count; ox++)
+                        *out++ = (uint8_t)(m >> (63 - ox * f) & 1);
+                    left -= count;
+                }
+                continue;
+            }
+            for (int ox = 0; ox < out_w; ox++) {
+                *out++ = (hi >> (64 - f)) != 0;
+                hi = hi << f | lo >> (64 - f);
+                lo <<= f;
+            }
+        }
+    }
+    return 1;
+}
+
+// ---- Benchmark ----
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Does frame i of the view match raw display frames a (and b, if pooled)?
+static int frameMatches(const FrameView *v, int instance, int i, const uint8_t *a, const uint8_t *b,
+                        uint8_t *scratch) {
+    FrameView one = *v;
+    one.data += i * v->frame_stride;
+    one.frames = 1;
+    FrameRegion full = { 0, 0, v->width, v->height, 1 };
+    sampleFrames(&one, instance, &full, scratch);
+    for (int y = 0; y < v->height; y++) {
+        for (int x = 0; x < v->width; x++) {
+            int lit = a[y * MAX_WIDTH + x] | (b ? b[y * MAX_WIDTH + x] : 0);
+            if (scratch[y * v->width + x] != lit)
+                return 0;
+        }
+    }
+    return 1;
+}
+
+int runFrameStackBench(const char *rom_path, int instances, int frames, int depth) {
+    if (instances <= 0)
+        instances = 1024;
+    if (frames <= 0)
+        frames = 300;
+    if (depth <= 0)
+        depth = 4;
+    const size_t raw = MAX_WIDTH * MAX_HEIGHT;
+    Chip8 *machines = allocChip8((size_t)instances * sizeof(Chip8));
+    uint8_t *history = malloc((size_t)instances * (depth + 1) * raw); // Raw ring, one spare.
+    uint8_t *batch = malloc((size_t)depth * raw);                     // One observation.
+    uint8_t *scratch = malloc((size_t)depth * raw);
+    if (!machines || !history || !batch || !scratch) {
+        fprintf(stderr, "Out of memory for %d instances\n", instances);
+        free(machines);
+        free(history);
+        free(batch);
+        free(scratch);
+        return 1;
+    }
+    initializeChip8(&machines[0]);
+    seedChip8(&machines[0], 0x2545F491);
+    if (!loadROM(&machines[0], rom_path)) {
+        free(machines);
+        free(history);
+        free(batch);
+        free(scratch);
+        return 1;
+    }
+    for (int i = 1; i < instances; i++) {
+        machines[i] = machines[0];
+        seedChip8(&machines[i], 0x2545F491 + i);
+    }
+    int width = machines[0].extended_mode ? MAX_WIDTH : 64, height = width == MAX_WIDTH ? MAX_HEIGHT : 32;
+    FrameStack *plain = createFrameStack(instances, depth, MAX_WIDTH, MAX_HEIGHT, 0);
+    FrameStack *pooled = createFrameStack(instances, depth, MAX_WIDTH, MAX_HEIGHT, FRAMESTACK_MAX_POOL);
+    FrameStack *small = createFrameStack(instances, depth, width, height, 0);
+    if (!plain || !pooled || !small) {
+        fprintf(stderr, "Out of memory for %d instances\n", instances);
+        destroyFrameStack(plain);
+        destroyFrameStack(pooled);
+        destroyFrameStack(small);
+        free(machines);
+        free(history);
+        free(batch);
+        free(scratch);
+        return 1;
+    }
+    memset(history, 0, (size_t)instances * (depth + 1) * raw);
+
+    double t_step = 0, t_copy = 0, t_pack = 0, t_pool = 0, t_small = 0, t_sample = 0;
+    uint64_t checksum = 0;
+    int mismatches = 0;
+    FrameRegion half = { 0, 0, MAX_WIDTH, MAX_HEIGHT, 2 };
+    for (int f = 0; f < frames; f++) {
+        double t0 = nowSeconds();
+        for (int i = 0; i < instances; i++) {
+            setKeyMask(&machines[i], (uint16_t)(1u << ((f / 8 + i) & 15)));
+            runFrame(&machines[i], DEFAULT_CYCLES_PER_FRAME);
+        }
+        double t1 = nowSeconds();
+        // The copying pipeline: keep raw frames, then gather the last K.
+        int slot = f % (depth + 1);
+        for (int i = 0; i < instances; i++) {
+            uint8_t *ring = history + (size_t)i * (depth + 1) * raw;
+            memcpy(ring + slot * raw, machines[i].display, raw);
+            for (int k = 0; k < depth; k++)
+                memcpy(batch + k * raw, ring + ((slot + 1 + k + 1) % (depth + 1)) * raw, raw);
+            checksum += batch[(i * 131) % (depth * raw)];
+        }
+        double t2 = nowSeconds();
+        pushFrames(plain, machines);
+        FrameView view = getFrameView(plain, depth);
+        checksum += view.data[(f * 7) % view.frame_stride];
+        double t3 = nowSeconds();
+        pushFrames(pooled, machines);
+        double t4 = nowSeconds();
+        pushFrames(small, machines);
+        double t5 = nowSeconds();
+        for (int i = 0; i < instances; i++) {
+            sampleFrames(&view, i, &half, scratch);
+            checksum += scratch[i % 64];
+        }
+        double t6 = nowSeconds();
+        t_step += t1 - t0;
+        t_copy += t2 - t1;
+        t_pack += t3 - t2;
+        t_pool += t4 - t3;
+        t_small += t5 - t4;
+        t_sample += t6 - t5;
+
+        // Check a few instances against the raw frames every so often.
+        if (f % 16 == 15 || f == frames - 1) {
+            FrameView pv = getFrameView(pooled, depth);
+            for (int i = 0; i < instances; i += instances / 8 + 1) {
+                const uint8_t *ring = history + (size_t)i * (depth + 1) * raw;
+                for (int k = 0; k < depth && k <= f; k++) {
+                    int fi = f - (depth - 1 - k);
+                    if (fi < 0)
+                        continue;
+                    const uint8_t *now = ring + (fi % (depth + 1)) * raw;
+                    const uint8_t *prev = fi > 0 ? ring + ((fi - 1) % (depth + 1)) * raw : NULL;
+                    mismatches += !frameMatches(&view, i, k, now, NULL, scratch);
+                    mismatches += !frameMatches(&pv, i, k, now, prev, scratch);
+                }
+            }
+        }
+    }
+
+    double n = (double)instances * frames;
+    FrameView sv = getFrameView(small, depth);
+    printf("instances:  %d x %d frames, stacks of %d\n", instances, frames, depth);
+    printf("emulation:  %7.0f ns per instance-frame\n", t_step / n * 1e9);
+    printf("raw copy:   %7.0f ns  (%zu bytes per observation, copied)\n", t_copy / n * 1e9,
+           depth * raw);
+    printf("packed:     %7.0f ns  (%zu bytes per observation, viewed in place)\n", t_pack / n * 1e9,
+           depth * (size_t)getFrameView(plain, depth).frame_stride);
+    printf("max-pooled: %7.0f ns\n", t_pool / n * 1e9);
+    printf("%dx%d:      %7.0f ns  (%zu bytes per observation)\n", width, height, t_small / n * 1e9,
+           depth * sv.frame_stride);
+    printf("half size:  %7.0f ns  to write %d 64x32 frames as bytes\n", t_sample / n * 1e9, depth);
+    printf("speedup:    %.1fx packing and viewing over copying\n", t_pack > 0 ? t_copy / t_pack : 0.0);
+    printf("verified:   %s (checksum %llu)\n", mismatches ? "MISMATCH" : "views match the displays",
+           (unsigned long long)checksum);
+    destroyFrameStack(plain);
+    destroyFrameStack(pooled);
+    destroyFrameStack(small);
+    free(machines);
+    free(history);
+    free(batch);
+    free(scratch);
+    return mismatches != 0;
+}
@@ -0,0 +1,74 @@
+#ifndef FRAMESTACK_H
+#define FRAMESTACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chip8.h"
+
+// Frame stacks for learning agents: the last K frames of every instance,
+// packed one bit per pixel (MSB first, so pixel x of a row is bit
+// 7 - x % 8 of byte x / 8). A 64x32 frame is 256 bytes and a 128x64 one
+// 1 KB, against 8 KB for the display itself.
+//
+// Each instance has a ring of 2 x depth slots, and every frame is written
+// twice, depth slots apart. The last `depth` frames are then always
+// contiguous, oldest first, so a view of them is a pointer and strides,
+// never a copy. All instances advance together, so one view covers the
+// whole batch.
+//
+// With FRAMESTACK_MAX_POOL each stored frame is the pixelwise max (OR) of
+// the display now and one frame earlier, which removes the flicker of
+// games that erase and redraw sprites with XOR on alternate frames.
+
+#define FRAMESTACK_MAX_POOL 1
+
+typedef struct FrameStack FrameStack;
+
+// Frames i of instance n start at
+// data + n * instance_stride + i * frame_stride, and row y of one at
+// y * row_stride, for 0 <= i < frames (0 is the oldest).
+typedef struct {
+    const uint8_t *data;
+    int instances;
+    int frames;
+    int width, height;      // Pixels.
+    size_t instance_stride; // Bytes.
+    size_t frame_stride;
+    size_t row_stride;
+} FrameView;
+
+// A region of the frame, shrunk by `factor` in each direction. An output
+// pixel is lit if any pixel in its factor x factor block is.
+typedef struct {
+    int x, y, width, height; // Crop, in source pixels.
+    int factor;              // 1 keeps full resolution.
+} FrameRegion;
+
+// width x height is 64x32 or 128x64: the top left of the display is kept.
+// flags: FRAMESTACK_MAX_POOL or 0. Returns NULL on bad arguments or
+// out of memory.
+FrameStack *createFrameStack(int instances, int depth, int width, int height, int flags);
+void destroyFrameStack(FrameStack *stack);
+// Store the current display of every instance. machines[n] is instance n.
+void pushFrames(FrameStack *stack, const Chip8 *machines);
+// Store one instance's display; call for every instance, then
+// advanceFrameStack. For machines that are not in one array.
+void storeFrame(FrameStack *stack, int instance, const Chip8 *chip8);
+void advanceFrameStack(FrameStack *stack);
+// Blank an instance's history, as after a reset.
+void clearFrameStack(FrameStack *stack, int instance);
+// The last k frames (k <= depth) of every instance. Valid until the next
+// push. Frames before the first push are blank.
+FrameView getFrameView(const FrameStack *stack, int k);
+
+// Output size of a region: frames x out_height x out_width bytes.
+void regionSize(const FrameRegion *region, int *out_width, int *out_height);
+// Write every frame of the view for one instance as 0/1 bytes, reading
+// the packed frames directly. Returns 0 if the region is outside the frame.
+int sampleFrames(const FrameView *view, int instance, const FrameRegion *region, uint8_t *out);
+
+// Compare packing into the stack against copying raw 8 KB frames, and
+// check the views against the displays.
+int runFrameStackBench(const char *rom_path, int instances, int frames, int depth);
+
+#endif
@@ -0,0 +1,155 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "chip8.h"
+
+// Robustness fuzz target for the core. An input is a key schedule followed
+// by ROM bytes:
+//
+//   bytes 0..15   eight 16-bit key masks, one applied per frame in rotation
+//   bytes 16..    ROM image loaded at 0x200 (truncated to fit)
+//
+// Each input runs for a bounded number of frames. Built with libFuzzer
+// (make fuzz) the sanitizers catch memory errors; built standalone
+// (make fuzz-standalone) main() replays files for AFL++ / reproducers or
+// generates random inputs and reports executions per second.
+
+#define FUZZ_KEY_BYTES  16
+#define FUZZ_FRAMES     100
+#define FUZZ_CYCLES     20 // Per frame, so at most 2000 cycles per input.
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "invariant violated: %s\n", what);
+        abort();
+    }
+}
+
+// Run one input; returns the number of cycles executed.
+static long runInput(const uint8_t *data, size_t size) {
+    static Chip8 chip8;
+    uint16_t schedule[FUZZ_KEY_BYTES / 2] = { 0 };
+    size_t key_bytes = size < FUZZ_KEY_BYTES ? size : FUZZ_KEY_BYTES;
+    memcpy(schedule, data, key_bytes);
+    data += key_bytes;
+    size -= key_bytes;
+    if (size > MEMORY_SIZE - START_ADDRESS)
+        size = MEMORY_SIZE - START_ADDRESS;
+
+    initializeChip8(&chip8);
+    seedChip8(&chip8, 0x2545F491);
+    loadROMData(&chip8, data, size);
+    long cycles = 0;
+    for (int frame = 0; frame < FUZZ_FRAMES && !chip8.halted; frame++) {
+        setKeyMask(&chip8, schedule[frame % (FUZZ_KEY_BYTES / 2)]);
+        for (int i = 0; i < FUZZ_CYCLES && !chip8.halted; i++) {
+            emulateCycle(&chip8);
+            cycles++;
+        }
+        tickTimers(&chip8);
+        check(chip8.sp < STACK_SIZE, "stack pointer in range");
+        check(chip8.screen_width <= MAX_WIDTH && chip8.screen_height <= MAX_HEIGHT,
+              "display size in range");
+    }
+
+    // Snapshots must round-trip whatever state the ROM left behind.
+    static uint8_t state[CHIP8_STATE_SIZE];
+    static Chip8 restored;
+    check(saveState(&chip8, state, sizeof(state)) == CHIP8_STATE_SIZE, "saveState");
+    check(loadState(&restored, state, sizeof(state)), "loadState");
+    check(memcmp(&restored, &chip8, sizeof(Chip8)) == 0, "snapshot round trip");
+    return cycles;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    runInput(data, size);
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t nextRandom(uint32_t *r) {
+    *r ^= *r << 13;
+    *r ^= *r >> 17;
+    *r ^= *r << 5;
+    return *r;
+}
+
+// Random inputs for a fixed time. Half the ROM words are drawn from the
+// opcode space that touches memory, the stack and keys so the hazards get
+// hit often; the rest are uniform.
+static int runRandom(double seconds) {
+    static const uint16_t hot[] = { 0x2000, 0x00EE, 0xF033, 0xF055, 0xF065,
+                                    0xD000, 0xE09E, 0xE0A1, 0xF01E, 0xA000 };
+    static uint8_t input[FUZZ_KEY_BYTES + MEMORY_SIZE - START_ADDRESS];
+    uint32_t rng = (uint32_t)time(NULL) | 1;
+    long execs = 0, cycles = 0;
+    double start = nowSeconds(), last = start, now = start;
+    while (now - start < seconds) {
+        size_t size = FUZZ_KEY_BYTES + 2 * (nextRandom(&rng) % ((sizeof(input) - FUZZ_KEY_BYTES) / 2));
+        for (size_t i = 0; i < size; i += 2) {
+            uint32_t r = nextRandom(&rng);
+            uint16_t word = (uint16_t)r;
+            if (i >= FUZZ_KEY_BYTES && (r >> 16) & 1) {
+                uint16_t op = hot[(r >> 17) % (sizeof(hot) / sizeof(hot[0]))];
+                if (op == 0x00EE)
+                    word = op;
+                else
+                    word = op | (op & 0x0FFF ? (word & 0x0F00) : (word & 0x0FFF));
+            }
+            input[i] = word >> 8;
+            input[i + 1] = word & 0xFF;
+        }
+        cycles += runInput(input, size);
+        execs++;
+        if ((execs & 1023) == 0) {
+            now = nowSeconds();
+            if (now - last >= 1.0) {
+                fprintf(stderr, "#%ld exec/s: %.0f cycles/s: %.0f\n", execs,
+                        execs / (now - start), cycles / (now - start));
+                last = now;
+            }
+        }
+    }
+    now = nowSeconds();
+    printf("executions:  %ld in %.2f s\n", execs, now - start);
+    printf("exec/s:      %.0f\n", execs / (now - start));
+    printf("cycles/s:    %.0f\n", cycles / (now - start));
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    double seconds = 10.0;
+    int first_file = 1;
+    if (argc > 2 && strcmp(argv[1], "-t") == 0) {
+        seconds = atof(argv[2]);
+        first_file = 3;
+    }
+    if (first_file >= argc)
+        return runRandom(seconds);
+
+    // Replay mode: each argument is an input file (AFL++ passes @@ here).
+    static uint8_t input[FUZZ_KEY_BYTES + MEMORY_SIZE];
+    for (int i = first_file; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            perror(argv[i]);
+            return 1;
+        }
+        size_t size = fread(input, 1, sizeof(input), f);
+        fclose(f);
+        long cycles = runInput(input, size);
+        printf("%s: %ld cycles\n", argv[i], cycles);
+    }
+    return 0;
+}
+
+#endif
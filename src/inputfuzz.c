@@ -0,0 +1,375 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "inputfuzz.h"
+
+// Coverage-guided exploration of a ROM by mutating key-mask sequences.
+//
+// Every corpus entry is a sequence of per-frame key masks played from boot
+// together with a snapshot of the machine at the end of it. Most mutations
+// extend an entry from its snapshot, so no prefix is ever re-emulated;
+// the rest rewrite part of an entry's sequence and replay it from boot.
+// Any run that lights up a guest address or edge bucket nobody has seen
+// becomes a new entry and is written to <out>/corpus/.
+
+#define MAX_SEQUENCE_FRAMES (60 * 120) // Two minutes of input.
+#define MIN_EXTENSION       10
+#define MAX_EXTENSION       120
+
+typedef struct {
+    uint16_t *keys; // One mask per frame, from boot.
+    int frames;
+    Chip8 state;    // The machine after playing `keys` from boot.
+} CorpusEntry;
+
+static struct {
+    pthread_mutex_t lock;
+    CorpusEntry **entries;
+    int count;
+    int cap;
+    uint8_t pcs[MEMORY_SIZE / 8];   // Union of every entry's coverage.
+    uint8_t edges[COVERAGE_EDGES];  // Bucket bits seen per edge.
+    long execs;
+    long frames;
+    Chip8 boot;
+    const char *outdir;
+} fuzz = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static volatile int fuzz_stop = 0;
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t nextRandom(uint32_t *r) {
+    *r ^= *r << 13;
+    *r ^= *r >> 17;
+    *r ^= *r << 5;
+    return *r;
+}
+
+// Collapse hit counts into one bit per magnitude class (1, 2, 3, 4-7, 8-15,
+// 16-31, 32-127, 128+) so loops that run a little longer don't look new.
+static uint8_t bucketBit(uint8_t count) {
+    if (count == 0) return 0;
+    if (count <= 3) return 1 << (count - 1);
+    if (count <= 7) return 8;
+    if (count <= 15) return 16;
+    if (count <= 31) return 32;
+    if (count <= 127) return 64;
+    return 128;
+}
+
+static void bucketize(Chip8Coverage *cov) {
+    uint64_t *words = (uint64_t *)cov->edges;
+    for (size_t w = 0; w < COVERAGE_EDGES / 8; w++) {
+        if (!words[w])
+            continue;
+        uint8_t *b = (uint8_t *)&words[w];
+        for (int i = 0; i < 8; i++)
+            b[i] = bucketBit(b[i]);
+    }
+}
+
+// Does a bucketized run cover anything `pcs`/`edges` don't? If `merge` is
+// set, fold it in as well.
+static int coverNew(uint8_t *pcs, uint8_t *edges, const Chip8Coverage *cov, int merge) {
+    int found = 0;
+    for (size_t i = 0; i < sizeof(cov->pcs); i++) {
+        if (cov->pcs[i] & ~pcs[i]) {
+            found = 1;
+            if (!merge)
+                return 1;
+            pcs[i] |= cov->pcs[i];
+        }
+    }
+    const uint64_t *run = (const uint64_t *)cov->edges;
+    uint64_t *seen = (uint64_t *)edges;
+    for (size_t w = 0; w < COVERAGE_EDGES / 8; w++) {
+        if (run[w] & ~seen[w]) {
+            found = 1;
+            if (!merge)
+                return 1;
+            seen[w] |= run[w];
+        }
+    }
+    return found;
+}
+
+static int countBits(const uint8_t *map, size_t len) {
+    int n = 0;
+    for (size_t i = 0; i < len; i++)
+        n += __builtin_popcount(map[i]);
+    return n;
+}
+
+static int countNonZero(const uint8_t *map, size_t len) {
+    int n = 0;
+    for (size_t i = 0; i < len; i++)
+        n += map[i] != 0;
+    return n;
+}
+
+static void writeEntry(int index, const CorpusEntry *e) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/corpus/%06d.keys", fuzz.outdir, index);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return;
+    }
+    // Little-endian uint16 per frame.
+    for (int i = 0; i < e->frames; i++) {
+        uint8_t le[2] = { e->keys[i] & 0xFF, e->keys[i] >> 8 };
+        fwrite(le, 1, 2, f);
+    }
+    fclose(f);
+}
+
+// Add an entry under the lock. Takes ownership of `keys`.
+static void addEntry(uint16_t *keys, int frames, const Chip8 *state) {
+    CorpusEntry *e = allocChip8(sizeof(CorpusEntry));
+    if (!e) {
+        free(keys);
+        return;
+    }
+    e->keys = keys;
+    e->frames = frames;
+    e->state = *state;
+    if (fuzz.count == fuzz.cap) {
+        int cap = fuzz.cap ? fuzz.cap * 2 : 256;
+        CorpusEntry **grown = realloc(fuzz.entries, cap * sizeof(CorpusEntry *));
+        if (!grown) {
+            free(keys);
+            free(e);
+            return;
+        }
+        fuzz.entries = grown;
+        fuzz.cap = cap;
+    }
+    fuzz.entries[fuzz.count] = e;
+    writeEntry(fuzz.count, e);
+    fuzz.count++;
+}
+
+// Next mask in a generated stretch of input: mostly hold, sometimes press,
+// toggle or release, the way a player would.
+static uint16_t mutateMask(uint16_t mask, uint32_t *rng) {
+    uint32_t r = nextRandom(rng);
+    if (r % 8)
+        return mask;
+    switch ((r >> 3) % 4) {
+        case 0: return 0;
+        case 1: return 1u << ((r >> 5) & 15);
+        case 2: return mask ^ (1u << ((r >> 5) & 15));
+        default: return (uint16_t)(r >> 9);
+    }
+}
+
+typedef struct {
+    uint32_t rng;
+    Chip8Coverage cov;
+    uint8_t pcs[MEMORY_SIZE / 8];  // This thread's possibly stale view of
+    uint8_t edges[COVERAGE_EDGES]; // the global maps.
+    uint16_t keys[MAX_SEQUENCE_FRAMES];
+    Chip8 chip8;
+} FuzzWorker;
+
+static void *fuzzWorkerMain(void *arg) {
+    FuzzWorker *w = arg;
+    long local_execs = 0, local_frames = 0;
+    while (!fuzz_stop) {
+        pthread_mutex_lock(&fuzz.lock);
+        const CorpusEntry *e = fuzz.entries[nextRandom(&w->rng) % fuzz.count];
+        pthread_mutex_unlock(&fuzz.lock);
+
+        memset(&w->cov, 0, sizeof(w->cov));
+        int frames = e->frames;
+        memcpy(w->keys, e->keys, frames * sizeof(uint16_t));
+        int ext = MIN_EXTENSION + nextRandom(&w->rng) % (MAX_EXTENSION - MIN_EXTENSION + 1);
+        if (frames + ext > MAX_SEQUENCE_FRAMES)
+            ext = MAX_SEQUENCE_FRAMES - frames;
+
+        int replay_from = frames;
+        if (frames > 0 && nextRandom(&w->rng) % 4 == 0) {
+            // Rewrite a stretch inside the sequence and replay from boot.
+            int at = nextRandom(&w->rng) % frames;
+            int len = 1 + nextRandom(&w->rng) % 60;
+            uint16_t mask = w->keys[at] ^ (1u << (nextRandom(&w->rng) & 15));
+            for (int i = at; i < at + len && i < frames; i++) {
+                w->keys[i] = mask;
+                mask = mutateMask(mask, &w->rng);
+            }
+            replay_from = 0;
+            w->chip8 = fuzz.boot;
+        } else {
+            w->chip8 = e->state;
+        }
+        uint16_t mask = frames ? w->keys[frames - 1] : 0;
+        for (int i = 0; i < ext; i++)
+            w->keys[frames + i] = mask = mutateMask(mask, &w->rng);
+        frames += ext;
+
+        for (int i = replay_from; i < frames; i++) {
+            setKeyMask(&w->chip8, w->keys[i]);
+            runFrameCovered(&w->chip8, DEFAULT_CYCLES_PER_FRAME, &w->cov);
+        }
+        local_frames += frames - replay_from;
+        local_execs++;
+
+        bucketize(&w->cov);
+        if (!coverNew(w->pcs, w->edges, &w->cov, 0))
+            continue;
+        pthread_mutex_lock(&fuzz.lock);
+        if (coverNew(fuzz.pcs, fuzz.edges, &w->cov, 1)) {
+            uint16_t *keys = malloc(frames * sizeof(uint16_t));
+            if (keys) {
+                memcpy(keys, w->keys, frames * sizeof(uint16_t));
+                addEntry(keys, frames, &w->chip8);
+            }
+        }
+        memcpy(w->pcs, fuzz.pcs, sizeof(w->pcs));
+        memcpy(w->edges, fuzz.edges, sizeof(w->edges));
+        fuzz.execs += local_execs;
+        fuzz.frames += local_frames;
+        pthread_mutex_unlock(&fuzz.lock);
+        local_execs = local_frames = 0;
+    }
+    pthread_mutex_lock(&fuzz.lock);
+    fuzz.execs += local_execs;
+    fuzz.frames += local_frames;
+    pthread_mutex_unlock(&fuzz.lock);
+    return NULL;
+}
+
+// A 2-byte word counts as run if either byte started an instruction
+// (jumps can land on odd addresses).
+static int wordRun(int a) {
+    return (fuzz.pcs[a >> 3] >> (a & 7) & 3) != 0;
+}
+
+// Print covered and never-executed address ranges within the ROM image.
+static void writeReport(const char *rom_path, size_t rom_size, double elapsed) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/coverage.txt", fuzz.outdir);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return;
+    }
+    int words = 0, covered_words = 0;
+    for (size_t a = START_ADDRESS; a < START_ADDRESS + rom_size; a += 2) {
+        words++;
+        covered_words += wordRun(a);
+    }
+    fprintf(f, "rom:              %s (%zu bytes)\n", rom_path, rom_size);
+    fprintf(f, "executions:       %ld (%.0f/s), %ld frames\n", fuzz.execs,
+            fuzz.execs / elapsed, fuzz.frames);
+    fprintf(f, "corpus entries:   %d\n", fuzz.count);
+    fprintf(f, "addresses run:    %d\n", countBits(fuzz.pcs, sizeof(fuzz.pcs)));
+    fprintf(f, "rom words run:    %d of %d (%.1f%%)\n", covered_words, words,
+            words ? 100.0 * covered_words / words : 0.0);
+    fprintf(f, "edges:            %d\n", countNonZero(fuzz.edges, sizeof(fuzz.edges)));
+
+    for (int pass = 1; pass >= 0; pass--) {
+        fprintf(f, "\n%s:\n", pass ? "executed" : "never executed (within the ROM)");
+        int start = -1;
+        for (int a = 0; a <= MEMORY_SIZE; a += 2) {
+            int run = a < MEMORY_SIZE && wordRun(a);
+            int in = pass ? run
+                          : !run && a >= START_ADDRESS && a < (int)(START_ADDRESS + rom_size);
+            if (in && start < 0)
+                start = a;
+            if (!in && start >= 0) {
+                fprintf(f, "  0x%03X-0x%03X\n", start, a - 1);
+                start = -1;
+            }
+        }
+    }
+    fclose(f);
+}
+
+int runInputFuzz(const char *rom_path, const char *outdir, int threads, double seconds) {
+    static uint8_t rom[MEMORY_SIZE];
+    FILE *rf = fopen(rom_path, "rb");
+    if (!rf) {
+        perror("Failed to open ROM");
+        return 1;
+    }
+    size_t rom_size = fread(rom, 1, sizeof(rom), rf);
+    fclose(rf);
+    initializeChip8(&fuzz.boot);
+    seedChip8(&fuzz.boot, 0x2545F491);
+    if (!loadROMData(&fuzz.boot, rom, rom_size)) {
+        fprintf(stderr, "ROM too large for memory\n");
+        return 1;
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/corpus", outdir);
+    if ((mkdir(outdir, 0755) < 0 && errno != EEXIST) ||
+        (mkdir(path, 0755) < 0 && errno != EEXIST)) {
+        perror(path);
+        return 1;
+    }
+    fuzz.outdir = outdir;
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+        threads = 1;
+
+    // Seed the corpus with the empty sequence: boot with no keys held.
+    FuzzWorker *workers = allocChip8(threads * sizeof(FuzzWorker));
+    if (!workers)
+        return 1;
+    Chip8Coverage *cov = &workers[0].cov;
+    Chip8 booted = fuzz.boot;
+    runFrameCovered(&booted, DEFAULT_CYCLES_PER_FRAME, cov);
+    bucketize(cov);
+    coverNew(fuzz.pcs, fuzz.edges, cov, 1);
+    uint16_t *seed = malloc(sizeof(uint16_t));
+    seed[0] = 0;
+    addEntry(seed, 1, &booted);
+
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    for (int i = 0; i < threads; i++) {
+        workers[i].rng = (uint32_t)time(NULL) * 2654435761u + i * 0x9E3779B9u + 1;
+        memcpy(workers[i].pcs, fuzz.pcs, sizeof(fuzz.pcs));
+        memcpy(workers[i].edges, fuzz.edges, sizeof(fuzz.edges));
+        pthread_create(&tids[i], NULL, fuzzWorkerMain, &workers[i]);
+    }
+    double start = nowSeconds();
+    while (nowSeconds() - start < seconds) {
+        sleep(1);
+        pthread_mutex_lock(&fuzz.lock);
+        fprintf(stderr, "execs: %ld  corpus: %d  addresses: %d  edges: %d\n", fuzz.execs,
+                fuzz.count, countBits(fuzz.pcs, sizeof(fuzz.pcs)),
+                countNonZero(fuzz.edges, sizeof(fuzz.edges)));
+        pthread_mutex_unlock(&fuzz.lock);
+    }
+    fuzz_stop = 1;
+    for (int i = 0; i < threads; i++)
+        pthread_join(tids[i], NULL);
+    double elapsed = nowSeconds() - start;
+
+    writeReport(rom_path, rom_size, elapsed);
+    printf("%d corpus entries, %d addresses, %ld execs (%.0f/s); report in %s/coverage.txt\n",
+           fuzz.count, countBits(fuzz.pcs, sizeof(fuzz.pcs)), fuzz.execs,
+           fuzz.execs / elapsed, outdir);
+    for (int i = 0; i < fuzz.count; i++) {
+        free(fuzz.entries[i]->keys);
+        free(fuzz.entries[i]);
+    }
+    free(fuzz.entries);
+    free(workers);
+    free(tids);
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef INPUTFUZZ_H
+#define INPUTFUZZ_H
+
+#include "chip8.h"
+
+// Coverage-guided key-sequence fuzzing of one ROM. Writes interesting
+// inputs to <outdir>/corpus/NNNNNN.keys (one little-endian uint16 key mask
+// per frame) and a coverage report to <outdir>/coverage.txt.
+int runInputFuzz(const char *rom_path, const char *outdir, int threads, double seconds);
+
+#endif
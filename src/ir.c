@@ -0,0 +1,659 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ir.h"
+
+static const char *op_names[IR_OPCODE_COUNT] = {
+    "nop", "const", "get", "set", "add", "sub", "or", "and", "xor", "shr", "shl",
+    "carry", "gt", "lsb", "msb", "eq", "ne", "add16", "font", "rand", "key",
+    "load", "loadk", "store", "storek", "draw", "drawk", "exec", "jump", "branch",
+};
+
+// Which operand fields hold temporaries.
+static int usesA(int op) {
+    switch (op) {
+        case IR_SET: case IR_ADD: case IR_SUB: case IR_OR: case IR_AND: case IR_XOR:
+        case IR_SHR: case IR_SHL: case IR_CARRY: case IR_GT: case IR_LSB: case IR_MSB:
+        case IR_EQ: case IR_NE: case IR_ADD16: case IR_FONT: case IR_KEY:
+        case IR_STORE: case IR_STOREK: case IR_DRAW: case IR_DRAWK: case IR_BRANCH:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int usesB(int op) {
+    switch (op) {
+        case IR_ADD: case IR_SUB: case IR_OR: case IR_AND: case IR_XOR: case IR_CARRY:
+        case IR_GT: case IR_EQ: case IR_NE: case IR_ADD16: case IR_DRAW: case IR_DRAWK:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Ops with no effect beyond their result, which can go when it is unused.
+static int isPure(int op) {
+    switch (op) {
+        case IR_CONST: case IR_GET: case IR_ADD: case IR_SUB: case IR_OR: case IR_AND:
+        case IR_XOR: case IR_SHR: case IR_SHL: case IR_CARRY: case IR_GT: case IR_LSB:
+        case IR_MSB: case IR_EQ: case IR_NE: case IR_ADD16: case IR_FONT: case IR_KEY:
+        case IR_LOAD: case IR_LOADK:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int isFoldable(int op) {
+    return op >= IR_ADD && op <= IR_FONT;
+}
+
+static uint16_t evalPure(int op, uint16_t a, uint16_t b) {
+    switch (op) {
+        case IR_ADD:   return (a + b) & 0xFF;
+        case IR_SUB:   return (a - b) & 0xFF;
+        case IR_OR:    return a | b;
+        case IR_AND:   return a & b;
+        case IR_XOR:   return a ^ b;
+        case IR_SHR:   return a >> 1;
+        case IR_SHL:   return (a << 1) & 0xFF;
+        case IR_CARRY: return a + b > 255;
+        case IR_GT:    return a > b;
+        case IR_LSB:   return a & 1;
+        case IR_MSB:   return (a & 0x80) >> 7;
+        case IR_EQ:    return a == b;
+        case IR_NE:    return a != b;
+        case IR_ADD16: return (a + b) & 0xFFFF;
+        case IR_FONT:  return (FONT_ADDRESS + a * 5) & 0xFFFF;
+        default:       return 0;
+    }
+}
+
+// ---- Translation ----
+
+static uint16_t emit(IrBlock *block, int op, int reg, uint16_t a, uint16_t b, uint16_t imm) {
+    IrOp *o = &block->ops[block->count];
+    o->op = op;
+    o->reg = reg;
+    o->dst = block->count;
+    o->a = a;
+    o->b = b;
+    o->imm = imm;
+    o->imm2 = 0;
+    return block->count++;
+}
+
+#define GET(r)          emit(block, IR_GET, (r), 0, 0, 0)
+#define SET(r, t)       emit(block, IR_SET, (r), (t), 0, 0)
+#define CONST(v)        emit(block, IR_CONST, 0, 0, 0, (v))
+#define ALU(op, a, b)   emit(block, (op), 0, (a), (b), 0)
+
+static void branch(IrBlock *block, uint16_t cond, uint16_t taken, uint16_t fallthrough) {
+    uint16_t t = emit(block, IR_BRANCH, 0, cond, 0, taken);
+    block->ops[t].imm2 = fallthrough;
+}
+
+// Lower one instruction. Returns 1 if it ends the block.
+static int lowerInstruction(IrBlock *block, uint16_t addr, uint16_t opcode) {
+    int x = (opcode >> 8) & 0xF, y = (opcode >> 4) & 0xF, n = opcode & 0xF;
+    uint8_t kk = opcode & 0xFF;
+    uint16_t nnn = opcode & 0xFFF;
+    uint16_t next = addr + 2, skip = addr + 4;
+
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            // Same decode order as emulateCycle: the SCHIP forms ignore X.
+            if ((opcode & 0xF0FF) == 0x00FD || opcode == 0x00EE) {
+                emit(block, IR_EXEC, 0, 0, 0, addr);
+                block->execs++;
+                return 1;
+            }
+            if ((opcode & 0xF0FF) >= 0x00FB || (opcode & 0x00F0) == 0x00C0 || opcode == 0x00E0) {
+                emit(block, IR_EXEC, 0, 0, 0, addr);
+                block->execs++;
+            }
+            return 0; // Anything else is a no-op.
+        case 0x1000:
+            emit(block, IR_JUMP, 0, 0, 0, nnn);
+            return 1;
+        case 0x2000:
+        case 0xB000:
+            emit(block, IR_EXEC, 0, 0, 0, addr);
+            block->execs++;
+            return 1;
+        case 0x3000:
+        case 0x4000: {
+            uint16_t c = ALU((opcode & 0xF000) == 0x3000 ? IR_EQ : IR_NE, GET(x), CONST(kk));
+            branch(block, c, skip, next);
+            return 1;
+        }
+        case 0x5000:
+        case 0x9000: {
+            uint16_t vx = GET(x);
+            uint16_t c = ALU((opcode & 0xF000) == 0x5000 ? IR_EQ : IR_NE, vx, GET(y));
+            branch(block, c, skip, next);
+            return 1;
+        }
+        case 0x6000:
+            SET(x, CONST(kk));
+            return 0;
+        case 0x7000: {
+            uint16_t vx = GET(x);
+            SET(x, ALU(IR_ADD, vx, CONST(kk)));
+            return 0;
+        }
+        case 0x8000: {
+            uint16_t vx, vy;
+            switch (n) {
+                case 0x0: SET(x, GET(y)); break;
+                case 0x1: vx = GET(x); SET(x, ALU(IR_OR, vx, GET(y))); break;
+                case 0x2: vx = GET(x); SET(x, ALU(IR_AND, vx, GET(y))); break;
+                case 0x3: vx = GET(x); SET(x, ALU(IR_XOR, vx, GET(y))); break;
+                case 0x4: {
+                    vx = GET(x);
+                    vy = GET(y);
+                    uint16_t sum = ALU(IR_ADD, vx, vy);
+                    SET(0xF, ALU(IR_CARRY, vx, vy));
+                    SET(x, sum);
+                    break;
+                }
+                // The rest write VF first and then re-read their operands,
+                // as the interpreter does.
+                case 0x5:
+                    vx = GET(x);
+                    SET(0xF, ALU(IR_GT, vx, GET(y)));
+                    vx = GET(x);
+                    SET(x, ALU(IR_SUB, vx, GET(y)));
+                    break;
+                case 0x6:
+                    SET(0xF, ALU(IR_LSB, GET(x), 0));
+                    SET(x, ALU(IR_SHR, GET(x), 0));
+                    break;
+                case 0x7:
+                    vy = GET(y);
+                    SET(0xF, ALU(IR_GT, vy, GET(x)));
+                    vy = GET(y);
+                    SET(x, ALU(IR_SUB, vy, GET(x)));
+                    break;
+                case 0xE:
+                    SET(0xF, ALU(IR_MSB, GET(x), 0));
+                    SET(x, ALU(IR_SHL, GET(x), 0));
+                    break;
+                default:
+                    break;
+            }
+            return 0;
+        }
+        case 0xA000:
+            SET(IR_REG_I, CONST(nnn));
+            return 0;
+        case 0xC000:
+            SET(x, emit(block, IR_RAND, 0, 0, 0, kk));
+            return 0;
+        case 0xD000: {
+            // With X or Y = F the interpreter re-reads the flag it is
+            // writing for every pixel; leave that to it.
+            if (x == 0xF || y == 0xF) {
+                emit(block, IR_EXEC, 0, 0, 0, addr);
+                block->execs++;
+                return 0;
+            }
+            SET(0xF, CONST(0));
+            uint16_t vx = GET(x);
+            uint16_t vy = GET(y);
+            SET(0xF, emit(block, IR_DRAW, n, vx, vy, 0));
+            return 0;
+        }
+        case 0xE000:
+            if (kk == 0x9E || kk == 0xA1) {
+                uint16_t held = emit(block, IR_KEY, 0, GET(x), 0, 0);
+                if (kk == 0x9E)
+                    branch(block, held, skip, next);
+                else
+                    branch(block, held, next, skip);
+                return 1;
+            }
+            return 0;
+        case 0xF000:
+            switch (kk) {
+                case 0x07: SET(x, GET(IR_REG_DT)); return 0;
+                case 0x15: SET(IR_REG_DT, GET(x)); return 0;
+                case 0x18: SET(IR_REG_ST, GET(x)); return 0;
+                case 0x1E: {
+                    uint16_t i = GET(IR_REG_I);
+                    SET(IR_REG_I, ALU(IR_ADD16, i, GET(x)));
+                    return 0;
+                }
+                case 0x29:
+                    SET(IR_REG_I, ALU(IR_FONT, GET(x), 0));
+                    return 0;
+                case 0x55:
+                    for (int i = 0; i <= x; i++)
+                        emit(block, IR_STORE, 0, GET(i), 0, i);
+                    // Stores may rewrite code, so the block ends here.
+                    emit(block, IR_JUMP, 0, 0, 0, next);
+                    return 1;
+                case 0x65:
+                    for (int i = 0; i <= x; i++)
+                        SET(i, emit(block, IR_LOAD, 0, 0, 0, i));
+                    return 0;
+                case 0x0A:
+                case 0x33:
+                    emit(block, IR_EXEC, 0, 0, 0, addr);
+                    block->execs++;
+                    return 1;
+                default:
+                    return 0;
+            }
+    }
+    return 0;
+}
+
+void translateBlock(const Chip8 *chip8, uint16_t pc, IrBlock *block) {
+    block->start = pc;
+    block->insns = 0;
+    block->execs = 0;
+    block->terminated = 0;
+    block->count = 0;
+    uint16_t addr = pc;
+    for (;;) {
+        uint16_t opcode = chip8->memory[addr & ADDRESS_MASK] << 8 |
+                          chip8->memory[(addr + 1) & ADDRESS_MASK];
+        block->insns++;
+        if (lowerInstruction(block, addr, opcode)) {
+            block->terminated = block->ops[block->count - 1].op == IR_EXEC;
+            return;
+        }
+        addr += 2;
+        // Worst case an instruction lowers to 33 ops (FX55/FX65).
+        if (block->insns == IR_MAX_INSNS || block->count > IR_MAX_OPS - 40) {
+            emit(block, IR_JUMP, 0, 0, 0, addr);
+            return;
+        }
+    }
+}
+
+// ---- Optimization ----
+
+static void propagateConstants(IrBlock *block, IrStats *stats) {
+    uint16_t map[IR_MAX_OPS], value[IR_MAX_OPS];
+    uint8_t known[IR_MAX_OPS];
+    int reg_temp[IR_REGS]; // Temporary holding each register's value, or -1.
+    for (int r = 0; r < IR_REGS; r++)
+        reg_temp[r] = -1;
+
+    for (int i = 0; i < block->count; i++) {
+        IrOp *o = &block->ops[i];
+        if (usesA(o->op))
+            o->a = map[o->a];
+        if (usesB(o->op))
+            o->b = map[o->b];
+        map[o->dst] = o->dst;
+        known[o->dst] = 0;
+
+        switch (o->op) {
+            case IR_CONST:
+                known[o->dst] = 1;
+                value[o->dst] = o->imm;
+                break;
+            case IR_GET:
+                if (reg_temp[o->reg] >= 0) {
+                    map[o->dst] = reg_temp[o->reg];
+                    o->op = IR_NOP;
+                    if (stats)
+                        stats->forwarded++;
+                } else {
+                    reg_temp[o->reg] = o->dst;
+                }
+                break;
+            case IR_SET:
+                reg_temp[o->reg] = o->a;
+                break;
+            case IR_BRANCH:
+                if (known[o->a]) {
+                    o->imm = value[o->a] ? o->imm : o->imm2;
+                    o->op = IR_JUMP;
+                    if (stats)
+                        stats->folded++;
+                }
+                break;
+            case IR_LOAD:
+            case IR_STORE:
+            case IR_DRAW: {
+                int i_temp = reg_temp[IR_REG_I];
+                if (i_temp >= 0 && known[i_temp]) {
+                    if (o->op == IR_DRAW) {
+                        o->op = IR_DRAWK;
+                        o->imm = value[i_temp];
+                        if (stats)
+                            stats->fused_draws++;
+                    } else {
+                        o->op = o->op == IR_LOAD ? IR_LOADK : IR_STOREK;
+                        o->imm = (value[i_temp] + o->imm) & 0xFFFF;
+                        if (stats)
+                            stats->fused_memory++;
+                    }
+                }
+                break;
+            }
+            case IR_EXEC:
+                for (int r = 0; r < IR_REGS; r++)
+                    reg_temp[r] = -1;
+                break;
+            default:
+                if (isFoldable(o->op) && known[o->a] && (!usesB(o->op) || known[o->b])) {
+                    value[o->dst] = evalPure(o->op, value[o->a], usesB(o->op) ? value[o->b] : 0);
+                    known[o->dst] = 1;
+                    o->op = IR_CONST;
+                    o->imm = value[o->dst];
+                    if (stats)
+                        stats->folded++;
+                }
+                break;
+        }
+    }
+}
+
+// Backward pass: a register write nobody reads before the next write to
+// the same register (or the end of the block, where all are live) goes.
+static void eliminateDeadSets(IrBlock *block, IrStats *stats) {
+    uint8_t live[IR_REGS];
+    memset(live, 1, sizeof(live));
+    for (int i = block->count - 1; i >= 0; i--) {
+        IrOp *o = &block->ops[i];
+        switch (o->op) {
+            case IR_SET:
+                if (!live[o->reg]) {
+                    o->op = IR_NOP;
+                    if (stats)
+                        stats->dead_sets++;
+                } else {
+                    live[o->reg] = 0;
+                }
+                break;
+            case IR_GET:
+                live[o->reg] = 1;
+                break;
+            case IR_LOAD:
+            case IR_STORE:
+            case IR_DRAW:
+                live[IR_REG_I] = 1;
+                break;
+            case IR_EXEC:
+                memset(live, 1, sizeof(live));
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Backward pass removing pure ops whose result is unused.
+static void eliminateDeadTemps(IrBlock *block) {
+    uint8_t used[IR_MAX_OPS] = {0};
+    for (int i = block->count - 1; i >= 0; i--) {
+        IrOp *o = &block->ops[i];
+        if (o->op == IR_NOP)
+            continue;
+        if (isPure(o->op) && !used[o->dst]) {
+            o->op = IR_NOP;
+            continue;
+        }
+        if (usesA(o->op))
+            used[o->a] = 1;
+        if (usesB(o->op))
+            used[o->b] = 1;
+    }
+}
+
+static int countVfWrites(const IrBlock *block) {
+    int n = 0;
+    for (int i = 0; i < block->count; i++)
+        n += block->ops[i].op == IR_SET && block->ops[i].reg == 0xF;
+    return n;
+}
+
+void optimizeBlock(IrBlock *block, IrStats *stats) {
+    if (stats) {
+        stats->blocks++;
+        stats->ops_before += block->count;
+        stats->vf_writes_before += countVfWrites(block);
+    }
+    propagateConstants(block, stats);
+    eliminateDeadSets(block, stats);
+    eliminateDeadTemps(block);
+    int n = 0;
+    for (int i = 0; i < block->count; i++)
+        if (block->ops[i].op != IR_NOP)
+            block->ops[n++] = block->ops[i];
+    block->count = n;
+    if (stats) {
+        stats->ops_after += block->count;
+        stats->vf_writes_after += countVfWrites(block);
+    }
+}
+
+// ---- Evaluation ----
+
+// DXYN for X, Y != F, where the coordinates can't change mid-sprite.
+static uint16_t drawSprite(Chip8 *chip8, uint8_t vx, uint8_t vy, int n, uint16_t addr) {
+    uint16_t collision = 0;
+    int wide = chip8->extended_mode && n == 0;
+    int rows = wide ? 16 : n, cols = wide ? 16 : 8;
+    for (int row = 0; row < rows; row++) {
+        uint16_t bits = wide
+            ? chip8->memory[(addr + row * 2) & ADDRESS_MASK] << 8 |
+              chip8->memory[(addr + row * 2 + 1) & ADDRESS_MASK]
+            : chip8->memory[(addr + row) & ADDRESS_MASK] << 8;
+        int posY = (vy + row) % chip8->screen_height;
+        for (int col = 0; col < cols; col++) {
+            if (!(bits & (0x8000 >> col)))
+                continue;
+            int idx = posY * MAX_WIDTH + (vx + col) % chip8->screen_width;
+            collision |= chip8->display[idx];
+            chip8->display[idx] ^= 1;
+        }
+    }
+    return collision;
+}
+
+void executeBlock(const IrBlock *block, Chip8 *chip8) {
+    uint16_t t[IR_MAX_OPS];
+    for (int i = 0; i < block->count; i++) {
+        const IrOp *o = &block->ops[i];
+        switch (o->op) {
+            case IR_NOP:
+                break;
+            case IR_CONST:
+                t[o->dst] = o->imm;
+                break;
+            case IR_GET:
+                t[o->dst] = o->reg < 16 ? chip8->V[o->reg]
+                          : o->reg == IR_REG_I ? chip8->I
+                          : o->reg == IR_REG_DT ? chip8->delay_timer : chip8->sound_timer;
+                break;
+            case IR_SET:
+                if (o->reg < 16)
+                    chip8->V[o->reg] = t[o->a];
+                else if (o->reg == IR_REG_I)
+                    chip8->I = t[o->a];
+                else if (o->reg == IR_REG_DT)
+                    chip8->delay_timer = t[o->a];
+                else
+                    chip8->sound_timer = t[o->a];
+                break;
+            case IR_RAND:
+                t[o->dst] = randomByte(chip8) & o->imm;
+                break;
+            case IR_KEY:
+                t[o->dst] = chip8->key_mask >> (t[o->a] & 0xF) & 1;
+                break;
+            case IR_LOAD:
+                t[o->dst] = chip8->memory[(chip8->I + o->imm) & ADDRESS_MASK];
+                break;
+            case IR_LOADK:
+                t[o->dst] = chip8->memory[o->imm & ADDRESS_MASK];
+                break;
+            case IR_STORE:
+                chip8->memory[(chip8->I + o->imm) & ADDRESS_MASK] = t[o->a];
+                break;
+            case IR_STOREK:
+                chip8->memory[o->imm & ADDRESS_MASK] = t[o->a];
+                break;
+            case IR_DRAW:
+                t[o->dst] = drawSprite(chip8, t[o->a], t[o->b], o->reg, chip8->I);
+                break;
+            case IR_DRAWK:
+                t[o->dst] = drawSprite(chip8, t[o->a], t[o->b], o->reg, o->imm);
+                break;
+            case IR_EXEC:
+                chip8->pc = o->imm;
+                emulateCycle(chip8);
+                break;
+            case IR_JUMP:
+                chip8->pc = o->imm;
+                break;
+            case IR_BRANCH:
+                chip8->pc = t[o->a] ? o->imm : o->imm2;
+                break;
+            default:
+                t[o->dst] = evalPure(o->op, t[o->a], usesB(o->op) ? t[o->b] : 0);
+                break;
+        }
+    }
+    // IR_EXEC counts its own instruction.
+    chip8->cycles += block->insns - block->execs;
+}
+
+void printBlock(const IrBlock *block, FILE *out) {
+    fprintf(out, "block %04X: %d instructions, %d ops\n", block->start, block->insns, block->count);
+    for (int i = 0; i < block->count; i++) {
+        const IrOp *o = &block->ops[i];
+        fprintf(out, "  t%-4d = %-6s", o->dst, op_names[o->op]);
+        if (o->op == IR_GET || o->op == IR_SET || o->op == IR_DRAW || o->op == IR_DRAWK)
+            fprintf(out, " r%d", o->reg);
+        if (usesA(o->op))
+            fprintf(out, " t%d", o->a);
+        if (usesB(o->op))
+            fprintf(out, " t%d", o->b);
+        if (o->op == IR_CONST || o->op == IR_RAND || o->op >= IR_LOAD)
+            fprintf(out, " #%04X", o->imm);
+        if (o->op == IR_BRANCH)
+            fprintf(out, " #%04X", o->imm2);
+        fprintf(out, "\n");
+    }
+}
+
+// ---- Differential testing ----
+
+static void reportMismatch(const char *what, const IrBlock *raw, const IrBlock *opt,
+                           const Chip8 *ref, const Chip8 *got) {
+    fprintf(stderr, "%s block at %04X diverges from emulateCycle:", what, raw->start);
+    if (ref->pc != got->pc)
+        fprintf(stderr, " pc %04X/%04X", ref->pc, got->pc);
+    if (ref->I != got->I)
+        fprintf(stderr, " I %04X/%04X", ref->I, got->I);
+    for (int r = 0; r < 16; r++)
+        if (ref->V[r] != got->V[r])
+            fprintf(stderr, " V%X %02X/%02X", r, ref->V[r], got->V[r]);
+    if (memcmp(ref->memory, got->memory, MEMORY_SIZE))
+        fprintf(stderr, " memory");
+    if (memcmp(ref->display, got->display, sizeof(ref->display)))
+        fprintf(stderr, " display");
+    if (ref->cycles != got->cycles)
+        fprintf(stderr, " cycles %llu/%llu", (unsigned long long)ref->cycles,
+                (unsigned long long)got->cycles);
+    fprintf(stderr, "\n");
+    printBlock(raw, stderr);
+    printBlock(opt, stderr);
+}
+
+static uint32_t nextSeed(uint32_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+static void loadRandomROM(Chip8 *chip8, uint32_t *seed) {
+    uint8_t rom[MEMORY_SIZE - START_ADDRESS];
+    for (size_t i = 0; i < sizeof(rom); i++)
+        rom[i] = nextSeed(seed);
+    initializeChip8(chip8);
+    seedChip8(chip8, nextSeed(seed));
+    loadROMData(chip8, rom, sizeof(rom));
+}
+
+int runIrDiffTest(const char *rom_path, long blocks) {
+    static Chip8 ref, raw_run, opt_run, boot;
+    static IrBlock raw, opt;
+    int random_roms = strcmp(rom_path, "random") == 0;
+    uint32_t seed = 0x2545F491;
+    IrStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    if (random_roms) {
+        loadRandomROM(&ref, &seed);
+    } else {
+        initializeChip8(&ref);
+        seedChip8(&ref, 0x2545F491);
+        if (!loadROM(&ref, rom_path))
+            return 1;
+    }
+    boot = ref;
+
+    long mismatches = 0, instructions = 0, steps = 0;
+    for (long b = 0; b < blocks; b++) {
+        translateBlock(&ref, ref.pc, &raw);
+        opt = raw;
+        optimizeBlock(&opt, &stats);
+
+        raw_run = ref;
+        executeBlock(&raw, &raw_run);
+        opt_run = ref;
+        executeBlock(&opt, &opt_run);
+        for (int i = 0; i < raw.insns; i++)
+            emulateCycle(&ref);
+        instructions += raw.insns;
+
+        int raw_ok = memcmp(&raw_run, &ref, sizeof(Chip8)) == 0;
+        int opt_ok = memcmp(&opt_run, &ref, sizeof(Chip8)) == 0;
+        if (!raw_ok || !opt_ok) {
+            if (mismatches++ < 5)
+                reportMismatch(raw_ok ? "optimized" : "unoptimized", &raw, &opt, &ref,
+                               raw_ok ? &opt_run : &raw_run);
+        }
+
+        // Keep timers and input moving, and start over when a ROM ends or
+        // has run long enough.
+        steps += raw.insns;
+        if (steps >= DEFAULT_CYCLES_PER_FRAME) {
+            steps = 0;
+            tickTimers(&ref);
+            if (random_roms && (nextSeed(&seed) & 7) == 0)
+                setKeyMask(&ref, nextSeed(&seed));
+        }
+        if (ref.halted || (random_roms && (b & 1023) == 1023)) {
+            if (random_roms)
+                loadRandomROM(&ref, &seed);
+            else
+                ref = boot;
+        }
+    }
+
+    printf("ir diff:    %llu blocks, %ld instructions, %ld mismatches\n",
+           (unsigned long long)stats.blocks, instructions, mismatches);
+    printf("ops:        %llu -> %llu (%.1f%% removed)\n",
+           (unsigned long long)stats.ops_before, (unsigned long long)stats.ops_after,
+           stats.ops_before ? 100.0 * (stats.ops_before - stats.ops_after) / stats.ops_before : 0.0);
+    printf("VF writes:  %llu -> %llu\n", (unsigned long long)stats.vf_writes_before,
+           (unsigned long long)stats.vf_writes_after);
+    printf("dead sets:  %llu, forwarded reads: %llu, folded: %llu\n",
+           (unsigned long long)stats.dead_sets, (unsigned long long)stats.forwarded,
+           (unsigned long long)stats.folded);
+    printf("fused:      %llu draws, %llu loads/stores with constant I\n",
+           (unsigned long long)stats.fused_draws, (unsigned long long)stats.fused_memory);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "chip8.h"
+
+// Intermediate representation for translated basic blocks.
+//
+// A block is the straight-line run of instructions starting at an address,
+// ended by the first jump, skip, call/return or store to memory (so code a
+// block modifies is never part of it), or after IR_MAX_INSNS instructions.
+// Each instruction is lowered to three-address ops on temporaries in the
+// same order the interpreter reads and writes state, so quirks such as
+// 8XY5 with Y = F come out right without special cases. Every op writes
+// the temporary with its own index (SSA), and architectural state is only
+// touched through GET/SET of the registers below.
+//
+// Rarely hot or state-heavy instructions (00E0, scrolls, mode switches,
+// calls, BNNN, FX0A, FX33, DXYN with X or Y = F) become IR_EXEC, which
+// runs emulateCycle on the original instruction.
+
+#define IR_MAX_INSNS 32
+#define IR_MAX_OPS   1024
+
+// Registers addressed by IR_GET/IR_SET beyond V0..VF.
+#define IR_REG_I  16
+#define IR_REG_DT 17
+#define IR_REG_ST 18
+#define IR_REGS   19
+
+typedef enum {
+    IR_NOP,
+    IR_CONST,   // imm
+    IR_GET,     // register `reg`
+    IR_SET,     // register `reg` = a
+    IR_ADD, IR_SUB, IR_OR, IR_AND, IR_XOR, // 8-bit results
+    IR_SHR, IR_SHL,
+    IR_CARRY,   // a + b > 255
+    IR_GT,      // a > b
+    IR_LSB,     // a & 1
+    IR_MSB,     // a >> 7
+    IR_EQ, IR_NE,
+    IR_ADD16,   // (a + b) & 0xFFFF, for FX1E
+    IR_FONT,    // FONT_ADDRESS + a * 5
+    IR_RAND,    // random byte & imm; advances the RNG
+    IR_KEY,     // key a & 0xF held
+    IR_LOAD,    // memory[I + imm]
+    IR_LOADK,   // memory[imm]
+    IR_STORE,   // memory[I + imm] = a
+    IR_STOREK,  // memory[imm] = a
+    IR_DRAW,    // sprite of `reg` rows at (a, b) from I; result = collision
+    IR_DRAWK,   // the same with the sprite address in imm (ANNN fused)
+    IR_EXEC,    // run the interpreter on the instruction at imm
+    IR_JUMP,    // pc = imm; ends the block
+    IR_BRANCH,  // pc = a ? imm : imm2; ends the block
+    IR_OPCODE_COUNT
+} IrOpcode;
+
+typedef struct {
+    uint8_t op;
+    uint8_t reg;
+    uint16_t dst;
+    uint16_t a, b;
+    uint16_t imm, imm2;
+} IrOp;
+
+typedef struct {
+    uint16_t start;
+    int insns;  // Guest instructions covered.
+    int execs;  // How many of them run through IR_EXEC.
+    int terminated; // Ends in IR_EXEC rather than JUMP/BRANCH.
+    int count;
+    IrOp ops[IR_MAX_OPS];
+} IrBlock;
+
+typedef struct {
+    uint64_t blocks;
+    uint64_t ops_before;
+    uint64_t ops_after;
+    uint64_t vf_writes_before;
+    uint64_t vf_writes_after;
+    uint64_t dead_sets;     // Register writes removed.
+    uint64_t folded;        // Ops replaced by constants.
+    uint64_t forwarded;     // Register reads replaced by known values.
+    uint64_t fused_draws;   // DXYN with a constant I.
+    uint64_t fused_memory;  // FX55/FX65 with a constant I.
+} IrStats;
+
+void translateBlock(const Chip8 *chip8, uint16_t pc, IrBlock *block);
+// Constant propagation and folding, then dead register write and dead
+// temporary elimination. stats may be NULL.
+void optimizeBlock(IrBlock *block, IrStats *stats);
+// Reference evaluator: run a block against a machine, leaving it exactly
+// as block->insns calls to emulateCycle would.
+void executeBlock(const IrBlock *block, Chip8 *chip8);
+void printBlock(const IrBlock *block, FILE *out);
+
+// Differential test: translate blocks along a ROM's execution (or random
+// ROMs when rom_path is "random"), run each unoptimized, optimized and
+// through emulateCycle, and compare the machines.
+int runIrDiffTest(const char *rom_path, long blocks);
+
+#endif
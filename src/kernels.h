@@ -0,0 +1,60 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Vectorizable kernels, built in several versions and picked at runtime.
+//
+// The build uses no target flags, so one binary runs anywhere. Each kernel
+// is compiled once per instruction-set level it benefits from (with
+// target attributes), and a constructor selects the best version the CPU
+// supports before main runs. Kernels with no version at a level use the
+// next lower one. Setting CUPID8_CPU_LEVEL, or calling selectKernels,
+// forces a lower level so that each version can be exercised.
+
+typedef enum {
+    CPU_LEVEL_GENERIC,
+    CPU_LEVEL_SSE2,
+    CPU_LEVEL_AVX2,
+    CPU_LEVEL_AVX512, // F, BW and VL.
+    CPU_LEVEL_COUNT
+} CpuLevel;
+
+typedef struct {
+    // XOR a sprite row (bits MSB first, 8 or 16 wide) into a display row
+    // at column x, wrapping at screen_width. Returns 1 if a lit pixel was
+    // cleared.
+    int (*blit_row)(uint8_t *row, int x, uint16_t bits, int width, int screen_width);
+    // Map count display bytes to fg (non-zero) or bg 32-bit pixels.
+    void (*expand_palette)(const uint8_t *src, uint32_t *dst, int count, uint32_t fg, uint32_t bg);
+    // Fold 32-byte blocks into hashState's four lanes.
+    void (*hash_blocks)(uint64_t h[4], const uint8_t *p, size_t blocks);
+} Kernels;
+
+extern Kernels kernels;
+
+enum { KERNEL_BLIT_ROW, KERNEL_PALETTE, KERNEL_HASH, KERNEL_COUNT };
+
+// One hashState lane step; every hash_blocks version must agree with it.
+static inline uint64_t hashMix(uint64_t h, uint64_t w) {
+    h ^= w * 0x9E3779B97F4A7C15ull;
+    return (h << 31 | h >> 33) * 0xC2B2AE3D27D4EB4Full;
+}
+
+CpuLevel detectCpuLevel(void);
+// Use the best versions up to `level`. Returns 0, changing nothing, if
+// the CPU doesn't support it.
+int selectKernels(CpuLevel level);
+CpuLevel selectedCpuLevel(void);
+const char *cpuLevelName(CpuLevel level);
+// Returns the level for a name as printed by cpuLevelName, or -1.
+int parseCpuLevel(const char *name);
+const char *kernelName(int kernel);
+// The version a kernel (KERNEL_*) uses when `level` is selected.
+CpuLevel kernelLevel(int kernel, CpuLevel level);
+// What the CPU has and which version of each kernel is in use.
+void printCpuFeatures(FILE *out);
+
+#endif
@@ -0,0 +1,214 @@
+#define _POSIX_C_SOURCE 200809L
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "launcher.h"
+#include "cache.h"
+
+#define LIBRARY_MAGIC   0x424C3843u // "C8LB"
+#define LIBRARY_VERSION 2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t warmup_frames;
+    uint32_t frame;
+    uint32_t lit;
+    uint32_t reserved;
+    uint64_t core; // chip8CoreId of the core that ran the warmup.
+} SnapshotHeader;
+
+static struct {
+    RomLibrary *library;
+    int frames;
+    int next;
+    pthread_mutex_t lock;
+} scan = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int litPixels(const Chip8 *chip8) {
+    int lit = 0;
+    for (int y = 0; y < chip8->screen_height; y++)
+        for (int x = 0; x < chip8->screen_width; x++)
+            lit += chip8->display[y * MAX_WIDTH + x] != 0;
+    return lit;
+}
+
+static int loadCachedSnapshot(LibraryEntry *e, const char *path) {
+    static __thread uint8_t buf[sizeof(SnapshotHeader) + CHIP8_STATE_SIZE];
+    SnapshotHeader h;
+    if (readCacheFile(path, buf, sizeof(buf)) != (long)sizeof(buf))
+        return 0;
+    memcpy(&h, buf, sizeof(h));
+    if (h.magic != LIBRARY_MAGIC || h.version != LIBRARY_VERSION ||
+        h.core != chip8CoreId() || h.warmup_frames != (uint32_t)scan.frames)
+        return 0;
+    if (!loadState(e->snapshot, buf + sizeof(h), CHIP8_STATE_SIZE))
+        return 0;
+    e->frame = h.frame;
+    e->lit = h.lit;
+    return 1;
+}
+
+static void saveSnapshot(const LibraryEntry *e, const char *path) {
+    static __thread uint8_t buf[sizeof(SnapshotHeader) + CHIP8_STATE_SIZE];
+    SnapshotHeader h = { LIBRARY_MAGIC, LIBRARY_VERSION, scan.frames, e->frame, e->lit, 0, chip8CoreId() };
+    memcpy(buf, &h, sizeof(h));
+    saveState(e->snapshot, buf + sizeof(h), CHIP8_STATE_SIZE);
+    writeCacheFile(path, buf, sizeof(buf));
+}
+
+static void buildEntry(LibraryEntry *e, Chip8 *chip8) {
+    double start = nowSeconds();
+    e->snapshot = allocChip8(sizeof(Chip8));
+    if (!e->snapshot)
+        return;
+    initializeChip8(chip8);
+    seedChip8(chip8, 0x2545F491);
+    if (!loadROM(chip8, e->path))
+        return;
+    e->hash = hashProgram(chip8);
+
+    char path[4096];
+    int cacheable = cachePath("launcher", e->hash, ".snap", path, sizeof(path));
+    if (cacheable && loadCachedSnapshot(e, path)) {
+        e->ok = 1;
+        e->cached = 1;
+        e->seconds = nowSeconds() - start;
+        return;
+    }
+
+    *e->snapshot = *chip8;
+    e->lit = -1;
+    for (int frame = 1; frame <= scan.frames && !chip8->halted; frame++) {
+        runFrame(chip8, DEFAULT_CYCLES_PER_FRAME);
+        if (frame % LIBRARY_SAMPLE_FRAMES || chip8->halted)
+            continue;
+        // Ties go to the later frame: title screens tend to settle.
+        int lit = litPixels(chip8);
+        if (lit >= e->lit) {
+            e->lit = lit;
+            e->frame = frame;
+            *e->snapshot = *chip8;
+        }
+    }
+    if (e->lit < 0)
+        e->lit = 0;
+    e->ok = 1;
+    if (cacheable)
+        saveSnapshot(e, path);
+    e->seconds = nowSeconds() - start;
+}
+
+static void *scanWorker(void *arg) {
+    (void)arg;
+    Chip8 *chip8 = allocChip8(sizeof(Chip8));
+    for (;;) {
+        pthread_mutex_lock(&scan.lock);
+        int i = scan.next++;
+        pthread_mutex_unlock(&scan.lock);
+        if (i >= scan.library->count || !chip8)
+            break;
+        buildEntry(&scan.library->entries[i], chip8);
+    }
+    free(chip8);
+    return NULL;
+}
+
+static int compareEntries(const void *a, const void *b) {
+    return strcmp(((const LibraryEntry *)a)->name, ((const LibraryEntry *)b)->name);
+}
+
+RomLibrary *scanLibrary(const char *dir, int frames, int threads) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        perror(dir);
+        return NULL;
+    }
+    RomLibrary *library = calloc(1, sizeof(RomLibrary));
+    int cap = 0;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        char path[4096];
+        struct stat st;
+        if (ent->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+            st.st_size > MEMORY_SIZE - START_ADDRESS)
+            continue;
+        if (library->count == cap) {
+            cap = cap ? cap * 2 : 64;
+            library->entries = realloc(library->entries, cap * sizeof(LibraryEntry));
+        }
+        LibraryEntry *e = &library->entries[library->count++];
+        memset(e, 0, sizeof(*e));
+        e->path = strdup(path);
+        e->name = e->path + strlen(dir) + 1;
+    }
+    closedir(d);
+    if (library->count)
+        qsort(library->entries, library->count, sizeof(LibraryEntry), compareEntries);
+
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+        threads = 1;
+    scan.library = library;
+    scan.frames = frames > 0 ? frames : LIBRARY_WARMUP_FRAMES;
+    scan.next = 0;
+    double start = nowSeconds();
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    for (int t = 0; t < threads; t++)
+        pthread_create(&tids[t], NULL, scanWorker, NULL);
+    for (int t = 0; t < threads; t++)
+        pthread_join(tids[t], NULL);
+    free(tids);
+    library->seconds = nowSeconds() - start;
+    for (int i = 0; i < library->count; i++) {
+        library->built += library->entries[i].ok && !library->entries[i].cached;
+        library->cached += library->entries[i].cached;
+    }
+    return library;
+}
+
+void freeLibrary(RomLibrary *library) {
+    if (!library)
+        return;
+    for (int i = 0; i < library->count; i++) {
+        free(library->entries[i].path);
+        free(library->entries[i].snapshot);
+    }
+    free(library->entries);
+    free(library);
+}
+
+int runLibraryScan(const char *dir, int frames, int threads) {
+    RomLibrary *library = scanLibrary(dir, frames, threads);
+    if (!library)
+        return 1;
+    printf("%-24s %-16s %-6s %6s %6s %10s\n", "rom", "hash", "source", "frame", "lit", "ms");
+    for (int i = 0; i < library->count; i++) {
+        LibraryEntry *e = &library->entries[i];
+        if (!e->ok) {
+            printf("%-24s failed to load\n", e->name);
+            continue;
+        }
+        printf("%-24s %016llx %-6s %6d %6d %10.2f\n", e->name, (unsigned long long)e->hash,
+               e->cached ? "cache" : "run", e->frame, e->lit, e->seconds * 1e3);
+    }
+    printf("library: %d ROMs, %d built, %d from cache, in %.2f s\n", library->count,
+           library->built, library->cached, library->seconds);
+    freeLibrary(library);
+    return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <stdint.h>
+#include "chip8.h"
+
+// ROM library for the launcher. Every ROM in a directory is run headless
+// for a few seconds by a pool of worker threads. A frame is sampled every
+// LIBRARY_SAMPLE_FRAMES, and the one with the most lit pixels becomes
+// both the thumbnail and the snapshot the launcher resumes from, so
+// picking a ROM continues exactly from the picture shown for it. Snapshots
+// are cached on disk by program hash (see cache.h) together with the
+// warm-up length, so later scans only run new ROMs.
+
+#define LIBRARY_WARMUP_FRAMES 180 // Three seconds.
+#define LIBRARY_SAMPLE_FRAMES 6
+
+typedef struct {
+    char *path;
+    const char *name;   // File name within path.
+    uint64_t hash;      // hashProgram of the ROM.
+    int ok;             // Loaded and snapshotted.
+    int cached;         // Snapshot came from the disk cache.
+    int frame;          // Frame the snapshot was taken at.
+    int lit;            // Lit pixels in it.
+    double seconds;     // Time spent building it.
+    Chip8 *snapshot;
+} LibraryEntry;
+
+typedef struct {
+    LibraryEntry *entries; // Sorted by name.
+    int count;
+    int built;
+    int cached;
+    double seconds;
+} RomLibrary;
+
+// threads <= 0 uses one per CPU. Returns NULL if the directory can't be
+// read.
+RomLibrary *scanLibrary(const char *dir, int frames, int threads);
+void freeLibrary(RomLibrary *library);
+
+// Headless scan with a per-ROM report.
+int runLibraryScan(const char *dir, int frames, int threads);
+
+#endif
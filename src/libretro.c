@@ -0,0 +1,214 @@
+#include <math.h>
+#include <string.h>
+#include "chip8.h"
+#include "kernels.h"
+#include "libretro.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define AUDIO_FREQUENCY 44100
+#define TONE_FREQUENCY  440
+#define FRAME_RATE      60
+#define AUDIO_FRAMES    (AUDIO_FREQUENCY / FRAME_RATE) // Stereo frames per retro_run.
+
+static retro_environment_t environ_cb;
+static retro_video_refresh_t video_cb;
+static retro_audio_sample_batch_t audio_batch_cb;
+static retro_input_poll_t input_poll_cb;
+static retro_input_state_t input_state_cb;
+
+static Chip8 chip8;
+static int game_loaded = 0;
+static uint8_t rom_image[MEMORY_SIZE - START_ADDRESS];
+static size_t rom_size = 0;
+static uint32_t framebuffer[MAX_WIDTH * MAX_HEIGHT];
+static int16_t audio_buffer[AUDIO_FRAMES * 2];
+static double audio_phase = 0.0;
+
+// Keyboard layout matches the SDL frontend (see mapKey in cupid-8.c).
+static const unsigned keyboard_map[16] = {
+    RETROK_x, RETROK_1, RETROK_2, RETROK_3,
+    RETROK_q, RETROK_w, RETROK_e, RETROK_a,
+    RETROK_s, RETROK_d, RETROK_z, RETROK_c,
+    RETROK_4, RETROK_r, RETROK_f, RETROK_v
+};
+
+// Joypad: the d-pad drives the 2/4/6/8 cross most games use, A is 5.
+static const struct { unsigned id; int key; } joypad_map[] = {
+    { RETRO_DEVICE_ID_JOYPAD_UP, 0x2 },
+    { RETRO_DEVICE_ID_JOYPAD_DOWN, 0x8 },
+    { RETRO_DEVICE_ID_JOYPAD_LEFT, 0x4 },
+    { RETRO_DEVICE_ID_JOYPAD_RIGHT, 0x6 },
+    { RETRO_DEVICE_ID_JOYPAD_A, 0x5 },
+    { RETRO_DEVICE_ID_JOYPAD_B, 0x0 },
+    { RETRO_DEVICE_ID_JOYPAD_X, 0xA },
+    { RETRO_DEVICE_ID_JOYPAD_Y, 0xB },
+    { RETRO_DEVICE_ID_JOYPAD_START, 0xF },
+    { RETRO_DEVICE_ID_JOYPAD_SELECT, 0xE },
+};
+
+RETRO_API void retro_set_environment(retro_environment_t cb) {
+    bool no_game = false;
+    environ_cb = cb;
+    cb(RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME, &no_game);
+}
+
+RETRO_API void retro_set_video_refresh(retro_video_refresh_t cb) { video_cb = cb; }
+RETRO_API void retro_set_audio_sample(retro_audio_sample_t cb) { (void)cb; }
+RETRO_API void retro_set_audio_sample_batch(retro_audio_sample_batch_t cb) { audio_batch_cb = cb; }
+RETRO_API void retro_set_input_poll(retro_input_poll_t cb) { input_poll_cb = cb; }
+RETRO_API void retro_set_input_state(retro_input_state_t cb) { input_state_cb = cb; }
+
+RETRO_API void retro_init(void) {
+    initializeChip8(&chip8);
+}
+
+RETRO_API void retro_deinit(void) {
+    game_loaded = 0;
+}
+
+RETRO_API unsigned retro_api_version(void) {
+    return RETRO_API_VERSION;
+}
+
+RETRO_API void retro_get_system_info(struct retro_system_info *info) {
+    memset(info, 0, sizeof(*info));
+    info->library_name = "cupid-8";
+    info->library_version = "1.0";
+    info->valid_extensions = "ch8|c8|sc8|rom";
+    info->need_fullpath = false;
+}
+
+RETRO_API void retro_get_system_av_info(struct retro_system_av_info *info) {
+    info->geometry.base_width = NORMAL_WIDTH;
+    info->geometry.base_height = NORMAL_HEIGHT;
+    info->geometry.max_width = MAX_WIDTH;
+    info->geometry.max_height = MAX_HEIGHT;
+    info->geometry.aspect_ratio = 2.0f;
+    info->timing.fps = FRAME_RATE;
+    info->timing.sample_rate = AUDIO_FREQUENCY;
+}
+
+RETRO_API void retro_set_controller_port_device(unsigned port, unsigned device) {
+    (void)port;
+    (void)device;
+}
+
+RETRO_API void retro_reset(void) {
+    initializeChip8(&chip8);
+    loadROMData(&chip8, rom_image, rom_size);
+}
+
+static void pollKeys(void) {
+    uint16_t mask = 0;
+    input_poll_cb();
+    for (int i = 0; i < 16; i++)
+        if (input_state_cb(0, RETRO_DEVICE_KEYBOARD, 0, keyboard_map[i]))
+            mask |= 1u << i;
+    for (size_t i = 0; i < sizeof(joypad_map) / sizeof(joypad_map[0]); i++)
+        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, joypad_map[i].id))
+            mask |= 1u << joypad_map[i].key;
+    setKeyMask(&chip8, mask);
+}
+
+// Expand the 1-byte-per-pixel display into XRGB8888 with the frontend's
+// palettes (white on black, or cyan on dark blue in extended mode).
+static void renderFrame(void) {
+    uint32_t fg = chip8.extended_mode ? 0x0000FFFF : 0x00FFFFFF;
+    uint32_t bg = chip8.extended_mode ? 0x00000080 : 0x00000000;
+    for (int y = 0; y < chip8.screen_height; y++)
+        kernels.expand_palette(&chip8.display[y * MAX_WIDTH], &framebuffer[y * MAX_WIDTH],
+                               chip8.screen_width, fg, bg);
+    video_cb(framebuffer, chip8.screen_width, chip8.screen_height,
+             MAX_WIDTH * sizeof(uint32_t));
+}
+
+// One frame's worth of stereo samples, delivered in a single batch.
+static void renderAudio(void) {
+    if (chip8.sound_timer > 0) {
+        double inc = (2.0 * M_PI * TONE_FREQUENCY) / AUDIO_FREQUENCY;
+        for (int i = 0; i < AUDIO_FRAMES; i++) {
+            int16_t s = (int16_t)(8000 * sin(audio_phase));
+            audio_buffer[i * 2] = s;
+            audio_buffer[i * 2 + 1] = s;
+            audio_phase += inc;
+            if (audio_phase > 2.0 * M_PI)
+                audio_phase -= 2.0 * M_PI;
+        }
+    } else {
+        memset(audio_buffer, 0, sizeof(audio_buffer));
+    }
+    for (size_t done = 0; done < AUDIO_FRAMES;) {
+        size_t n = audio_batch_cb(audio_buffer + done * 2, AUDIO_FRAMES - done);
+        if (n == 0)
+            break;
+        done += n;
+    }
+}
+
+RETRO_API void retro_run(void) {
+    pollKeys();
+    if (game_loaded && !chip8.halted)
+        runFrame(&chip8, DEFAULT_CYCLES_PER_FRAME);
+    renderFrame();
+    renderAudio();
+}
+
+RETRO_API size_t retro_serialize_size(void) {
+    return CHIP8_STATE_SIZE;
+}
+
+RETRO_API bool retro_serialize(void *data, size_t size) {
+    return saveState(&chip8, data, size) != 0;
+}
+
+RETRO_API bool retro_unserialize(const void *data, size_t size) {
+    return loadState(&chip8, data, size) != 0;
+}
+
+RETRO_API void retro_cheat_reset(void) {}
+
+RETRO_API void retro_cheat_set(unsigned index, bool enabled, const char *code) {
+    (void)index;
+    (void)enabled;
+    (void)code;
+}
+
+RETRO_API bool retro_load_game(const struct retro_game_info *game) {
+    enum retro_pixel_format fmt = RETRO_PIXEL_FORMAT_XRGB8888;
+    if (!game || !game->data || game->size > sizeof(rom_image))
+        return false;
+    if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt))
+        return false;
+    memcpy(rom_image, game->data, game->size);
+    rom_size = game->size;
+    retro_reset();
+    game_loaded = 1;
+    return true;
+}
+
+RETRO_API bool retro_load_game_special(unsigned game_type,
+                                       const struct retro_game_info *info, size_t num_info) {
+    (void)game_type;
+    (void)info;
+    (void)num_info;
+    return false;
+}
+
+RETRO_API void retro_unload_game(void) {
+    game_loaded = 0;
+}
+
+RETRO_API unsigned retro_get_region(void) {
+    return RETRO_REGION_NTSC;
+}
+
+RETRO_API void *retro_get_memory_data(unsigned id) {
+    return id == RETRO_MEMORY_SYSTEM_RAM ? chip8.memory : NULL;
+}
+
+RETRO_API size_t retro_get_memory_size(unsigned id) {
+    return id == RETRO_MEMORY_SYSTEM_RAM ? sizeof(chip8.memory) : 0;
+}
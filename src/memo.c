@@ -0,0 +1,314 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "memo.h"
+#include "kernels.h"
+
+#define MEMO_INITIAL_BUCKETS 1024
+#define MEMO_RUN_GAP         16 // Unchanged bytes that end a delta run.
+
+typedef struct MemoEntry {
+    uint64_t hash;
+    uint16_t keys;
+    int cycles;
+    struct MemoEntry *next;     // Bucket chain.
+    struct MemoEntry *lru_prev; // Towards most recently used.
+    struct MemoEntry *lru_next; // Towards least recently used.
+    uint32_t delta_len;
+    // The state's first line (registers, timers, keys), compared on a hit
+    // so that a hash collision between states that differ there is caught.
+    uint8_t line[CHIP8_CACHE_LINE];
+    // Runs of (u16 offset, u16 length, bytes) to write into the state.
+    uint8_t delta[];
+} MemoEntry;
+
+struct FrameMemo {
+    MemoEntry **buckets;
+    size_t bucket_count;
+    MemoEntry *lru_head;
+    MemoEntry *lru_tail;
+    size_t max_bytes;
+    int verify;
+    FrameMemoStats stats;
+    Chip8 before;   // Scratch: the state at the start of a missed frame,
+    Chip8 executed; // or the re-executed frame when verifying a hit.
+    uint8_t *scratch_delta;
+};
+
+// Worst case: every byte changed, one run per MEMO_RUN_GAP bytes.
+#define MAX_DELTA_LEN (sizeof(Chip8) + 4 * (sizeof(Chip8) / MEMO_RUN_GAP + 2))
+
+// 64-bit hash of the whole machine. Four independent lanes keep the
+// multiplies pipelined (or share one vector register, see kernels.c);
+// this is the per-frame cost of memoization.
+uint64_t hashState(const Chip8 *chip8) {
+    const uint8_t *p = (const uint8_t *)chip8;
+    size_t n = sizeof(Chip8);
+    uint64_t h[4] = { 1, 2, 3, 4 };
+    kernels.hash_blocks(h, p, n / 32);
+    p += n / 32 * 32;
+    n %= 32;
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h[0] = hashMix(h[0], w);
+        p += 8;
+        n -= 8;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, p, n);
+    h[1] = hashMix(h[1], tail);
+    return hashMix(hashMix(h[0], h[1]), hashMix(h[2], h[3]));
+}
+
+// Encode the bytes that differ between two states as runs.
+static uint32_t encodeDelta(const uint8_t *before, const uint8_t *after, uint8_t *out) {
+    size_t n = sizeof(Chip8), i = 0;
+    uint8_t *p = out;
+    while (i < n) {
+        if (before[i] == after[i]) {
+            // Skip equal bytes a word at a time where possible.
+            while (i + 8 <= n && memcmp(before + i, after + i, 8) == 0)
+                i += 8;
+            while (i < n && before[i] == after[i])
+                i++;
+            continue;
+        }
+        size_t start = i, last = i;
+        while (i < n && i - last <= MEMO_RUN_GAP) {
+            if (before[i] != after[i])
+                last = i;
+            i++;
+        }
+        size_t len = last - start + 1;
+        p[0] = start & 0xFF;
+        p[1] = start >> 8;
+        p[2] = len & 0xFF;
+        p[3] = len >> 8;
+        memcpy(p + 4, after + start, len);
+        p += 4 + len;
+        i = last + 1;
+    }
+    return (uint32_t)(p - out);
+}
+
+static void applyDelta(const MemoEntry *e, uint8_t *state) {
+    const uint8_t *p = e->delta, *end = e->delta + e->delta_len;
+    while (p < end) {
+        size_t start = p[0] | p[1] << 8;
+        size_t len = p[2] | p[3] << 8;
+        memcpy(state + start, p + 4, len);
+        p += 4 + len;
+    }
+}
+
+static void lruUnlink(FrameMemo *memo, MemoEntry *e) {
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        memo->lru_head = e->lru_next;
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        memo->lru_tail = e->lru_prev;
+}
+
+static void lruPushFront(FrameMemo *memo, MemoEntry *e) {
+    e->lru_prev = NULL;
+    e->lru_next = memo->lru_head;
+    if (memo->lru_head)
+        memo->lru_head->lru_prev = e;
+    memo->lru_head = e;
+    if (!memo->lru_tail)
+        memo->lru_tail = e;
+}
+
+static size_t entryBytes(const MemoEntry *e) {
+    return sizeof(MemoEntry) + e->delta_len;
+}
+
+static void removeEntry(FrameMemo *memo, MemoEntry *e) {
+    MemoEntry **link = &memo->buckets[e->hash & (memo->bucket_count - 1)];
+    while (*link != e)
+        link = &(*link)->next;
+    *link = e->next;
+    lruUnlink(memo, e);
+    memo->stats.entries--;
+    memo->stats.bytes -= entryBytes(e);
+    free(e);
+}
+
+static void growBuckets(FrameMemo *memo) {
+    size_t count = memo->bucket_count * 2;
+    MemoEntry **buckets = calloc(count, sizeof(MemoEntry *));
+    if (!buckets)
+        return;
+    for (size_t b = 0; b < memo->bucket_count; b++) {
+        MemoEntry *e = memo->buckets[b];
+        while (e) {
+            MemoEntry *next = e->next;
+            e->next = buckets[e->hash & (count - 1)];
+            buckets[e->hash & (count - 1)] = e;
+            e = next;
+        }
+    }
+    free(memo->buckets);
+    memo->buckets = buckets;
+    memo->bucket_count = count;
+}
+
+FrameMemo *createFrameMemo(size_t max_bytes, int verify) {
+    FrameMemo *memo = allocChip8(sizeof(FrameMemo));
+    if (!memo)
+        return NULL;
+    memo->bucket_count = MEMO_INITIAL_BUCKETS;
+    memo->buckets = calloc(memo->bucket_count, sizeof(MemoEntry *));
+    memo->scratch_delta = malloc(MAX_DELTA_LEN);
+    if (!memo->buckets || !memo->scratch_delta) {
+        destroyFrameMemo(memo);
+        return NULL;
+    }
+    memo->max_bytes = max_bytes;
+    memo->verify = verify;
+    return memo;
+}
+
+void destroyFrameMemo(FrameMemo *memo) {
+    if (!memo)
+        return;
+    MemoEntry *e = memo->lru_head;
+    while (e) {
+        MemoEntry *next = e->lru_next;
+        free(e);
+        e = next;
+    }
+    free(memo->buckets);
+    free(memo->scratch_delta);
+    free(memo);
+}
+
+static int lookupOrRun(FrameMemo *memo, Chip8 *chip8, int cycles) {
+    uint64_t hash = hashState(chip8);
+    uint16_t keys = getKeyMask(chip8);
+    memo->stats.lookups++;
+
+    MemoEntry *e = memo->buckets[hash & (memo->bucket_count - 1)];
+    while (e && !(e->hash == hash && e->keys == keys && e->cycles == cycles &&
+                  memcmp(e->line, chip8, CHIP8_CACHE_LINE) == 0))
+        e = e->next;
+    if (e) {
+        memo->stats.hits++;
+        lruUnlink(memo, e);
+        lruPushFront(memo, e);
+        if (memo->verify) {
+            memo->executed = *chip8;
+            runFrame(&memo->executed, cycles);
+            applyDelta(e, (uint8_t *)chip8);
+            if (memcmp(&memo->executed, chip8, sizeof(Chip8)) != 0) {
+                memo->stats.verify_failures++;
+                *chip8 = memo->executed;
+            }
+        } else {
+            applyDelta(e, (uint8_t *)chip8);
+        }
+        return 1;
+    }
+
+    memo->before = *chip8;
+    runFrame(chip8, cycles);
+    uint32_t len = encodeDelta((const uint8_t *)&memo->before, (const uint8_t *)chip8,
+                               memo->scratch_delta);
+    if (sizeof(MemoEntry) + len > memo->max_bytes)
+        return 0;
+    e = malloc(sizeof(MemoEntry) + len);
+    if (!e)
+        return 0;
+    e->hash = hash;
+    e->keys = keys;
+    e->cycles = cycles;
+    e->delta_len = len;
+    memcpy(e->line, &memo->before, CHIP8_CACHE_LINE);
+    memcpy(e->delta, memo->scratch_delta, len);
+
+    while (memo->stats.bytes + entryBytes(e) > memo->max_bytes && memo->lru_tail) {
+        removeEntry(memo, memo->lru_tail);
+        memo->stats.evictions++;
+    }
+    if (memo->stats.entries >= memo->bucket_count)
+        growBuckets(memo);
+    MemoEntry **bucket = &memo->buckets[hash & (memo->bucket_count - 1)];
+    e->next = *bucket;
+    *bucket = e;
+    lruPushFront(memo, e);
+    memo->stats.entries++;
+    memo->stats.bytes += entryBytes(e);
+    return 0;
+}
+
+int runFrameMemo(FrameMemo *memo, Chip8 *chip8, int cycles) {
+    // The instruction counter differs on every frame, so it is kept out of
+    // the key: count from zero through the frame and add the total back.
+    uint64_t counted = chip8->cycles;
+    chip8->cycles = 0;
+    int hit = lookupOrRun(memo, chip8, cycles);
+    chip8->cycles += counted;
+    return hit;
+}
+
+void getFrameMemoStats(const FrameMemo *memo, FrameMemoStats *stats) {
+    *stats = memo->stats;
+}
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run a ROM with and without the cache and report hit rate and speedup.
+// The final states must match.
+int runMemoBench(const char *rom_path, int frames, int cycles_per_frame, int verify) {
+    static Chip8 plain, memoized;
+    if (cycles_per_frame <= 0)
+        cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+    initializeChip8(&plain);
+    seedChip8(&plain, 0x2545F491);
+    if (!loadROM(&plain, rom_path))
+        return 1;
+    memoized = plain;
+
+    double start = nowSeconds();
+    for (int i = 0; i < frames; i++)
+        runFrame(&plain, cycles_per_frame);
+    double plain_time = nowSeconds() - start;
+
+    FrameMemo *memo = createFrameMemo(64u << 20, verify);
+    if (!memo)
+        return 1;
+    start = nowSeconds();
+    for (int i = 0; i < frames; i++)
+        runFrameMemo(memo, &memoized, cycles_per_frame);
+    double memo_time = nowSeconds() - start;
+
+    FrameMemoStats st;
+    getFrameMemoStats(memo, &st);
+    int same = memcmp(&plain, &memoized, sizeof(Chip8)) == 0;
+    printf("frames:          %d at %d cycles/frame\n", frames, cycles_per_frame);
+    printf("hit rate:        %.1f%% (%llu of %llu)\n",
+           st.lookups ? 100.0 * st.hits / st.lookups : 0.0,
+           (unsigned long long)st.hits, (unsigned long long)st.lookups);
+    printf("entries:         %zu (%zu bytes, %llu evicted)\n", st.entries, st.bytes,
+           (unsigned long long)st.evictions);
+    printf("plain:           %.3f s (%.2f us/frame)\n", plain_time, plain_time * 1e6 / frames);
+    printf("memoized:        %.3f s (%.2f us/frame, %.2fx)\n", memo_time,
+           memo_time * 1e6 / frames, memo_time > 0 ? plain_time / memo_time : 0.0);
+    if (verify)
+        printf("verify failures: %llu\n", (unsigned long long)st.verify_failures);
+    else
+        printf("hits:            matched by hash and first line, not re-executed\n");
+    printf("final state:     %s\n", same ? "identical" : "DIFFERENT");
+    destroyFrameMemo(memo);
+    return same && st.verify_failures == 0 ? 0 : 1;
+}
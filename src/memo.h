@@ -0,0 +1,46 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chip8.h"
+
+// Frame memoization: a cache from (full machine state, key mask, cycles per
+// frame) to the bytes that one frame changes. Menus, attract loops and
+// paused games repeat whole frames exactly; on a hit the recorded delta is
+// applied instead of executing the frame.
+//
+// The key is a 64-bit hash of the state, so the cache costs one pass over
+// the ~12 KB struct per frame. It pays off when frames execute many
+// cycles; at the default 10 cycles per frame emulation is cheaper.
+//
+// A hit also compares the state's first cache line (registers, timers,
+// keys) with the stored one, but not memory or the display. Outside verify
+// mode a hit is therefore probabilistic: two states that share a hash and
+// a first line but differ elsewhere would take the wrong delta. The chance
+// is about 2^-64 per lookup against each stored entry.
+
+typedef struct FrameMemo FrameMemo;
+
+typedef struct {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t evictions;
+    uint64_t verify_failures; // Hits whose delta didn't match re-execution.
+    size_t entries;
+    size_t bytes;
+} FrameMemoStats;
+
+// max_bytes bounds the memory used by entries; least recently used entries
+// are evicted beyond it. With verify set, every hit is also executed and
+// compared, and the executed result wins.
+FrameMemo *createFrameMemo(size_t max_bytes, int verify);
+void destroyFrameMemo(FrameMemo *memo);
+// Drop-in replacement for runFrame. Returns 1 on a cache hit.
+int runFrameMemo(FrameMemo *memo, Chip8 *chip8, int cycles);
+void getFrameMemoStats(const FrameMemo *memo, FrameMemoStats *stats);
+uint64_t hashState(const Chip8 *chip8);
+
+int runMemoBench(const char *rom_path, int frames, int cycles_per_frame, int verify);
+
+#endif
@@ -0,0 +1,219 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "persist.h"
+#include "memo.h"
+
+#define PERSIST_MAGIC   0x50533843u // "C8SP"
+#define PERSIST_VERSION 1
+#define PERSIST_PAGE    4096
+// Slots start on their own pages so committing one never dirties a page of
+// the other.
+#define PERSIST_SLOT_SIZE (((16 + CHIP8_STATE_SIZE) + PERSIST_PAGE - 1) / PERSIST_PAGE * PERSIST_PAGE)
+#define PERSIST_FILE_SIZE (PERSIST_PAGE + 2 * PERSIST_SLOT_SIZE)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t reserved;
+    uint64_t program_hash;
+} PersistHeader;
+
+typedef struct {
+    volatile uint64_t generation; // 0 while the slot is being written.
+    uint64_t checksum;            // hashState of the stored machine.
+    uint8_t state[CHIP8_STATE_SIZE];
+} PersistSlot;
+
+struct PersistentState {
+    int fd;
+    uint8_t *map;
+    uint64_t generation;
+    uint64_t program_hash;
+    int sync_frames;
+    int since_sync;
+};
+
+static PersistHeader *header(PersistentState *ps) {
+    return (PersistHeader *)ps->map;
+}
+
+static PersistSlot *slot(PersistentState *ps, int i) {
+    return (PersistSlot *)(ps->map + PERSIST_PAGE + i * PERSIST_SLOT_SIZE);
+}
+
+PersistentState *openPersistentState(const char *path, uint64_t program_hash, int sync_frames) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("Failed to open state file");
+        return NULL;
+    }
+    // Only an empty (new) file is sized here. Anything else must already
+    // be a state file, so a wrong path never overwrites another file.
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("Failed to stat state file");
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size == 0) {
+        if (ftruncate(fd, PERSIST_FILE_SIZE) < 0) {
+            perror("Failed to size state file");
+            close(fd);
+            return NULL;
+        }
+    } else {
+        PersistHeader h;
+        if (st.st_size != PERSIST_FILE_SIZE || pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+            h.magic != PERSIST_MAGIC || h.version != PERSIST_VERSION ||
+            h.slot_size != PERSIST_SLOT_SIZE) {
+            fprintf(stderr, "%s is not a cupid-8 state file; refusing to overwrite it\n", path);
+            close(fd);
+            return NULL;
+        }
+    }
+    uint8_t *map = mmap(NULL, PERSIST_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Failed to map state file");
+        close(fd);
+        return NULL;
+    }
+    PersistentState *ps = calloc(1, sizeof(PersistentState));
+    if (!ps) {
+        fprintf(stderr, "Out of memory for state file\n");
+        munmap(map, PERSIST_FILE_SIZE);
+        close(fd);
+        return NULL;
+    }
+    ps->fd = fd;
+    ps->map = map;
+    ps->program_hash = program_hash;
+    ps->sync_frames = sync_frames;
+    return ps;
+}
+
+// A slot's frame, if it is complete and belongs to this program.
+static uint64_t validSlot(PersistentState *ps, int i, Chip8 *out) {
+    PersistSlot *s = slot(ps, i);
+    uint64_t generation = s->generation;
+    if (!generation || !loadState(out, s->state, sizeof(s->state)) || hashState(out) != s->checksum)
+        return 0;
+    return generation;
+}
+
+uint64_t resumePersistentState(PersistentState *ps, Chip8 *chip8) {
+    PersistHeader *h = header(ps);
+    if (h->magic != PERSIST_MAGIC || h->version != PERSIST_VERSION ||
+        h->slot_size != PERSIST_SLOT_SIZE || h->program_hash != ps->program_hash) {
+        // A new file (openPersistentState checked any existing one), or
+        // another program's: start it over.
+        memset(ps->map, 0, PERSIST_FILE_SIZE);
+        h->magic = PERSIST_MAGIC;
+        h->version = PERSIST_VERSION;
+        h->slot_size = PERSIST_SLOT_SIZE;
+        h->program_hash = ps->program_hash;
+        ps->generation = 0;
+        return 0;
+    }
+    Chip8 *candidates = allocChip8(2 * sizeof(Chip8));
+    if (!candidates) {
+        // Resume nothing, but commit after the newest slot so it survives.
+        fprintf(stderr, "Out of memory resuming state file\n");
+        uint64_t g0 = slot(ps, 0)->generation, g1 = slot(ps, 1)->generation;
+        ps->generation = g0 > g1 ? g0 : g1;
+        return 0;
+    }
+    uint64_t g0 = validSlot(ps, 0, &candidates[0]);
+    uint64_t g1 = validSlot(ps, 1, &candidates[1]);
+    int best = g1 > g0;
+    ps->generation = best ? g1 : g0;
+    if (ps->generation)
+        *chip8 = candidates[best];
+    free(candidates);
+    return ps->generation;
+}
+
+uint64_t commitPersistentState(PersistentState *ps, const Chip8 *chip8) {
+    uint64_t generation = ps->generation + 1;
+    // Slot generation & 1 holds either nothing or the frame before last.
+    PersistSlot *s = slot(ps, generation & 1);
+    s->generation = 0;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    saveState(chip8, s->state, sizeof(s->state));
+    s->checksum = hashState(chip8);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    s->generation = generation;
+    ps->generation = generation;
+    if (ps->sync_frames > 0 && ++ps->since_sync >= ps->sync_frames) {
+        msync(ps->map, PERSIST_FILE_SIZE, MS_SYNC);
+        ps->since_sync = 0;
+    }
+    return generation;
+}
+
+void closePersistentState(PersistentState *ps) {
+    if (!ps)
+        return;
+    msync(ps->map, PERSIST_FILE_SIZE, MS_SYNC);
+    munmap(ps->map, PERSIST_FILE_SIZE);
+    close(ps->fd);
+    free(ps);
+}
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int runPersistentRun(const char *rom_path, const char *state_path, int frames, int cycles_per_frame) {
+    Chip8 *chip8 = allocChip8(sizeof(Chip8));
+    if (!chip8) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    initializeChip8(chip8);
+    if (!loadROM(chip8, rom_path)) {
+        free(chip8);
+        return 1;
+    }
+    PersistentState *ps = openPersistentState(state_path, hashProgram(chip8), 60);
+    if (!ps) {
+        free(chip8);
+        return 1;
+    }
+    double t0 = nowSeconds();
+    uint64_t generation = resumePersistentState(ps, chip8);
+    double resume = nowSeconds() - t0;
+    if (generation)
+        printf("resumed:   frame %llu in %.1f us\n", (unsigned long long)generation, resume * 1e6);
+    else
+        printf("resumed:   nothing, starting fresh\n");
+
+    double run = 0, commit = 0;
+    for (uint64_t f = generation; f < (uint64_t)frames && !chip8->halted; f++) {
+        double a = nowSeconds();
+        runFrame(chip8, cycles_per_frame);
+        double b = nowSeconds();
+        commitPersistentState(ps, chip8);
+        run += b - a;
+        commit += nowSeconds() - b;
+    }
+    uint64_t done = ps->generation - generation;
+    printf("ran:       %llu frames to frame %llu\n", (unsigned long long)done,
+           (unsigned long long)ps->generation);
+    if (done)
+        printf("per frame: %.2f us emulating, %.2f us committing (sync every 60 frames)\n",
+               run * 1e6 / done, commit * 1e6 / done);
+    printf("state:     %016llx\n", (unsigned long long)hashState(chip8));
+    closePersistentState(ps);
+    free(chip8);
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include <stdint.h>
+#include "chip8.h"
+
+// Crash-safe machine state in a memory-mapped file.
+//
+// The file holds a header and two state slots, each on its own pages. At
+// every frame boundary the machine is committed to the slot that doesn't
+// hold the latest frame: the slot's generation is cleared, the state and
+// its checksum are written, and then the new generation is stored. The
+// mapping is shared, so once the stores are done the frame survives a
+// crash of the process. msync every `sync_frames` commits (and on close)
+// also makes it survive a crash of the machine. A commit interrupted
+// halfway leaves the other slot intact, so resuming always finds the
+// last complete frame.
+
+typedef struct PersistentState PersistentState;
+
+// Open or create a state file for the program identified by program_hash
+// (see hashProgram). A missing or empty file becomes a new state file; any
+// other file must already be one, or NULL is returned and it is left
+// untouched. sync_frames <= 0 syncs only on close.
+PersistentState *openPersistentState(const char *path, uint64_t program_hash, int sync_frames);
+// Restore the newest complete frame into chip8. Returns its generation, or
+// 0 (leaving chip8 alone) when the file is new, for another program (its
+// slots are then cleared), or holds no valid frame.
+uint64_t resumePersistentState(PersistentState *ps, Chip8 *chip8);
+// Commit a frame. Returns its generation.
+uint64_t commitPersistentState(PersistentState *ps, const Chip8 *chip8);
+void closePersistentState(PersistentState *ps);
+
+// Run a ROM headless for `frames` frames with a commit after each, resuming
+// from state_path if it holds a frame, and report the final state hash and
+// the cost of committing.
+int runPersistentRun(const char *rom_path, const char *state_path, int frames, int cycles_per_frame);
+
+#endif
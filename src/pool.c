@@ -0,0 +1,386 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "pool.h"
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+typedef struct Arena {
+    struct Arena *next;
+    uint8_t *base;
+    size_t used;
+} Arena;
+
+struct InstancePool {
+    PoolPages pages;
+    Arena *arenas;   // Newest first; machines come from the head.
+    Chip8 *free_list; // Linked through each machine's first bytes.
+    PoolStats stats;
+};
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+const char *poolPagesName(PoolPages pages) {
+    switch (pages) {
+        case POOL_THP:     return "THP";
+        case POOL_HUGETLB: return "hugetlb";
+        default:           return "4K pages";
+    }
+}
+
+InstancePool *createInstancePool(PoolPages pages, int node) {
+    InstancePool *pool = calloc(1, sizeof(InstancePool));
+    if (!pool)
+        return NULL;
+    pool->pages = pages;
+    pool->stats.node = node;
+    return pool;
+}
+
+// Map POOL_ARENA_SIZE bytes on a 2 MB boundary, so THP can back all of it.
+static uint8_t *mapAligned(void) {
+    size_t len = POOL_ARENA_SIZE + POOL_HUGE_PAGE;
+    uint8_t *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    uintptr_t start = ((uintptr_t)p + POOL_HUGE_PAGE - 1) & ~(uintptr_t)(POOL_HUGE_PAGE - 1);
+    size_t head = start - (uintptr_t)p;
+    if (head)
+        munmap(p, head);
+    if (len - head > POOL_ARENA_SIZE)
+        munmap((uint8_t *)start + POOL_ARENA_SIZE, len - head - POOL_ARENA_SIZE);
+    return (uint8_t *)start;
+}
+
+static Arena *addArena(InstancePool *pool) {
+    Arena *arena = calloc(1, sizeof(Arena));
+    if (!arena)
+        return NULL;
+    if (pool->pages == POOL_HUGETLB) {
+        void *p = mmap(NULL, POOL_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            arena->base = p;
+            pool->stats.hugetlb_arenas++;
+        }
+    }
+    if (!arena->base) {
+        arena->base = mapAligned();
+        if (!arena->base) {
+            free(arena);
+            return NULL;
+        }
+        madvise(arena->base, POOL_ARENA_SIZE,
+                pool->pages == POOL_SMALL ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+    }
+    // Bind before anything touches the arena; placement happens on first
+    // touch.
+    if (pool->stats.node >= 0 && pool->stats.node < (int)(8 * sizeof(unsigned long))) {
+        unsigned long mask = 1ul << pool->stats.node;
+        pool->stats.node_bound = syscall(SYS_mbind, arena->base, POOL_ARENA_SIZE, MPOL_PREFERRED,
+                                         &mask, 8 * sizeof(mask), 0) == 0;
+    }
+    arena->next = pool->arenas;
+    pool->arenas = arena;
+    pool->stats.arenas++;
+    pool->stats.mapped += POOL_ARENA_SIZE;
+    return arena;
+}
+
+Chip8 *poolAlloc(InstancePool *pool) {
+    Chip8 *chip8 = pool->free_list;
+    if (chip8) {
+        memcpy(&pool->free_list, chip8, sizeof(Chip8 *));
+        memset(chip8, 0, sizeof(Chip8));
+    } else {
+        Arena *arena = pool->arenas;
+        if (!arena || arena->used + sizeof(Chip8) > POOL_ARENA_SIZE)
+            arena = addArena(pool);
+        if (!arena)
+            return NULL;
+        // Fresh anonymous memory is already zero.
+        chip8 = (Chip8 *)(arena->base + arena->used);
+        arena->used += sizeof(Chip8);
+    }
+    pool->stats.instances++;
+    return chip8;
+}
+
+void poolFree(InstancePool *pool, Chip8 *chip8) {
+    if (!chip8)
+        return;
+    memcpy(chip8, &pool->free_list, sizeof(Chip8 *));
+    pool->free_list = chip8;
+    pool->stats.instances--;
+}
+
+void destroyInstancePool(InstancePool *pool) {
+    if (!pool)
+        return;
+    while (pool->arenas) {
+        Arena *arena = pool->arenas;
+        pool->arenas = arena->next;
+        munmap(arena->base, POOL_ARENA_SIZE);
+        free(arena);
+    }
+    free(pool);
+}
+
+void getPoolStats(const InstancePool *pool, PoolStats *stats) {
+    *stats = pool->stats;
+}
+
+// ---- Benchmark ----
+
+enum { BENCH_MALLOC = -1 };
+
+typedef struct {
+    int mode; // BENCH_MALLOC or a PoolPages.
+    int node; // -1 unless NUMA placement was asked for.
+    int first, count;
+    const Chip8 *loaded;
+    Chip8 **machines;
+    InstancePool *pool;
+    int frames;
+    int shuffle;
+    double seconds;
+} BenchWorker;
+
+static size_t residentBytes(void) {
+    FILE *f = fopen("/proc/self/statm", "r");
+    unsigned long size = 0, resident = 0;
+    if (f) {
+        if (fscanf(f, "%lu %lu", &size, &resident) != 2)
+            resident = 0;
+        fclose(f);
+    }
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+// Bytes of this process's memory backed by transparent huge pages.
+static size_t anonHugeBytes(void) {
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    char line[256];
+    size_t kb = 0;
+    if (!f)
+        return 0;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1)
+            break;
+    fclose(f);
+    return kb << 10;
+}
+
+static int numaNodes(void) {
+    FILE *f = fopen("/sys/devices/system/node/online", "r");
+    int first = 0, last = 0;
+    if (!f)
+        return 1;
+    int n = fscanf(f, "%d-%d", &first, &last);
+    fclose(f);
+    return n == 2 ? last + 1 : 1;
+}
+
+// Run the calling thread on the CPUs of `node` ("0-3,8-11" in sysfs).
+static void pinToNode(int node) {
+    char path[64], list[1024];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return;
+    if (!fgets(list, sizeof(list), f)) {
+        fclose(f);
+        return;
+    }
+    fclose(f);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    char *p = list;
+    while (*p >= '0' && *p <= '9') {
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (*end == '-')
+            hi = strtol(end + 1, &end, 10);
+        for (long c = lo; c <= hi && c < CPU_SETSIZE; c++)
+            CPU_SET(c, &set);
+        p = *end == ',' ? end + 1 : end;
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+// Allocate and initialize on the worker's own thread, so first touch puts
+// each machine on the worker's node.
+static void *allocWorker(void *arg) {
+    BenchWorker *w = arg;
+    if (w->node >= 0)
+        pinToNode(w->node);
+    if (w->mode != BENCH_MALLOC)
+        w->pool = createInstancePool((PoolPages)w->mode, w->node);
+    for (int i = 0; i < w->count; i++) {
+        Chip8 *chip8 = w->mode == BENCH_MALLOC ? allocChip8(sizeof(Chip8)) : poolAlloc(w->pool);
+        if (!chip8) {
+            w->count = i;
+            break;
+        }
+        *chip8 = *w->loaded;
+        seedChip8(chip8, w->first + i + 1);
+        w->machines[w->first + i] = chip8;
+    }
+    return NULL;
+}
+
+static void *stepWorker(void *arg) {
+    BenchWorker *w = arg;
+    if (w->node >= 0)
+        pinToNode(w->node);
+    // A scheduler visits machines in no particular order, which is where
+    // the TLB hurts: memory order lets the prefetchers hide page walks.
+    if (w->shuffle) {
+        uint32_t rng = 0x2545F491;
+        for (int i = w->count - 1; i > 0; i--) {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            int j = (int)(rng % (uint32_t)(i + 1));
+            Chip8 *tmp = w->machines[w->first + i];
+            w->machines[w->first + i] = w->machines[w->first + j];
+            w->machines[w->first + j] = tmp;
+        }
+    }
+    double start = nowSeconds();
+    for (int f = 0; f < w->frames; f++)
+        for (int i = w->first; i < w->first + w->count; i++)
+            runFrame(w->machines[i], DEFAULT_CYCLES_PER_FRAME);
+    w->seconds = nowSeconds() - start;
+    return NULL;
+}
+
+static void runWorkers(BenchWorker *workers, int threads, void *(*fn)(void *)) {
+    pthread_t tids[256];
+    for (int t = 0; t < threads; t++)
+        pthread_create(&tids[t], NULL, fn, &workers[t]);
+    for (int t = 0; t < threads; t++)
+        pthread_join(tids[t], NULL);
+}
+
+int runPoolBench(const char *rom_path, int instances, int frames, int threads, int numa) {
+    if (instances <= 0)
+        instances = 100000;
+    if (frames <= 0)
+        frames = 60;
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+        threads = 1;
+    if (threads > 256)
+        threads = 256;
+    Chip8 *loaded = allocChip8(sizeof(Chip8));
+    Chip8 **machines = calloc(instances, sizeof(Chip8 *));
+    BenchWorker *workers = calloc(threads, sizeof(BenchWorker));
+    if (!loaded || !machines || !workers) {
+        fprintf(stderr, "Out of memory\n");
+        free(loaded);
+        free(machines);
+        free(workers);
+        return 1;
+    }
+    initializeChip8(loaded);
+    if (!loadROM(loaded, rom_path)) {
+        free(loaded);
+        free(machines);
+        free(workers);
+        return 1;
+    }
+    int nodes = numa ? numaNodes() : 0;
+
+    printf("%d instances of %zu bytes, %d frames, %d thread%s%s\n", instances, sizeof(Chip8),
+           frames, threads, threads == 1 ? "" : "s",
+           numa ? (nodes > 1 ? ", node-local" : ", node-local (1 node)") : "");
+    printf("%-10s %9s %9s %10s %6s %14s %14s\n", "allocator", "alloc ms", "MB", "inst/GB",
+           "huge", "steps/s order", "steps/s random");
+    const int modes[] = { BENCH_MALLOC, POOL_SMALL, POOL_THP, POOL_HUGETLB };
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        size_t rss = residentBytes(), thp = anonHugeBytes();
+        for (int t = 0; t < threads; t++) {
+            BenchWorker *w = &workers[t];
+            memset(w, 0, sizeof(*w));
+            w->mode = modes[m];
+            w->node = numa ? t % nodes : -1;
+            w->first = (int)((long long)instances * t / threads);
+            w->count = (int)((long long)instances * (t + 1) / threads) - w->first;
+            w->loaded = loaded;
+            w->machines = machines;
+            w->frames = frames;
+        }
+        double start = nowSeconds();
+        runWorkers(workers, threads, allocWorker);
+        double alloc_seconds = nowSeconds() - start;
+
+        int allocated = 0;
+        size_t hugetlb = 0;
+        for (int t = 0; t < threads; t++) {
+            allocated += workers[t].count;
+            if (workers[t].pool) {
+                PoolStats st;
+                getPoolStats(workers[t].pool, &st);
+                hugetlb += st.hugetlb_arenas * (size_t)POOL_ARENA_SIZE;
+            }
+        }
+        // Reserved huge pages don't show up in the resident set.
+        size_t used = residentBytes() - rss + hugetlb;
+        size_t huge = anonHugeBytes() - thp + hugetlb;
+
+        // Step in memory order, then shuffled; best of three each.
+        double step_seconds[2] = { 0, 0 };
+        for (int run = 0; run < 6 && allocated == instances; run++) {
+            int shuffle = run / 3;
+            double slowest = 0;
+            for (int t = 0; t < threads; t++)
+                workers[t].shuffle = shuffle && run == 3;
+            runWorkers(workers, threads, stepWorker);
+            for (int t = 0; t < threads; t++)
+                if (workers[t].seconds > slowest)
+                    slowest = workers[t].seconds;
+            if (step_seconds[shuffle] == 0 || slowest < step_seconds[shuffle])
+                step_seconds[shuffle] = slowest;
+        }
+
+        const char *name = modes[m] == BENCH_MALLOC ? "malloc" : poolPagesName(modes[m]);
+        if (allocated < instances)
+            printf("%-10s out of memory after %d instances\n", name, allocated);
+        else if (modes[m] == POOL_HUGETLB && hugetlb == 0)
+            printf("%-10s no reserved huge pages (see vm.nr_hugepages); fell back to THP\n", name);
+        else
+            printf("%-10s %9.1f %9.1f %10.0f %5.0f%% %14.0f %14.0f\n", name, alloc_seconds * 1e3,
+                   used / 1048576.0, used ? instances / (used / 1073741824.0) : 0.0,
+                   used ? 100.0 * huge / used : 0.0,
+                   step_seconds[0] > 0 ? (double)instances * frames / step_seconds[0] : 0.0,
+                   step_seconds[1] > 0 ? (double)instances * frames / step_seconds[1] : 0.0);
+
+        for (int t = 0; t < threads; t++) {
+            BenchWorker *w = &workers[t];
+            if (w->mode == BENCH_MALLOC)
+                for (int i = w->first; i < w->first + w->count; i++)
+                    free(machines[i]);
+            destroyInstancePool(w->pool);
+        }
+    }
+    free(loaded);
+    free(machines);
+    free(workers);
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include "chip8.h"
+
+// Instance pools. Machines are carved back to back from large arenas
+// aligned to 2 MB, so with huge pages a step touches a few TLB entries
+// per hundred machines rather than three per machine. Arenas are
+// allocated as the pool grows and only released with the pool. Freed
+// machines go on a free list for reuse.
+//
+// POOL_HUGETLB asks for reserved huge pages (vm.nr_hugepages) and falls
+// back to POOL_THP when none are left. POOL_THP maps normally and advises
+// transparent huge pages. POOL_SMALL opts out of them, as a baseline.
+// A pool may be tied to a NUMA node, which then holds all its arenas.
+// A pool is not thread-safe: give each worker its own.
+
+#define POOL_HUGE_PAGE   (2u << 20)
+#define POOL_ARENA_SIZE  (16 * POOL_HUGE_PAGE)
+
+typedef enum { POOL_SMALL, POOL_THP, POOL_HUGETLB } PoolPages;
+
+typedef struct InstancePool InstancePool;
+
+typedef struct {
+    size_t instances;      // Allocated and not freed.
+    size_t arenas;
+    size_t mapped;         // Bytes of arena address space.
+    size_t hugetlb_arenas; // Arenas that got reserved huge pages.
+    int node;              // NUMA node, or -1.
+    int node_bound;        // The kernel accepted the node binding.
+} PoolStats;
+
+// node < 0 leaves placement to the kernel.
+InstancePool *createInstancePool(PoolPages pages, int node);
+void destroyInstancePool(InstancePool *pool);
+// A zeroed machine, or NULL when out of memory.
+Chip8 *poolAlloc(InstancePool *pool);
+void poolFree(InstancePool *pool, Chip8 *chip8);
+void getPoolStats(const InstancePool *pool, PoolStats *stats);
+const char *poolPagesName(PoolPages pages);
+
+// Allocate and step `instances` machines round-robin with each allocator,
+// reporting memory per instance and steps per second.
+int runPoolBench(const char *rom_path, int instances, int frames, int threads, int numa);
+
+#endif
@@ -0,0 +1,300 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "realtime.h"
+#include "chip8.h"
+
+#define FRAME_NS     (1000000000ull / 60)
+#define TICK_NS      1000000ull // Wheel resolution: 1 ms.
+#define WHEEL_BITS   8
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 3          // 256 ms, 65 s and 4.6 h horizons.
+
+typedef struct Session {
+    Chip8 chip8;
+    struct Session *next; // Wheel slot list.
+    uint64_t due_ns;      // When the next frame should start.
+    uint64_t due_tick;
+    uint64_t frames;
+    uint64_t missed;
+    uint64_t max_late_ns;
+    int id;
+} Session;
+
+// Sessions hang off the slot for their due tick, on the level whose span
+// covers the distance from now; higher levels cascade down as the lower
+// level wraps, the way kernel timer wheels work.
+typedef struct {
+    Session *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t now_tick;
+} TimingWheel;
+
+typedef struct {
+    pthread_t tid;
+    int index;
+    Session **sessions;
+    int count;
+    int stop_fd;
+    TimingWheel wheel;
+    double cpu_seconds;
+    uint64_t frames;
+} HostThread;
+
+static struct {
+    uint64_t start_ns;
+    int cycles_per_frame;
+} host;
+
+static uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t tickFor(uint64_t ns) {
+    return ns <= host.start_ns ? 0 : (ns - host.start_ns + TICK_NS - 1) / TICK_NS;
+}
+
+// File a session no earlier than tick `earliest`. A level-l slot is only
+// used once the due tick leaves the current level-l block, so cascading a
+// slot always lands its sessions strictly lower.
+static void wheelInsert(TimingWheel *w, Session *s, uint64_t earliest) {
+    uint64_t tick = s->due_tick > earliest ? s->due_tick : earliest;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 &&
+           (tick >> (WHEEL_BITS * (level + 1))) != (w->now_tick >> (WHEEL_BITS * (level + 1))))
+        level++;
+    Session **slot = &w->slots[level][(tick >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    s->next = *slot;
+    *slot = s;
+}
+
+// Run one due session and schedule its next frame.
+static void runSession(HostThread *t, Session *s) {
+    uint64_t start = nowNs();
+    if (start > s->due_ns && start - s->due_ns > s->max_late_ns)
+        s->max_late_ns = start - s->due_ns;
+    runFrame(&s->chip8, host.cycles_per_frame);
+    s->frames++;
+    t->frames++;
+    s->due_ns += FRAME_NS;
+    // Couldn't start before the next frame was due: drop what was missed.
+    if (start >= s->due_ns) {
+        uint64_t behind = (start - s->due_ns) / FRAME_NS + 1;
+        s->missed += behind;
+        s->due_ns += behind * FRAME_NS;
+    }
+    s->due_tick = tickFor(s->due_ns);
+    // The current slot has already been taken, so anything due now waits
+    // for the next tick.
+    wheelInsert(&t->wheel, s, t->wheel.now_tick + 1);
+}
+
+static void cascade(TimingWheel *w, int level) {
+    Session **slot = &w->slots[level][(w->now_tick >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    Session *s = *slot;
+    *slot = NULL;
+    while (s) {
+        Session *next = s->next;
+        wheelInsert(w, s, w->now_tick);
+        s = next;
+    }
+}
+
+static void advanceWheel(HostThread *t, uint64_t target) {
+    TimingWheel *w = &t->wheel;
+    while (w->now_tick < target) {
+        w->now_tick++;
+        for (int level = 1; level < WHEEL_LEVELS; level++) {
+            if (w->now_tick & ((1ull << (WHEEL_BITS * level)) - 1))
+                break;
+            cascade(w, level);
+        }
+        Session **slot = &w->slots[0][w->now_tick & WHEEL_MASK];
+        Session *s = *slot;
+        *slot = NULL;
+        while (s) {
+            Session *next = s->next;
+            runSession(t, s);
+            s = next;
+        }
+    }
+}
+
+static void *hostThread(void *arg) {
+    HostThread *t = arg;
+    int epfd = epoll_create1(0);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    struct itimerspec period = {
+        .it_interval = { 0, TICK_NS },
+        .it_value = { 0, TICK_NS },
+    };
+    timerfd_settime(tfd, 0, &period, NULL);
+    struct epoll_event ev = { .events = EPOLLIN };
+    ev.data.fd = tfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+    ev.data.fd = t->stop_fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, t->stop_fd, &ev);
+
+    for (int i = 0; i < t->count; i++)
+        wheelInsert(&t->wheel, t->sessions[i], 1);
+
+    int running = 1;
+    while (running) {
+        struct epoll_event events[2];
+        int n = epoll_wait(epfd, events, 2, -1);
+        if (n < 0 && errno != EINTR)
+            break;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == t->stop_fd) {
+                running = 0;
+            } else {
+                uint64_t expirations;
+                if (read(tfd, &expirations, sizeof(expirations)) < 0)
+                    continue;
+                // Ticks are derived from the clock, so expirations that
+                // piled up while a tick overran are simply caught up.
+                advanceWheel(t, (nowNs() - host.start_ns) / TICK_NS);
+            }
+        }
+    }
+
+    struct timespec cpu;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    t->cpu_seconds = cpu.tv_sec + cpu.tv_nsec / 1e9;
+    close(tfd);
+    close(epfd);
+    return NULL;
+}
+
+static int byMissed(const void *a, const void *b) {
+    const Session *x = *(Session *const *)a, *y = *(Session *const *)b;
+    if (x->missed != y->missed)
+        return x->missed < y->missed ? 1 : -1;
+    return x->max_late_ns < y->max_late_ns ? 1 : x->max_late_ns > y->max_late_ns ? -1 : 0;
+}
+
+int runRealtimeHost(const char *rom_path, int sessions, int threads, double seconds,
+                    const char *report_path) {
+    if (sessions <= 0)
+        sessions = 1;
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > sessions)
+        threads = sessions;
+    host.cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+
+    int status = 1, stop_fd = -1;
+    Session *pool = allocChip8((size_t)sessions * sizeof(Session));
+    Session **order = malloc(sessions * sizeof(Session *));
+    HostThread *hts = allocChip8(threads * sizeof(HostThread));
+    if (!pool || !order || !hts) {
+        fprintf(stderr, "Out of memory for %d sessions\n", sessions);
+        goto done;
+    }
+    initializeChip8(&pool[0].chip8);
+    if (!loadROM(&pool[0].chip8, rom_path))
+        goto done;
+    for (int i = 1; i < sessions; i++)
+        pool[i].chip8 = pool[0].chip8;
+
+    stop_fd = eventfd(0, 0);
+    if (stop_fd < 0) {
+        perror("eventfd");
+        goto done;
+    }
+    for (int t = 0; t < threads; t++) {
+        hts[t].index = t;
+        hts[t].stop_fd = stop_fd;
+        hts[t].sessions = malloc(((sessions + threads - 1) / threads) * sizeof(Session *));
+        if (!hts[t].sessions) {
+            fprintf(stderr, "Out of memory for %d sessions\n", sessions);
+            goto done;
+        }
+    }
+    host.start_ns = nowNs();
+    for (int i = 0; i < sessions; i++) {
+        Session *s = &pool[i];
+        s->id = i;
+        seedChip8(&s->chip8, i + 1);
+        // Spread phases so every tick carries the same load.
+        s->due_ns = host.start_ns + FRAME_NS + (uint64_t)i * FRAME_NS / sessions;
+        s->due_tick = tickFor(s->due_ns);
+        HostThread *t = &hts[i % threads];
+        t->sessions[t->count++] = s;
+        order[i] = s;
+    }
+    for (int t = 0; t < threads; t++)
+        pthread_create(&hts[t].tid, NULL, hostThread, &hts[t]);
+
+    struct timespec run = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9) };
+    while (nanosleep(&run, &run) != 0 && errno == EINTR)
+        ;
+    uint64_t one = 1;
+    if (write(stop_fd, &one, sizeof(one)) < 0)
+        perror("eventfd");
+    for (int t = 0; t < threads; t++)
+        pthread_join(hts[t].tid, NULL);
+    double elapsed = (nowNs() - host.start_ns) / 1e9;
+
+    uint64_t frames = 0, missed = 0, worst = 0;
+    int late_sessions = 0;
+    for (int i = 0; i < sessions; i++) {
+        frames += pool[i].frames;
+        missed += pool[i].missed;
+        late_sessions += pool[i].missed > 0;
+        if (pool[i].max_late_ns > worst)
+            worst = pool[i].max_late_ns;
+    }
+    printf("realtime host: %d sessions on %d threads for %.2f s at 60 Hz\n",
+           sessions, threads, elapsed);
+    printf("frames:        %llu (%.0f/s), %llu missed (%.3f%%) in %d sessions\n",
+           (unsigned long long)frames, frames / elapsed, (unsigned long long)missed,
+           frames + missed ? 100.0 * missed / (frames + missed) : 0.0, late_sessions);
+    printf("worst start:   %.2f ms after due\n", worst / 1e6);
+    for (int t = 0; t < threads; t++)
+        printf("thread %-3d     %d sessions, %llu frames, %.1f%% CPU\n", t, hts[t].count,
+               (unsigned long long)hts[t].frames, 100.0 * hts[t].cpu_seconds / elapsed);
+
+    qsort(order, sessions, sizeof(Session *), byMissed);
+    if (order[0]->missed) {
+        printf("sessions with the most missed deadlines:\n");
+        for (int i = 0; i < sessions && i < 10 && order[i]->missed; i++)
+            printf("  session %-6d %llu frames, %llu missed, worst start %.2f ms late\n",
+                   order[i]->id, (unsigned long long)order[i]->frames,
+                   (unsigned long long)order[i]->missed, order[i]->max_late_ns / 1e6);
+    }
+    if (report_path) {
+        FILE *f = fopen(report_path, "w");
+        if (!f) {
+            perror("Failed to open report file");
+        } else {
+            fprintf(f, "session,frames,missed,max_late_ms\n");
+            for (int i = 0; i < sessions; i++)
+                fprintf(f, "%d,%llu,%llu,%.3f\n", i, (unsigned long long)pool[i].frames,
+                        (unsigned long long)pool[i].missed, pool[i].max_late_ns / 1e6);
+            fclose(f);
+        }
+    }
+
+    status = 0;
+
+done:
+    if (stop_fd >= 0)
+        close(stop_fd);
+    for (int t = 0; hts && t < threads; t++)
+        free(hts[t].sessions);
+    free(hts);
+    free(order);
+    free(pool);
+    return status;
+}
@@ -0,0 +1,20 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+// Real-time host for many paced sessions on a few threads. Each thread owns
+// a share of the sessions and a hierarchical timing wheel with 1 ms ticks,
+// driven by a periodic timerfd in an epoll loop. A session runs one frame
+// whenever it is due (60 Hz, phases spread across the period), so idle
+// sessions cost nothing between frames.
+//
+// A frame misses its deadline when it can't start before the next one is
+// due; hosts that fall behind drop frames rather than burst to catch up,
+// and every dropped frame counts as missed.
+//
+// Runs `sessions` copies of the ROM for `seconds`, then reports schedule
+// adherence, per-thread load and the worst sessions; report_path, if set,
+// receives a CSV row per session.
+int runRealtimeHost(const char *rom_path, int sessions, int threads, double seconds,
+                    const char *report_path);
+
+#endif
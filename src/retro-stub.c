@@ -0,0 +1,226 @@
+#define _POSIX_C_SOURCE 200809L
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libretro.h"
+
+// A headless libretro frontend: loads a core, feeds it scripted input,
+// checks what it produces and measures how fast retro_run goes.
+
+#define LOAD_SYM(name)                                                   \
+    do {                                                                 \
+        *(void **)(&core.name) = dlsym(handle, #name);                   \
+        if (!core.name) {                                                \
+            fprintf(stderr, "Core is missing %s\n", #name);              \
+            return 1;                                                    \
+        }                                                                \
+    } while (0)
+
+static struct {
+    void (*retro_set_environment)(retro_environment_t);
+    void (*retro_set_video_refresh)(retro_video_refresh_t);
+    void (*retro_set_audio_sample)(retro_audio_sample_t);
+    void (*retro_set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*retro_set_input_poll)(retro_input_poll_t);
+    void (*retro_set_input_state)(retro_input_state_t);
+    void (*retro_init)(void);
+    void (*retro_deinit)(void);
+    unsigned (*retro_api_version)(void);
+    void (*retro_get_system_info)(struct retro_system_info *);
+    void (*retro_get_system_av_info)(struct retro_system_av_info *);
+    void (*retro_run)(void);
+    size_t (*retro_serialize_size)(void);
+    bool (*retro_serialize)(void *, size_t);
+    bool (*retro_unserialize)(const void *, size_t);
+    bool (*retro_load_game)(const struct retro_game_info *);
+    void (*retro_unload_game)(void);
+} core;
+
+static enum retro_pixel_format pixel_format = RETRO_PIXEL_FORMAT_0RGB1555;
+static unsigned long frame_count = 0;
+static unsigned long audio_frames = 0;
+static unsigned long input_polls = 0;
+static uint64_t frame_hash = 0;
+
+static bool environment(unsigned cmd, void *data) {
+    switch (cmd) {
+        case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+            pixel_format = *(const enum retro_pixel_format *)data;
+            return pixel_format == RETRO_PIXEL_FORMAT_XRGB8888;
+        case RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// FNV-1a over the visible rows, chained across frames.
+static void videoRefresh(const void *data, unsigned width, unsigned height, size_t pitch) {
+    frame_count++;
+    if (!data)
+        return;
+    uint64_t h = frame_hash ^ 14695981039346656037ull;
+    for (unsigned y = 0; y < height; y++) {
+        const uint8_t *row = (const uint8_t *)data + y * pitch;
+        for (unsigned x = 0; x < width * 4; x++)
+            h = (h ^ row[x]) * 1099511628211ull;
+    }
+    frame_hash = h;
+}
+
+static void audioSample(int16_t left, int16_t right) {
+    (void)left;
+    (void)right;
+    audio_frames++;
+}
+
+static size_t audioSampleBatch(const int16_t *data, size_t frames) {
+    (void)data;
+    audio_frames += frames;
+    return frames;
+}
+
+static void inputPoll(void) {
+    input_polls++;
+}
+
+// Scripted input: tap joypad A (key 5) for 5 frames out of every 30, and
+// hold keyboard '1' every other second.
+static int16_t inputState(unsigned port, unsigned device, unsigned index, unsigned id) {
+    (void)index;
+    if (port != 0)
+        return 0;
+    if (device == RETRO_DEVICE_JOYPAD && id == RETRO_DEVICE_ID_JOYPAD_A)
+        return frame_count % 30 < 5;
+    if (device == RETRO_DEVICE_KEYBOARD && id == RETROK_1)
+        return (frame_count / 60) % 2;
+    return 0;
+}
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *readFile(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror("Failed to open ROM");
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    rewind(f);
+    void *buf = malloc(len > 0 ? len : 1);
+    *size = buf ? fread(buf, 1, len, f) : 0;
+    fclose(f);
+    return buf;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <core.so> <ROM file> [frames]\n", argv[0]);
+        return 1;
+    }
+    long frames = argc > 3 ? atol(argv[3]) : 100000;
+
+    void *handle = dlopen(argv[1], RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        fprintf(stderr, "Failed to load core: %s\n", dlerror());
+        return 1;
+    }
+    LOAD_SYM(retro_set_environment);
+    LOAD_SYM(retro_set_video_refresh);
+    LOAD_SYM(retro_set_audio_sample);
+    LOAD_SYM(retro_set_audio_sample_batch);
+    LOAD_SYM(retro_set_input_poll);
+    LOAD_SYM(retro_set_input_state);
+    LOAD_SYM(retro_init);
+    LOAD_SYM(retro_deinit);
+    LOAD_SYM(retro_api_version);
+    LOAD_SYM(retro_get_system_info);
+    LOAD_SYM(retro_get_system_av_info);
+    LOAD_SYM(retro_run);
+    LOAD_SYM(retro_serialize_size);
+    LOAD_SYM(retro_serialize);
+    LOAD_SYM(retro_unserialize);
+    LOAD_SYM(retro_load_game);
+    LOAD_SYM(retro_unload_game);
+
+    if (core.retro_api_version() != RETRO_API_VERSION) {
+        fprintf(stderr, "Core API version mismatch\n");
+        return 1;
+    }
+    core.retro_set_environment(environment);
+    core.retro_set_video_refresh(videoRefresh);
+    core.retro_set_audio_sample(audioSample);
+    core.retro_set_audio_sample_batch(audioSampleBatch);
+    core.retro_set_input_poll(inputPoll);
+    core.retro_set_input_state(inputState);
+    core.retro_init();
+
+    struct retro_system_info sys;
+    struct retro_system_av_info av;
+    core.retro_get_system_info(&sys);
+
+    struct retro_game_info game;
+    memset(&game, 0, sizeof(game));
+    game.path = argv[2];
+    void *rom = readFile(argv[2], &game.size);
+    game.data = rom;
+    if (!rom || !core.retro_load_game(&game)) {
+        fprintf(stderr, "Core refused the game\n");
+        return 1;
+    }
+    core.retro_get_system_av_info(&av);
+    printf("core:        %s %s\n", sys.library_name, sys.library_version);
+    printf("pixel fmt:   %s\n", pixel_format == RETRO_PIXEL_FORMAT_XRGB8888 ? "XRGB8888" : "other");
+
+    double start = nowSeconds();
+    for (long i = 0; i < frames; i++)
+        core.retro_run();
+    double elapsed = nowSeconds() - start;
+    printf("retro_run:   %ld calls in %.3f s (%.0f/s, %.2f us each)\n",
+           frames, elapsed, frames / elapsed, elapsed * 1e6 / frames);
+    printf("video:       %lu frames\n", frame_count);
+    printf("audio:       %.1f stereo frames per run (expect %.1f)\n",
+           (double)audio_frames / frames, av.timing.sample_rate / av.timing.fps);
+
+    // Save state round trip: the same frames must come out after a rewind.
+    int status = 0;
+    size_t state_size = core.retro_serialize_size();
+    void *state = malloc(state_size);
+    if (!core.retro_serialize(state, state_size)) {
+        printf("serialize:   FAILED\n");
+        status = 1;
+    } else {
+        unsigned long saved_frames = frame_count;
+        frame_hash = 0;
+        for (int i = 0; i < 120; i++)
+            core.retro_run();
+        uint64_t first = frame_hash;
+        frame_count = saved_frames;
+        frame_hash = 0;
+        if (!core.retro_unserialize(state, state_size)) {
+            printf("unserialize: FAILED\n");
+            status = 1;
+        } else {
+            for (int i = 0; i < 120; i++)
+                core.retro_run();
+            printf("serialize:   %zu bytes, replay %s\n", state_size,
+                   frame_hash == first ? "matches" : "DIVERGES");
+            if (frame_hash != first)
+                status = 1;
+        }
+    }
+    free(state);
+
+    core.retro_unload_game();
+    core.retro_deinit();
+    free(rom);
+    dlclose(handle);
+    return status;
+}
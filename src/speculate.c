@@ -0,0 +1,142 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "speculate.h"
+
+enum { SLOT_QUEUED, SLOT_RUNNING, SLOT_DONE };
+
+typedef struct {
+    uint16_t mask;
+    int state;
+    Chip8 result;
+} SpecSlot;
+
+struct Speculator {
+    Chip8 base;   // The state every candidate starts from.
+    SpecSlot slots[SPECULATE_CANDIDATES];
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    uint64_t generation; // Bumped every frame; stale results are dropped.
+    int next;            // Next queued slot.
+    int cycles_per_frame;
+    int stop;
+    int threads;
+    pthread_t *tids;
+    SpeculatorStats stats;
+};
+
+// Each worker runs candidates on a private copy, so the lock is only held
+// to take a candidate and to publish its result.
+static void *specWorker(void *arg) {
+    Speculator *spec = arg;
+    Chip8 *chip8 = allocChip8(sizeof(Chip8));
+    pthread_mutex_lock(&spec->lock);
+    while (!spec->stop) {
+        if (spec->next >= SPECULATE_CANDIDATES) {
+            pthread_cond_wait(&spec->wake, &spec->lock);
+            continue;
+        }
+        int i = spec->next++;
+        uint64_t generation = spec->generation;
+        uint16_t mask = spec->slots[i].mask;
+        spec->slots[i].state = SLOT_RUNNING;
+        *chip8 = spec->base;
+        pthread_mutex_unlock(&spec->lock);
+
+        setKeyMask(chip8, mask);
+        runFrame(chip8, spec->cycles_per_frame);
+
+        pthread_mutex_lock(&spec->lock);
+        if (generation == spec->generation) {
+            spec->slots[i].result = *chip8;
+            spec->slots[i].state = SLOT_DONE;
+        }
+    }
+    pthread_mutex_unlock(&spec->lock);
+    free(chip8);
+    return NULL;
+}
+
+Speculator *createSpeculator(int threads, int cycles_per_frame) {
+    Speculator *spec = allocChip8(sizeof(Speculator));
+    if (!spec)
+        return NULL;
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (threads < 1)
+        threads = 1;
+    spec->threads = threads;
+    spec->cycles_per_frame = cycles_per_frame > 0 ? cycles_per_frame : DEFAULT_CYCLES_PER_FRAME;
+    spec->next = SPECULATE_CANDIDATES; // Nothing queued yet.
+    pthread_mutex_init(&spec->lock, NULL);
+    pthread_cond_init(&spec->wake, NULL);
+    spec->tids = calloc(threads, sizeof(pthread_t));
+    for (int t = 0; t < threads; t++)
+        pthread_create(&spec->tids[t], NULL, specWorker, spec);
+    return spec;
+}
+
+void destroySpeculator(Speculator *spec) {
+    if (!spec)
+        return;
+    pthread_mutex_lock(&spec->lock);
+    spec->stop = 1;
+    pthread_cond_broadcast(&spec->wake);
+    pthread_mutex_unlock(&spec->lock);
+    for (int t = 0; t < spec->threads; t++)
+        pthread_join(spec->tids[t], NULL);
+    pthread_mutex_destroy(&spec->lock);
+    pthread_cond_destroy(&spec->wake);
+    free(spec->tids);
+    free(spec);
+}
+
+void speculateFrame(Speculator *spec, const Chip8 *chip8) {
+    uint16_t held = getKeyMask(chip8);
+    pthread_mutex_lock(&spec->lock);
+    spec->base = *chip8;
+    spec->generation++;
+    // Most frames keep the same keys, so that candidate goes first.
+    spec->slots[0].mask = held;
+    spec->slots[0].state = SLOT_QUEUED;
+    for (int k = 0; k < 16; k++) {
+        spec->slots[k + 1].mask = held ^ (1u << k);
+        spec->slots[k + 1].state = SLOT_QUEUED;
+    }
+    spec->next = 0;
+    pthread_cond_broadcast(&spec->wake);
+    pthread_mutex_unlock(&spec->lock);
+}
+
+int commitFrame(Speculator *spec, Chip8 *chip8, uint16_t mask) {
+    int hit = 0;
+    pthread_mutex_lock(&spec->lock);
+    spec->stats.frames++;
+    int i = 0;
+    while (i < SPECULATE_CANDIDATES && spec->slots[i].mask != mask)
+        i++;
+    if (i == SPECULATE_CANDIDATES) {
+        spec->stats.unpredicted++;
+    } else if (spec->slots[i].state == SLOT_DONE) {
+        *chip8 = spec->slots[i].result;
+        spec->stats.hits++;
+        hit = 1;
+    } else {
+        spec->stats.late++;
+    }
+    // Nothing from this generation is needed any more.
+    spec->next = SPECULATE_CANDIDATES;
+    spec->generation++;
+    pthread_mutex_unlock(&spec->lock);
+    if (!hit) {
+        setKeyMask(chip8, mask);
+        runFrame(chip8, spec->cycles_per_frame);
+    }
+    return hit;
+}
+
+void getSpeculatorStats(const Speculator *spec, SpeculatorStats *stats) {
+    *stats = spec->stats;
+}
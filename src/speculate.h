@@ -0,0 +1,38 @@
+#ifndef SPECULATE_H
+#define SPECULATE_H
+
+#include <stdint.h>
+#include "chip8.h"
+
+// Speculative pre-simulation. After each frame the host hands the machine
+// to the speculator, whose worker threads run the next frame from a copy
+// for the likely inputs: the keys held now, and each single key pressed or
+// released. When the real input is known, a matching precomputed frame is
+// adopted instead of emulated, so the host can present right after reading
+// input.
+//
+// Frames are deterministic given the state and key mask, so an adopted
+// frame is exactly the one the host would have computed.
+
+#define SPECULATE_CANDIDATES 17 // The current mask plus 16 single-key toggles.
+
+typedef struct Speculator Speculator;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t hits;
+    uint64_t late;        // Input was predicted but not finished in time.
+    uint64_t unpredicted; // Input changed by more than one key.
+} SpeculatorStats;
+
+// threads <= 0 uses every CPU but one.
+Speculator *createSpeculator(int threads, int cycles_per_frame);
+void destroySpeculator(Speculator *spec);
+// Start simulating the frame after `chip8` for every candidate input.
+void speculateFrame(Speculator *spec, const Chip8 *chip8);
+// Advance `chip8` (the state last passed to speculateFrame) by one frame
+// with `mask` held. Returns 1 if a precomputed frame was used.
+int commitFrame(Speculator *spec, Chip8 *chip8, uint16_t mask);
+void getSpeculatorStats(const Speculator *spec, SpeculatorStats *stats);
+
+#endif
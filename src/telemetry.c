@@ -0,0 +1,532 @@
+#define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "telemetry.h"
+
+#define HEADER_SIZE 16
+#define WATCH_SIZE  20
+
+typedef struct {
+    uint8_t *columns[TELEMETRY_MAX_WATCHES];
+    uint32_t first_frame;
+    int frames;
+} Block;
+
+struct Telemetry {
+    Watch watches[TELEMETRY_MAX_WATCHES];
+    size_t offsets[TELEMETRY_MAX_WATCHES]; // Of 1-byte watches within Chip8.
+    int count;
+    int instances;
+    int block_frames;
+    int csv;
+    FILE *out;
+
+    Block blocks[2];
+    int filling;       // Block the sampler writes into.
+    int filled_frames; // Frames in it so far.
+    uint32_t frame;
+
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;       // Block handed to the writer, or -1.
+    int stop;
+    TelemetryStats stats;
+};
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ---- Watch list ----
+
+static int parseWatch(char *line, Watch *w) {
+    char name[64], where[32];
+    int width = 0;
+    if (sscanf(line, "%63s %31s %d", name, where, &width) < 2)
+        return 0;
+    memset(w, 0, sizeof(*w));
+    size_t len = strlen(name);
+    memcpy(w->name, name, len < TELEMETRY_NAME_SIZE ? len : TELEMETRY_NAME_SIZE - 1);
+    if ((where[0] == 'V' || where[0] == 'v') && isxdigit((unsigned char)where[1]) && !where[2]) {
+        w->kind = WATCH_REGISTER;
+        w->address = (uint16_t)strtol(where + 1, NULL, 16);
+        w->width = 1;
+    } else if (strcasecmp(where, "I") == 0) {
+        w->kind = WATCH_INDEX;
+        w->width = 2;
+    } else {
+        char *end;
+        long address = strtol(where, &end, 16);
+        if (*end || address < 0 || address >= MEMORY_SIZE)
+            return 0;
+        w->kind = WATCH_MEMORY;
+        w->address = (uint16_t)address;
+        w->width = 1;
+    }
+    if (width) {
+        if (w->kind != WATCH_MEMORY || (width != 1 && width != 2 && width != 4))
+            return 0;
+        w->width = (uint8_t)width;
+    }
+    return 1;
+}
+
+int loadWatchList(const char *path, Watch *watches, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[256];
+    int count = 0, lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        char *p = line;
+        while (isspace((unsigned char)*p))
+            p++;
+        if (!*p)
+            continue;
+        if (count == max || !parseWatch(p, &watches[count])) {
+            fprintf(stderr, "%s:%d: %s\n", path, lineno,
+                    count == max ? "too many watches" : "expected <name> <address|Vx|I> [1|2|4]");
+            fclose(f);
+            return -1;
+        }
+        count++;
+    }
+    fclose(f);
+    return count;
+}
+
+static uint32_t readWatch(const Chip8 *chip8, const Watch *w) {
+    switch (w->kind) {
+        case WATCH_REGISTER: return chip8->V[w->address & 0xF];
+        case WATCH_INDEX:    return chip8->I;
+        default: {
+            uint32_t value = 0;
+            for (int k = 0; k < w->width; k++)
+                value = value << 8 | chip8->memory[(w->address + k) & ADDRESS_MASK];
+            return value;
+        }
+    }
+}
+
+static void putU32(uint8_t *p, uint32_t value) {
+    for (int k = 0; k < 4; k++)
+        p[k] = value >> (8 * k) & 0xFF;
+}
+
+static uint32_t getU32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t columnValue(const uint8_t *column, int width, size_t row) {
+    const uint8_t *p = column + row * width;
+    uint32_t value = 0;
+    for (int k = width - 1; k >= 0; k--)
+        value = value << 8 | p[k];
+    return value;
+}
+
+// ---- Writer thread ----
+
+// Append a decimal number; snprintf per value would dominate CSV output.
+static char *putDecimal(char *p, uint32_t value) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (n)
+        *p++ = digits[--n];
+    return p;
+}
+
+static size_t writeCsvBlock(Telemetry *t, const Block *b) {
+    char line[32 + TELEMETRY_MAX_WATCHES * 12];
+    size_t bytes = 0;
+    for (int f = 0; f < b->frames; f++) {
+        for (int i = 0; i < t->instances; i++) {
+            size_t row = (size_t)f * t->instances + i;
+            char *p = putDecimal(line, b->first_frame + f);
+            *p++ = ',';
+            p = putDecimal(p, (uint32_t)i);
+            for (int w = 0; w < t->count; w++) {
+                *p++ = ',';
+                p = putDecimal(p, columnValue(b->columns[w], t->watches[w].width, row));
+            }
+            *p++ = '\n';
+            bytes += fwrite(line, 1, p - line, t->out);
+        }
+    }
+    return bytes;
+}
+
+static size_t writeBinaryBlock(Telemetry *t, const Block *b) {
+    uint8_t header[8];
+    putU32(header, b->first_frame);
+    putU32(header + 4, (uint32_t)b->frames);
+    size_t rows = (size_t)b->frames * t->instances;
+    size_t bytes = fwrite(header, 1, sizeof(header), t->out);
+    for (int w = 0; w < t->count; w++)
+        bytes += fwrite(b->columns[w], 1, rows * t->watches[w].width, t->out);
+    return bytes;
+}
+
+static void *writerThread(void *arg) {
+    Telemetry *t = arg;
+    pthread_mutex_lock(&t->lock);
+    for (;;) {
+        while (t->pending < 0 && !t->stop)
+            pthread_cond_wait(&t->cond, &t->lock);
+        if (t->pending < 0)
+            break;
+        Block *b = &t->blocks[t->pending];
+        pthread_mutex_unlock(&t->lock);
+
+        double start = nowSeconds();
+        size_t bytes = t->csv ? writeCsvBlock(t, b) : writeBinaryBlock(t, b);
+
+        pthread_mutex_lock(&t->lock);
+        t->stats.bytes += bytes;
+        t->stats.blocks++;
+        t->stats.write_seconds += nowSeconds() - start;
+        t->pending = -1;
+        pthread_cond_broadcast(&t->cond);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+// ---- Sampling ----
+
+static void freeColumns(Telemetry *t) {
+    for (int b = 0; b < 2; b++)
+        for (int w = 0; w < t->count; w++)
+            free(t->blocks[b].columns[w]);
+}
+
+Telemetry *openTelemetry(const char *out_path, int csv, const Watch *watches, int count,
+                         int instances, int block_frames) {
+    if (count <= 0 || count > TELEMETRY_MAX_WATCHES || instances <= 0)
+        return NULL;
+    Telemetry *t = calloc(1, sizeof(Telemetry));
+    if (!t)
+        return NULL;
+    memcpy(t->watches, watches, count * sizeof(Watch));
+    for (int w = 0; w < count; w++)
+        t->offsets[w] = watches[w].kind == WATCH_REGISTER
+                            ? offsetof(Chip8, V) + (watches[w].address & 0xF)
+                            : offsetof(Chip8, memory) + watches[w].address;
+    t->count = count;
+    t->instances = instances;
+    t->block_frames = block_frames > 0 ? block_frames : TELEMETRY_BLOCK;
+    t->csv = csv;
+    t->pending = -1;
+    size_t rows = (size_t)t->block_frames * instances;
+    for (int b = 0; b < 2; b++) {
+        for (int w = 0; w < count; w++) {
+            t->blocks[b].columns[w] = calloc(rows, watches[w].width);
+            if (!t->blocks[b].columns[w]) {
+                fprintf(stderr, "Out of memory for %zu telemetry rows\n", rows);
+                freeColumns(t);
+                free(t);
+                return NULL;
+            }
+        }
+    }
+    t->out = fopen(out_path, csv ? "w" : "wb");
+    if (!t->out) {
+        perror(out_path);
+        freeColumns(t);
+        free(t);
+        return NULL;
+    }
+
+    if (csv) {
+        fprintf(t->out, "frame,instance");
+        for (int w = 0; w < count; w++)
+            fprintf(t->out, ",%s", watches[w].name);
+        fprintf(t->out, "\n");
+    } else {
+        uint8_t header[HEADER_SIZE] = { 0 };
+        memcpy(header, TELEMETRY_MAGIC, 4);
+        header[4] = TELEMETRY_VERSION & 0xFF;
+        header[5] = TELEMETRY_VERSION >> 8;
+        header[6] = count & 0xFF;
+        header[7] = count >> 8;
+        putU32(header + 8, (uint32_t)instances);
+        putU32(header + 12, (uint32_t)t->block_frames);
+        fwrite(header, 1, sizeof(header), t->out);
+        for (int w = 0; w < count; w++) {
+            uint8_t rec[WATCH_SIZE] = { 0 };
+            memcpy(rec, watches[w].name, TELEMETRY_NAME_SIZE);
+            rec[16] = watches[w].address & 0xFF;
+            rec[17] = watches[w].address >> 8;
+            rec[18] = watches[w].width;
+            rec[19] = watches[w].kind;
+            fwrite(rec, 1, sizeof(rec), t->out);
+        }
+    }
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->cond, NULL);
+    pthread_create(&t->writer, NULL, writerThread, t);
+    return t;
+}
+
+void recordTelemetry(Telemetry *t, int instance, const Chip8 *chip8) {
+    Block *b = &t->blocks[t->filling];
+    size_t row = (size_t)t->filled_frames * t->instances + instance;
+    for (int w = 0; w < t->count; w++) {
+        // Most game variables are single bytes: copy them straight out.
+        if (t->watches[w].width == 1) {
+            b->columns[w][row] = ((const uint8_t *)chip8)[t->offsets[w]];
+            continue;
+        }
+        uint32_t value = readWatch(chip8, &t->watches[w]);
+        uint8_t *p = b->columns[w] + row * t->watches[w].width;
+        switch (t->watches[w].width) {
+            case 4:
+                p[3] = value >> 24;
+                p[2] = value >> 16;
+                // Fall through.
+            case 2:
+                p[1] = value >> 8;
+                // Fall through.
+            default:
+                p[0] = value;
+        }
+    }
+}
+
+// Hand the filling block to the writer and switch to the other one,
+// waiting if the writer still has it.
+static void submitBlock(Telemetry *t) {
+    Block *b = &t->blocks[t->filling];
+    b->frames = t->filled_frames;
+    b->first_frame = t->frame - t->filled_frames;
+    pthread_mutex_lock(&t->lock);
+    if (t->pending >= 0)
+        t->stats.stalls++;
+    while (t->pending >= 0)
+        pthread_cond_wait(&t->cond, &t->lock);
+    t->pending = t->filling;
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    t->filling ^= 1;
+    t->filled_frames = 0;
+}
+
+void endTelemetryFrame(Telemetry *t) {
+    t->stats.rows += t->instances;
+    t->frame++;
+    if (++t->filled_frames == t->block_frames)
+        submitBlock(t);
+}
+
+void closeTelemetry(Telemetry *t, TelemetryStats *stats) {
+    if (!t)
+        return;
+    if (t->filled_frames)
+        submitBlock(t);
+    pthread_mutex_lock(&t->lock);
+    t->stop = 1;
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->writer, NULL);
+    fclose(t->out);
+    if (stats)
+        *stats = t->stats;
+    freeColumns(t);
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->cond);
+    free(t);
+}
+
+// ---- Tools ----
+
+int runTelemetryDump(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    uint8_t header[HEADER_SIZE];
+    Watch watches[TELEMETRY_MAX_WATCHES];
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) ||
+        memcmp(header, TELEMETRY_MAGIC, 4) != 0 || (header[4] | header[5] << 8) != TELEMETRY_VERSION) {
+        fprintf(stderr, "%s is not a telemetry file\n", path);
+        fclose(f);
+        return 1;
+    }
+    int count = header[6] | header[7] << 8;
+    uint32_t instances = getU32(header + 8);
+    uint32_t block_frames = getU32(header + 12);
+    if (count <= 0 || count > TELEMETRY_MAX_WATCHES || instances == 0 || block_frames == 0) {
+        fprintf(stderr, "%s: bad header\n", path);
+        fclose(f);
+        return 1;
+    }
+    printf("frame,instance");
+    for (int w = 0; w < count; w++) {
+        uint8_t rec[WATCH_SIZE];
+        if (fread(rec, 1, sizeof(rec), f) != sizeof(rec)) {
+            fprintf(stderr, "%s: truncated\n", path);
+            fclose(f);
+            return 1;
+        }
+        memcpy(watches[w].name, rec, TELEMETRY_NAME_SIZE);
+        watches[w].name[TELEMETRY_NAME_SIZE - 1] = '\0';
+        watches[w].width = rec[18];
+        if (rec[18] != 1 && rec[18] != 2 && rec[18] != 4) {
+            fprintf(stderr, "%s: bad watch width\n", path);
+            fclose(f);
+            return 1;
+        }
+        printf(",%s", watches[w].name);
+    }
+    printf("\n");
+
+    uint8_t *columns[TELEMETRY_MAX_WATCHES] = { 0 };
+    uint8_t block_header[8];
+    int status = 0;
+    while (fread(block_header, 1, sizeof(block_header), f) == sizeof(block_header)) {
+        uint32_t first_frame = getU32(block_header);
+        uint32_t frames = getU32(block_header + 4);
+        if (frames == 0 || frames > block_frames) {
+            fprintf(stderr, "%s: bad block at frame %u\n", path, first_frame);
+            status = 1;
+            break;
+        }
+        size_t rows = (size_t)frames * instances;
+        for (int w = 0; w < count && !status; w++) {
+            uint8_t *grown = realloc(columns[w], rows * watches[w].width + 1);
+            if (!grown) {
+                fprintf(stderr, "%s: out of memory for a block of %zu rows\n", path, rows);
+                status = 1;
+                break;
+            }
+            columns[w] = grown;
+            if (fread(columns[w], watches[w].width, rows, f) != rows) {
+                fprintf(stderr, "%s: truncated block at frame %u\n", path, first_frame);
+                status = 1;
+            }
+        }
+        if (status)
+            break;
+        for (size_t row = 0; row < rows; row++) {
+            printf("%u,%u", first_frame + (uint32_t)(row / instances), (unsigned)(row % instances));
+            for (int w = 0; w < count; w++)
+                printf(",%u", columnValue(columns[w], watches[w].width, row));
+            printf("\n");
+        }
+    }
+    for (int w = 0; w < count; w++)
+        free(columns[w]);
+    fclose(f);
+    return status;
+}
+
+static void resetInstances(Chip8 *machines, const Chip8 *loaded, int instances) {
+    for (int i = 0; i < instances; i++) {
+        machines[i] = *loaded;
+        seedChip8(&machines[i], 0x9E3779B9u * (i + 1));
+    }
+}
+
+// Tap a key now and then, differently per instance, so runs diverge.
+static void tapKeys(Chip8 *chip8, int instance, int frame) {
+    uint32_t h = (uint32_t)instance * 0x85EBCA6Bu ^ (uint32_t)(frame / 8) * 0xC2B2AE35u;
+    h ^= h >> 15;
+    setKeyMask(chip8, h % 4 == 0 ? 1u << (h >> 8 & 15) : 0);
+}
+
+int runTelemetryBench(const char *rom_path, const char *watch_path, const char *out_path,
+                      int instances, int frames) {
+    Watch watches[TELEMETRY_MAX_WATCHES];
+    int count = loadWatchList(watch_path, watches, TELEMETRY_MAX_WATCHES);
+    if (count <= 0) {
+        if (count == 0)
+            fprintf(stderr, "%s has no watches\n", watch_path);
+        return 1;
+    }
+    if (instances <= 0)
+        instances = 1000;
+    if (frames <= 0)
+        frames = 600;
+    Chip8 *loaded = allocChip8(sizeof(Chip8));
+    Chip8 *machines = allocChip8((size_t)instances * sizeof(Chip8));
+    if (!loaded || !machines) {
+        fprintf(stderr, "Out of memory for %d instances\n", instances);
+        free(loaded);
+        free(machines);
+        return 1;
+    }
+    initializeChip8(loaded);
+    if (!loadROM(loaded, rom_path)) {
+        free(loaded);
+        free(machines);
+        return 1;
+    }
+    size_t len = strlen(out_path);
+    int csv = len > 4 && strcasecmp(out_path + len - 4, ".csv") == 0;
+
+    // The same run twice: bare, then sampled.
+    double elapsed[2] = { 0, 0 };
+    TelemetryStats stats;
+    Telemetry *t = NULL;
+    for (int pass = 0; pass < 2; pass++) {
+        resetInstances(machines, loaded, instances);
+        if (pass == 1) {
+            t = openTelemetry(out_path, csv, watches, count, instances, 0);
+            if (!t) {
+                free(loaded);
+                free(machines);
+                return 1;
+            }
+        }
+        double start = nowSeconds();
+        for (int frame = 0; frame < frames; frame++) {
+            for (int i = 0; i < instances; i++) {
+                tapKeys(&machines[i], i, frame);
+                runFrame(&machines[i], DEFAULT_CYCLES_PER_FRAME);
+                if (t)
+                    recordTelemetry(t, i, &machines[i]);
+            }
+            if (t)
+                endTelemetryFrame(t);
+        }
+        elapsed[pass] = nowSeconds() - start;
+    }
+    double start = nowSeconds();
+    closeTelemetry(t, &stats);
+    double drain = nowSeconds() - start;
+
+    printf("instances:  %d x %d frames, %d watches, %s output\n", instances, frames, count,
+           csv ? "CSV" : "binary");
+    printf("bare:       %.3f s\n", elapsed[0]);
+    printf("sampled:    %.3f s (%+.1f%%), %.1f ns per instance-frame\n", elapsed[1],
+           100.0 * (elapsed[1] - elapsed[0]) / elapsed[0],
+           1e9 * (elapsed[1] - elapsed[0]) / ((double)instances * frames));
+    printf("written:    %llu rows, %llu bytes in %llu blocks (%.1f bytes/row)\n",
+           (unsigned long long)stats.rows, (unsigned long long)stats.bytes,
+           (unsigned long long)stats.blocks, stats.rows ? (double)stats.bytes / stats.rows : 0.0);
+    printf("writer:     %.3f s busy, %llu stalls, %.3f s final drain\n", stats.write_seconds,
+           (unsigned long long)stats.stalls, drain);
+    free(loaded);
+    free(machines);
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "chip8.h"
+
+// Guest telemetry: a watch list of guest variables (score, lives, level)
+// sampled once per frame per instance. Samples go into preallocated
+// columns, one per watch, with rows ordered frame-major. When a block of
+// frames fills up, a background thread writes it out while the other
+// block fills, so the emulation thread never formats or does I/O.
+//
+// Watch file, one per line ('#' starts a comment):
+//   <name> <address> [width]
+// where address is a guest address in hex (0x prefix optional), V0..VF or
+// I, and width is 1, 2 or 4 bytes (multi-byte memory is big-endian, as the
+// guest stores it). Width defaults to 1, or 2 for I.
+//
+// Binary format, little-endian:
+//   header  "C8TM", u16 version, u16 watch count, u32 instances,
+//           u32 frames per block (no block holds more)
+//   watches char name[16], u16 address, u8 width, u8 kind     (20 bytes)
+//   blocks  u32 first frame, u32 frames, then per watch a column of
+//           frames * instances values of its width, frame-major
+// CSV has a header row and one row per frame and instance.
+
+#define TELEMETRY_MAGIC       "C8TM"
+#define TELEMETRY_VERSION     2
+#define TELEMETRY_MAX_WATCHES 64
+#define TELEMETRY_NAME_SIZE   16
+#define TELEMETRY_BLOCK       60 // Frames per block.
+
+enum { WATCH_MEMORY, WATCH_REGISTER, WATCH_INDEX };
+
+typedef struct {
+    char name[TELEMETRY_NAME_SIZE];
+    uint16_t address; // Register number for WATCH_REGISTER.
+    uint8_t width;
+    uint8_t kind;
+} Watch;
+
+typedef struct Telemetry Telemetry;
+
+typedef struct {
+    uint64_t rows;
+    uint64_t bytes;        // Written to the file.
+    uint64_t blocks;
+    uint64_t stalls;       // Times the sampler waited for the writer.
+    double write_seconds;  // Writer thread busy time.
+} TelemetryStats;
+
+// Returns the number of watches read, or -1 on error.
+int loadWatchList(const char *path, Watch *watches, int max);
+// block_frames <= 0 uses TELEMETRY_BLOCK.
+Telemetry *openTelemetry(const char *out_path, int csv, const Watch *watches, int count,
+                         int instances, int block_frames);
+// Sample one instance for the current frame.
+void recordTelemetry(Telemetry *t, int instance, const Chip8 *chip8);
+// Finish the current frame once every instance has been recorded.
+void endTelemetryFrame(Telemetry *t);
+// Flush what's left and close the file.
+void closeTelemetry(Telemetry *t, TelemetryStats *stats);
+
+// Binary file to CSV on stdout.
+int runTelemetryDump(const char *path);
+// Batch run of many instances, timed with and without telemetry.
+int runTelemetryBench(const char *rom_path, const char *watch_path, const char *out_path,
+                      int instances, int frames);
+
+#endif
@@ -0,0 +1,418 @@
+#define _DEFAULT_SOURCE
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+#define CONTEXT_RECORDS 8 // Matching records shown before a divergence.
+#define AFTER_RECORDS   4 // Reference records shown after it.
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void captureRecord(Chip8 *chip8, TraceRecord *rec) {
+    rec->pc = chip8->pc;
+    rec->opcode = fetchOpcode(chip8);
+    memcpy(rec->V, chip8->V, sizeof(rec->V));
+    rec->I = chip8->I;
+}
+
+static char *putHex(char *p, unsigned value, int digits) {
+    for (int i = digits - 1; i >= 0; i--)
+        *p++ = hex_digits[(value >> (i * 4)) & 0xF];
+    return p;
+}
+
+// Format a record as a text trace line (without the newline); returns its
+// length. Column of field f: pc 0, opcode 5, V[n] 10 + 3n, I 58.
+static int formatRecord(char *buf, const TraceRecord *rec) {
+    char *p = buf;
+    p = putHex(p, rec->pc, 4);
+    *p++ = ' ';
+    p = putHex(p, rec->opcode, 4);
+    for (int i = 0; i < REGISTER_COUNT; i++) {
+        *p++ = ' ';
+        p = putHex(p, rec->V[i], 2);
+    }
+    *p++ = ' ';
+    p = putHex(p, rec->I, 4);
+    *p = '\0';
+    return (int)(p - buf);
+}
+
+static void packRecord(uint8_t *out, const TraceRecord *rec) {
+    out[0] = rec->pc & 0xFF;
+    out[1] = rec->pc >> 8;
+    out[2] = rec->opcode & 0xFF;
+    out[3] = rec->opcode >> 8;
+    memcpy(out + 4, rec->V, REGISTER_COUNT);
+    out[20] = rec->I & 0xFF;
+    out[21] = rec->I >> 8;
+}
+
+static void unpackRecord(const uint8_t *in, TraceRecord *rec) {
+    rec->pc = in[0] | in[1] << 8;
+    rec->opcode = in[2] | in[3] << 8;
+    memcpy(rec->V, in + 4, REGISTER_COUNT);
+    rec->I = in[20] | in[21] << 8;
+}
+
+// Advance the machine by one instruction, ticking the timers every
+// cycles_per_frame instructions as a frame-based host would.
+static void stepInstruction(Chip8 *chip8, long *cycle, int cycles_per_frame) {
+    emulateCycle(chip8);
+    if (++*cycle % cycles_per_frame == 0)
+        tickTimers(chip8);
+}
+
+static int loadMachine(Chip8 *chip8, const char *rom_path) {
+    initializeChip8(chip8);
+    seedChip8(chip8, 0x2545F491);
+    return loadROM(chip8, rom_path);
+}
+
+// Run a ROM with no input and write its trace.
+int runTraceExport(const char *rom_path, const char *out_path, long instructions,
+                   int binary, int cycles_per_frame) {
+    static Chip8 chip8;
+    if (cycles_per_frame <= 0)
+        cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+    if (!loadMachine(&chip8, rom_path))
+        return 1;
+    FILE *out = fopen(out_path, "wb");
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+    if (binary) {
+        uint8_t header[TRACE_HEADER_SIZE] = { 0 };
+        memcpy(header, TRACE_MAGIC, 4);
+        header[4] = TRACE_VERSION;
+        header[6] = TRACE_RECORD_SIZE;
+        fwrite(header, 1, sizeof(header), out);
+    }
+    long cycle = 0, written = 0;
+    TraceRecord rec;
+    double start = nowSeconds();
+    while (written < instructions && !chip8.halted) {
+        captureRecord(&chip8, &rec);
+        if (binary) {
+            uint8_t packed[TRACE_RECORD_SIZE];
+            packRecord(packed, &rec);
+            fwrite(packed, 1, sizeof(packed), out);
+        } else {
+            char line[80];
+            int len = formatRecord(line, &rec);
+            line[len++] = '\n';
+            fwrite(line, 1, len, out);
+        }
+        written++;
+        stepInstruction(&chip8, &cycle, cycles_per_frame);
+    }
+    if (fclose(out) != 0) {
+        perror(out_path);
+        return 1;
+    }
+    double elapsed = nowSeconds() - start;
+    fprintf(stderr, "%ld records written to %s (%.0f/s)\n", written, out_path,
+            elapsed > 0 ? written / elapsed : 0.0);
+    return 0;
+}
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    int binary;
+    long line; // Text line number of the last record read.
+} TraceReader;
+
+// Hex digit values, or -1; filled on first use.
+static int8_t hex_value[256];
+
+static void initHexTable(void) {
+    memset(hex_value, -1, sizeof(hex_value));
+    for (int i = 0; i < 16; i++) {
+        hex_value[(uint8_t)hex_digits[i]] = i;
+        hex_value[(uint8_t)tolower(hex_digits[i])] = i;
+    }
+}
+
+static int fixedHex(const uint8_t *p, int digits, unsigned *value) {
+    unsigned v = 0;
+    for (int i = 0; i < digits; i++) {
+        int d = hex_value[p[i]];
+        if (d < 0)
+            return 0;
+        v = v << 4 | d;
+    }
+    *value = v;
+    return 1;
+}
+
+// Fast path for lines in exactly the layout formatRecord writes.
+static int parseCanonical(const uint8_t *p, const uint8_t *eol, TraceRecord *rec) {
+    const int length = 62;
+    if (eol - p < length || (eol - p > length && !isspace(p[length])))
+        return 0;
+    unsigned v;
+    if (!fixedHex(p, 4, &v) || p[4] != ' ')
+        return 0;
+    rec->pc = v;
+    if (!fixedHex(p + 5, 4, &v))
+        return 0;
+    rec->opcode = v;
+    for (int i = 0; i < REGISTER_COUNT; i++) {
+        if (p[9 + 3 * i] != ' ' || !fixedHex(p + 10 + 3 * i, 2, &v))
+            return 0;
+        rec->V[i] = v;
+    }
+    if (p[57] != ' ' || !fixedHex(p + 58, 4, &v))
+        return 0;
+    rec->I = v;
+    return 1;
+}
+
+// Parse one hex token, skipping separators and an optional 0x prefix.
+static int parseHex(const uint8_t **pp, const uint8_t *end, unsigned *value) {
+    const uint8_t *p = *pp;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == ',' || *p == ':'))
+        p++;
+    if (p + 1 < end && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+        p += 2;
+    unsigned v = 0;
+    const uint8_t *digits = p;
+    for (; p < end && hex_value[*p] >= 0; p++)
+        v = v << 4 | hex_value[*p];
+    if (p == digits)
+        return 0;
+    *pp = p;
+    *value = v;
+    return 1;
+}
+
+// Returns 1 with a record, 0 at the end, -1 on a malformed record.
+static int nextRecord(TraceReader *r, TraceRecord *rec) {
+    if (r->binary) {
+        if (r->end - r->p < TRACE_RECORD_SIZE)
+            return 0;
+        unpackRecord(r->p, rec);
+        r->p += TRACE_RECORD_SIZE;
+        r->line++;
+        return 1;
+    }
+    for (;;) {
+        if (r->p >= r->end)
+            return 0;
+        const uint8_t *eol = memchr(r->p, '\n', r->end - r->p);
+        if (!eol)
+            eol = r->end;
+        r->line++;
+        const uint8_t *p = r->p;
+        r->p = eol < r->end ? eol + 1 : eol;
+        while (p < eol && isspace(*p))
+            p++;
+        if (p == eol || *p == '#')
+            continue;
+        if (parseCanonical(p, eol, rec))
+            return 1;
+        unsigned v;
+        if (!parseHex(&p, eol, &v))
+            return -1;
+        rec->pc = v;
+        if (!parseHex(&p, eol, &v))
+            return -1;
+        rec->opcode = v;
+        for (int i = 0; i < REGISTER_COUNT; i++) {
+            if (!parseHex(&p, eol, &v))
+                return -1;
+            rec->V[i] = v;
+        }
+        if (!parseHex(&p, eol, &v))
+            return -1;
+        rec->I = v;
+        return 1;
+    }
+}
+
+static int parseIgnoreList(const char *list, uint32_t *mask) {
+    *mask = 0;
+    if (!list || !*list)
+        return 1;
+    char *copy = strdup(list);
+    int ok = 1;
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+        if (strcasecmp(tok, "pc") == 0)
+            *mask |= TRACE_FIELD_PC;
+        else if (strcasecmp(tok, "opcode") == 0)
+            *mask |= TRACE_FIELD_OPCODE;
+        else if (strcasecmp(tok, "I") == 0)
+            *mask |= TRACE_FIELD_I;
+        else if ((tok[0] == 'V' || tok[0] == 'v') && isxdigit((unsigned char)tok[1]) && !tok[2])
+            *mask |= TRACE_FIELD_V(strtol(tok + 1, NULL, 16));
+        else {
+            fprintf(stderr, "Unknown trace field: %s\n", tok);
+            ok = 0;
+        }
+    }
+    free(copy);
+    return ok;
+}
+
+// Bitmask of fields that differ and are not ignored.
+static uint32_t diffRecords(const TraceRecord *a, const TraceRecord *b, uint32_t ignore) {
+    uint32_t diff = 0;
+    if (a->pc != b->pc)
+        diff |= TRACE_FIELD_PC;
+    if (a->opcode != b->opcode)
+        diff |= TRACE_FIELD_OPCODE;
+    if (a->I != b->I)
+        diff |= TRACE_FIELD_I;
+    if (memcmp(a->V, b->V, REGISTER_COUNT) != 0)
+        for (int i = 0; i < REGISTER_COUNT; i++)
+            if (a->V[i] != b->V[i])
+                diff |= TRACE_FIELD_V(i);
+    return diff & ~ignore;
+}
+
+static void printRecord(const char *label, long index, const TraceRecord *rec) {
+    char line[80];
+    formatRecord(line, rec);
+    if (index >= 0)
+        printf("  %-5s %10ld  %s\n", label, index, line);
+    else
+        printf("  %-5s %10s  %s\n", label, "", line);
+}
+
+static void printDivergence(uint32_t diff) {
+    char marks[80];
+    memset(marks, ' ', sizeof(marks));
+    int len = 0;
+    for (int f = 0; f < 19; f++) {
+        if (!((diff >> f) & 1))
+            continue;
+        int col, width;
+        if (f < 16) {
+            col = 10 + 3 * f;
+            width = 2;
+        } else {
+            col = f == 16 ? 0 : f == 17 ? 5 : 58;
+            width = 4;
+        }
+        memset(marks + col, '^', width);
+        if (col + width > len)
+            len = col + width;
+    }
+    marks[len] = '\0';
+    printf("  %-5s %10s  %s\n", "", "", marks);
+}
+
+// Compare our execution against a reference trace, streaming it from an
+// mmap. Ignored fields are not compared and are copied from the reference
+// into our machine, so RNG-driven registers don't cascade into false
+// divergences later.
+int runTraceCompare(const char *ref_path, const char *rom_path, const char *ignore_list,
+                    int cycles_per_frame) {
+    static Chip8 chip8;
+    uint32_t ignore;
+    if (!parseIgnoreList(ignore_list, &ignore))
+        return 1;
+    if (cycles_per_frame <= 0)
+        cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+    if (!loadMachine(&chip8, rom_path))
+        return 1;
+
+    int fd = open(ref_path, O_RDONLY);
+    struct stat st;
+    if (fd < 0) {
+        perror(ref_path);
+        return 1;
+    }
+    if (fstat(fd, &st) < 0) {
+        perror(ref_path);
+        close(fd);
+        return 1;
+    }
+    TraceReader reader = { NULL, NULL, 0, 0 };
+    initHexTable();
+    void *map = NULL;
+    if (st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return 1;
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        reader.p = map;
+        reader.end = reader.p + st.st_size;
+    }
+    close(fd);
+    if (reader.end - reader.p >= TRACE_HEADER_SIZE && memcmp(reader.p, TRACE_MAGIC, 4) == 0) {
+        if (reader.p[4] != TRACE_VERSION || reader.p[6] != TRACE_RECORD_SIZE) {
+            fprintf(stderr, "Unsupported binary trace version\n");
+            munmap(map, st.st_size);
+            return 1;
+        }
+        reader.binary = 1;
+        reader.p += TRACE_HEADER_SIZE;
+    }
+
+    TraceRecord history[CONTEXT_RECORDS];
+    TraceRecord ref, ours;
+    long index = 0, cycle = 0;
+    int status = 0, got;
+    double start = nowSeconds();
+    while ((got = nextRecord(&reader, &ref)) == 1) {
+        captureRecord(&chip8, &ours);
+        uint32_t diff = diffRecords(&ref, &ours, ignore);
+        if (diff) {
+            printf("Divergence at instruction %ld (reference %s %ld):\n", index,
+                   reader.binary ? "record" : "line", reader.line);
+            long first = index > CONTEXT_RECORDS ? index - CONTEXT_RECORDS : 0;
+            for (long i = first; i < index; i++)
+                printRecord("", i, &history[i % CONTEXT_RECORDS]);
+            printRecord("ref", index, &ref);
+            printRecord("ours", -1, &ours);
+            printDivergence(diff);
+            for (int i = 1; i <= AFTER_RECORDS && nextRecord(&reader, &ref) == 1; i++)
+                printRecord("ref", index + i, &ref);
+            status = 2;
+            break;
+        }
+        if (ignore & 0xFFFF)
+            for (int i = 0; i < REGISTER_COUNT; i++)
+                if ((ignore >> i) & 1)
+                    chip8.V[i] = ref.V[i];
+        if (ignore & TRACE_FIELD_I)
+            chip8.I = ref.I;
+        history[index % CONTEXT_RECORDS] = ref;
+        index++;
+        stepInstruction(&chip8, &cycle, cycles_per_frame);
+    }
+    double elapsed = nowSeconds() - start;
+    fflush(stdout);
+    if (got < 0) {
+        fprintf(stderr, "Malformed reference record at line %ld\n", reader.line);
+        status = 1;
+    } else if (status == 0) {
+        printf("No divergence in %ld instructions.\n", index);
+    }
+    fprintf(stderr, "compared %ld instructions in %.2f s (%.1fM/min)\n", index, elapsed,
+            elapsed > 0 ? index / elapsed * 60 / 1e6 : 0.0);
+    if (map)
+        munmap(map, st.st_size);
+    return status;
+}
@@ -0,0 +1,40 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "chip8.h"
+
+// Execution traces: one record per instruction, taken before it executes.
+//
+// Text format, one line per record (the common "pc opcode V0..VF I" layout):
+//   0200 00E0 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 0000
+// Hex tokens may carry a 0x prefix; lines starting with '#' are ignored.
+//
+// Binary format: a 16-byte header ("C8TR", u16 version, u16 record size,
+// 8 reserved bytes) followed by packed little-endian records:
+//   u16 pc, u16 opcode, u8 V[16], u16 I   (22 bytes)
+
+#define TRACE_MAGIC        "C8TR"
+#define TRACE_VERSION      1
+#define TRACE_HEADER_SIZE  16
+#define TRACE_RECORD_SIZE  22
+
+// Fields that --trace-compare can be told to ignore.
+#define TRACE_FIELD_PC     (1u << 16)
+#define TRACE_FIELD_OPCODE (1u << 17)
+#define TRACE_FIELD_I      (1u << 18)
+#define TRACE_FIELD_V(n)   (1u << (n))
+
+typedef struct {
+    uint16_t pc;
+    uint16_t opcode;
+    uint8_t V[REGISTER_COUNT];
+    uint16_t I;
+} TraceRecord;
+
+int runTraceExport(const char *rom_path, const char *out_path, long instructions,
+                   int binary, int cycles_per_frame);
+int runTraceCompare(const char *ref_path, const char *rom_path, const char *ignore,
+                    int cycles_per_frame);
+
+#endif
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <string.h>
+#include "warmstart.h"
+#include "cache.h"
+#include "kernels.h"
+#include "memo.h"
+
+#define WARMSTART_MAGIC   0x53573843u // "C8WS"
+#define WARMSTART_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t frames;   // Frames run; fewer than asked if the machine halted.
+    uint32_t reserved;
+    uint64_t key;
+    uint64_t core;
+} WarmStartHeader;
+
+static WarmStartStats stats;
+
+static void count(uint64_t *counter, uint64_t n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+int warmStart(Chip8 *chip8, int frames, int cycles, const uint16_t *keys, int nkeys, int *hit) {
+    if (hit)
+        *hit = 0;
+    if (frames <= 0)
+        return 0;
+    uint64_t key = hashMix(hashMix(hashState(chip8), (uint64_t)cycles), (uint64_t)frames);
+    for (int f = 0; f < frames; f++)
+        key = hashMix(key, f < nkeys ? keys[f] : 0);
+
+    static __thread uint8_t buf[sizeof(WarmStartHeader) + CHIP8_STATE_SIZE];
+    WarmStartHeader h;
+    char path[4096];
+    int cacheable = cachePath("warmstart", key, ".snap", path, sizeof(path));
+    count(&stats.lookups, 1);
+    if (cacheable && readCacheFile(path, buf, sizeof(buf)) == (long)sizeof(buf)) {
+        memcpy(&h, buf, sizeof(h));
+        if (h.magic == WARMSTART_MAGIC && h.version == WARMSTART_VERSION && h.key == key) {
+            if (h.core != chip8CoreId())
+                count(&stats.stale, 1);
+            else if (loadState(chip8, buf + sizeof(h), CHIP8_STATE_SIZE)) {
+                count(&stats.hits, 1);
+                count(&stats.frames_skipped, h.frames);
+                if (hit)
+                    *hit = 1;
+                return (int)h.frames;
+            }
+        }
+    }
+
+    int f;
+    for (f = 0; f < frames && !chip8->halted; f++) {
+        setKeyMask(chip8, f < nkeys ? keys[f] : 0);
+        runFrame(chip8, cycles);
+    }
+    if (cacheable) {
+        h = (WarmStartHeader){ WARMSTART_MAGIC, WARMSTART_VERSION, (uint32_t)f, 0, key, chip8CoreId() };
+        memcpy(buf, &h, sizeof(h));
+        saveState(chip8, buf + sizeof(h), CHIP8_STATE_SIZE);
+        if (writeCacheFile(path, buf, sizeof(buf)))
+            count(&stats.stores, 1);
+    }
+    return f;
+}
+
+void getWarmStartStats(WarmStartStats *out) {
+    out->lookups = __atomic_load_n(&stats.lookups, __ATOMIC_RELAXED);
+    out->hits = __atomic_load_n(&stats.hits, __ATOMIC_RELAXED);
+    out->stale = __atomic_load_n(&stats.stale, __ATOMIC_RELAXED);
+    out->stores = __atomic_load_n(&stats.stores, __ATOMIC_RELAXED);
+    out->frames_skipped = __atomic_load_n(&stats.frames_skipped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,33 @@
+#ifndef WARMSTART_H
+#define WARMSTART_H
+
+#include <stdint.h>
+#include "chip8.h"
+
+// Warm-start cache. Batch jobs of one ROM often replay the same title
+// screen or intro before they diverge. warmStart runs a declared prefix
+// of frames once and stores the machine on disk (cache kind "warmstart");
+// later jobs with the same prefix load it instead.
+//
+// The key is a hash of the booted machine (so the ROM, quirks and seed),
+// the cycles per frame, the prefix length and the keys held during it.
+// Entries record the core version (CHIP8_CORE_VERSION and the state
+// format); an entry from another version is a miss and is replaced.
+
+typedef struct {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t stale;          // Entries written by another core version.
+    uint64_t stores;
+    uint64_t frames_skipped; // Frames loaded rather than run.
+} WarmStartStats;
+
+// Advance a freshly booted machine by up to `frames` frames, holding
+// keys[f] in frame f (nothing past nkeys), stopping early if it halts.
+// Returns the frames advanced; *hit (if not NULL) says whether they came
+// from the cache. The result is exactly what running them would give.
+int warmStart(Chip8 *chip8, int frames, int cycles, const uint16_t *keys, int nkeys, int *hit);
+// Counts for this process.
+void getWarmStartStats(WarmStartStats *stats);
+
+#endif